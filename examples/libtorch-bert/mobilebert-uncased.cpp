@@ -33,9 +33,11 @@ int main(int argc, char* argv[]) {
   torch::Tensor input_ids_tensor = torch::from_blob(
       encoding.ids.data(), {1, static_cast<long>(encoding.ids.size())},
       torch::kInt32);
-  torch::Tensor attention_mask_tensor = torch::from_blob(
-      encoding.attention_mask.data(),
-      {1, static_cast<long>(encoding.attention_mask.size())}, torch::kInt32);
+  torch::Tensor attention_mask_tensor =
+      torch::from_blob(encoding.attention_mask.data(),
+                       {1, static_cast<long>(encoding.attention_mask.size())},
+                       torch::kUInt8)
+          .to(torch::kInt32);
   std::vector<torch::jit::IValue> inputs;
   inputs.push_back(input_ids_tensor);
   inputs.push_back(attention_mask_tensor);
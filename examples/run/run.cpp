@@ -6,6 +6,7 @@
 #include <string>
 #include <utility>
 #include <variant>
+#include <vector>
 
 #include "tokenizers/common.h"
 #include "tokenizers/tokenizer.h"
@@ -53,20 +54,26 @@ int main(int argc, char* argv[]) {
   std::cout << "Encoding: " << convert_to_string(input) << std::endl;
   std::cout << "ids: ";
   print_result(std::vector<var_type>(result.ids.begin(), result.ids.end()));
+  std::vector<var_type> type_ids, tokens, words, offsets, attention_mask;
+  for (int i = 0; i < result.ids.size(); i++) {
+    type_ids.push_back(static_cast<int>(result.type_ids[i]));
+    tokens.push_back(std::string(result.tokens[i]));
+    words.push_back(result.words[i] == NO_WORD
+                        ? std::nullopt
+                        : std::optional<int>(result.words[i]));
+    offsets.push_back(std::pair<int, int>(result.offsets[i]));
+    attention_mask.push_back(static_cast<int>(result.attention_mask[i]));
+  }
   std::cout << "type_ids: ";
-  print_result(
-      std::vector<var_type>(result.type_ids.begin(), result.type_ids.end()));
+  print_result(type_ids);
   std::cout << "tokens: ";
-  print_result(
-      std::vector<var_type>(result.tokens.begin(), result.tokens.end()));
+  print_result(tokens);
   std::cout << "words: ";
-  print_result(std::vector<var_type>(result.words.begin(), result.words.end()));
+  print_result(words);
   std::cout << "offsets: ";
-  print_result(
-      std::vector<var_type>(result.offsets.begin(), result.offsets.end()));
+  print_result(offsets);
   std::cout << "attention_mask: ";
-  print_result(std::vector<var_type>(result.attention_mask.begin(),
-                                     result.attention_mask.end()));
+  print_result(attention_mask);
 
   std::string decoded_result = tokenizer.decode(result.ids);
   std::cout << "Decoding: ";
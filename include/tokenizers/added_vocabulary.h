@@ -41,8 +41,16 @@ class AddedVocabulary {
                          Normalizer *normalizer);
   bool is_special_token(const std::string &token) const;
   std::optional<std::string> id_to_token(int id);
+  const std::unordered_map<int, AddedToken> &get_added_tokens_decoder() const;
   PreTokenizedString extract_and_normalize(const Normalizer *normalizer,
-                                           const std::wstring &sequence);
+                                           const std::wstring &sequence,
+                                           bool track_offsets = true) const;
+  // Whether any added token is matched after normalization.
+  bool has_normalized_tokens() const;
+  // Added tokens matched before normalization, as character ranges of
+  // sequence alongside the runs between them.
+  std::vector<std::pair<std::optional<int>, std::pair<int, int>>>
+  find_non_normalized_matches(const std::wstring &sequence) const;
 
  private:
   bool encode_special_tokens;
@@ -56,7 +64,7 @@ class AddedVocabulary {
   void refresh_added_tokens(Model *model, Normalizer *normalizer);
   std::vector<std::pair<std::optional<int>, std::pair<int, int>>> find_matches(
       std::string sentence,
-      std::pair<std::vector<std::string>, std::vector<int>> split_re);
+      std::pair<std::vector<std::string>, std::vector<int>> split_re) const;
 };
 
 std::unique_ptr<AddedVocabulary> with_added_vocabulary(
@@ -0,0 +1,65 @@
+// Copyright 2024 Omkar Prabhu
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Tokenizer binary file: a header, a table of sections and the sections,
+// each aligned to BINARY_ALIGNMENT so the flat tables in them can be used in
+// place once the file is mapped. Files are read with the byte order they
+// were written with, a mismatch failing the magic check.
+const uint32_t BINARY_MAGIC = 0x4b4f5442;
+const uint32_t BINARY_VERSION = 2;
+const size_t BINARY_ALIGNMENT = 8;
+
+enum BINARY_SECTION {
+  CONFIG_BINARY_SECTION,
+  VOCAB_BINARY_SECTION,
+  MERGES_BINARY_SECTION,
+  UNKNOWN_BINARY_SECTION
+};
+
+// Whole file mapped read-only, so processes mapping the same file share its
+// pages.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  const char *data() const;
+  size_t size() const;
+
+ private:
+  void *address;
+  size_t length;
+};
+
+class BinaryWriter {
+ public:
+  // Section of data, which must outlive write.
+  void add_section(BINARY_SECTION kind, std::string_view data);
+  void write(const std::string &path) const;
+
+ private:
+  std::vector<std::pair<BINARY_SECTION, std::string_view>> sections;
+};
+
+class BinaryReader {
+ public:
+  // Maps path, checking its header and that its sections lie in the file.
+  explicit BinaryReader(const std::string &path);
+  std::optional<std::string_view> section(BINARY_SECTION kind) const;
+  // Mapping to keep alive while the sections are viewed.
+  std::shared_ptr<const MappedFile> file() const;
+
+ private:
+  std::shared_ptr<const MappedFile> mapped;
+  std::vector<std::pair<BINARY_SECTION, std::string_view>> sections;
+};
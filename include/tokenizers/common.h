@@ -1,31 +1,74 @@
 // Copyright 2024 Omkar Prabhu
 #pragma once
 
+#include <unicode/umachine.h>
+
 #include <codecvt>
 #include <cstdint>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+// Encoding fields to compute besides ids, which are always filled. Fields
+// left out stay empty.
+enum ENCODE_OPTION : uint32_t {
+  TYPE_IDS_ENCODE_OPTION = 1 << 0,
+  TOKENS_ENCODE_OPTION = 1 << 1,
+  WORDS_ENCODE_OPTION = 1 << 2,
+  OFFSETS_ENCODE_OPTION = 1 << 3,
+  SPECIAL_TOKENS_MASK_ENCODE_OPTION = 1 << 4,
+  ATTENTION_MASK_ENCODE_OPTION = 1 << 5,
+  IDS_ONLY_ENCODE_OPTION = 0,
+  ALL_ENCODE_OPTION = (1 << 6) - 1
+};
+
+// Bitmask of ENCODE_OPTION values.
+using EncodeOptions = uint32_t;
+
+// Word index of tokens that belong to no word, such as special tokens.
+const int32_t NO_WORD = -1;
+
+// Owns one copy of every distinct token string, so encodings can hold views
+// that stay valid for the lifetime of the storage.
+class TokenStorage {
+ public:
+  std::string_view intern(std::string_view token);
+
+ private:
+  std::unordered_set<std::string> tokens;
+  std::mutex mutex;
+};
+
 class Encoding {
  public:
-  std::vector<int> ids;
-  std::vector<int> type_ids;
-  std::vector<std::string> tokens;
-  std::vector<std::optional<int>> words;
-  std::vector<std::pair<int, int>> offsets;
-  std::vector<int> special_tokens_mask;
-  std::vector<int> attention_mask;
+  std::vector<int32_t> ids;
+  std::vector<uint32_t> type_ids;
+  // Views into token storage owned by the tokenizer or its components.
+  std::vector<std::string_view> tokens;
+  std::vector<int32_t> words;
+  std::vector<std::pair<uint32_t, uint32_t>> offsets;
+  std::vector<uint8_t> special_tokens_mask;
+  std::vector<uint8_t> attention_mask;
   std::vector<Encoding> overflowing;
+  // Fields this encoding carries.
+  EncodeOptions fields = ALL_ENCODE_OPTION;
   Encoding();
-  Encoding(const std::vector<int> &ids, const std::vector<int> &type_ids,
-           const std::vector<std::string> &tokens,
-           const std::vector<std::optional<int>> &words,
-           const std::vector<std::pair<int, int>> &offsets,
-           const std::vector<int> &special_tokens_mask,
-           const std::vector<int> &attention_mask);
+  Encoding(const std::vector<int32_t> &ids,
+           const std::vector<uint32_t> &type_ids,
+           const std::vector<std::string_view> &tokens,
+           const std::vector<int32_t> &words,
+           const std::vector<std::pair<uint32_t, uint32_t>> &offsets,
+           const std::vector<uint8_t> &special_tokens_mask,
+           const std::vector<uint8_t> &attention_mask);
+  // Reserves length entries in every carried field.
+  void reserve(size_t length);
+  // Empties every field, keeping the capacity for reuse.
+  void clear();
 };
 
 class Token {
@@ -37,11 +80,55 @@ class Token {
   Token(int id, std::string value, std::pair<int, int> offsets);
 };
 
-enum SPLIT_DELIMITER_BEHAVIOR { REMOVED, ISOLATED };
+enum SPLIT_DELIMITER_BEHAVIOR {
+  REMOVED,
+  ISOLATED,
+  MERGED_WITH_PREVIOUS,
+  MERGED_WITH_NEXT,
+  CONTIGUOUS
+};
 
 SPLIT_DELIMITER_BEHAVIOR
 get_split_delimiter_behavior(const std::string &behavior);
 
+enum PREPEND_SCHEME {
+  ALWAYS_PREPEND_SCHEME,
+  FIRST_PREPEND_SCHEME,
+  NEVER_PREPEND_SCHEME
+};
+
+PREPEND_SCHEME get_prepend_scheme(const std::string &scheme);
+
+enum PATTERN_TYPE { STRING_PATTERN_TYPE, REGEX_PATTERN_TYPE };
+
+// Offset of the first occurrence of needle at or after pos, or npos. Candidates
+// come from a vectorized scan for the first unit and are rejected on the last
+// unit before the full comparison.
+template <typename CharT>
+size_t find_literal(std::basic_string_view<CharT> haystack,
+                    std::basic_string_view<CharT> needle, size_t pos = 0) {
+  using traits = std::char_traits<CharT>;
+  size_t n = needle.size();
+  if (n == 0 || pos > haystack.size() || haystack.size() - pos < n) {
+    return std::basic_string_view<CharT>::npos;
+  }
+  const CharT *data = haystack.data();
+  const CharT *cursor = data + pos;
+  const CharT *last = data + haystack.size() - n;
+  while (cursor <= last) {
+    const CharT *found = traits::find(cursor, last - cursor + 1, needle[0]);
+    if (found == nullptr) {
+      break;
+    }
+    if (traits::eq(found[n - 1], needle[n - 1]) &&
+        traits::compare(found + 1, needle.data() + 1, n - 1) == 0) {
+      return found - data;
+    }
+    cursor = found + 1;
+  }
+  return std::basic_string_view<CharT>::npos;
+}
+
 class Split {
  public:
   std::string normalized;
@@ -56,3 +143,19 @@ std::string convert_to_string(std::wstring sequence);
 std::wstring convert_from_string(std::string sequence);
 
 std::unordered_map<uint16_t, std::string> bytes_char();
+
+enum CHAR_CLASS : uint8_t {
+  WHITESPACE_CHAR_CLASS = 1 << 0,
+  PUNCTUATION_CHAR_CLASS = 1 << 1,
+  NUMERIC_CHAR_CLASS = 1 << 2,
+  WORD_CHAR_CLASS = 1 << 3
+};
+
+// Bitmask of CHAR_CLASS values, served from a table built once for the BMP.
+uint8_t get_char_class(UChar32 c);
+
+const uint8_t ANY_SCRIPT = 0xFF;
+
+// UScriptCode of a codepoint with Hiragana, Katakana and U+30FC folded into
+// Han and the space reported as ANY_SCRIPT, served from a two-level table.
+uint8_t get_char_script(UChar32 c);
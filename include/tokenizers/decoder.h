@@ -1,12 +1,16 @@
 // Copyright 2024 Omkar Prabhu
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 #include "simdjson.h"
+#include "tokenizers/common.h"
+#include "tokenizers/regex.h"
 
 enum DECODER {
   SEQUENCE_DECODER,
@@ -24,11 +28,31 @@ enum DECODER {
 
 DECODER get_decoder(std::string type);
 
+// Tokens stored back to back in one buffer, token i spanning
+// [ends[i - 1], ends[i]), so the buffer is also their concatenation.
+class DecodedTokens {
+ public:
+  std::string buffer;
+  std::vector<int> ends;
+  DecodedTokens();
+  explicit DecodedTokens(const std::vector<std::string> &tokens);
+  int size() const;
+  std::string_view token(int i) const;
+  void push_back(std::string_view token);
+  void end_token();
+  void clear();
+  std::vector<std::string> to_vector() const;
+};
+
 class Decoder {
  public:
   virtual ~Decoder() = default;
-  virtual std::vector<std::string> decode_chain(
-      std::vector<std::string> tokens) const = 0;
+  std::vector<std::string> decode_chain(std::vector<std::string> tokens) const;
+  std::string decode(const DecodedTokens &tokens) const;
+  // Appends the decoded tokens to output, which must not alias tokens.
+  virtual void decode_into(const DecodedTokens &tokens,
+                           DecodedTokens *output) const = 0;
+  virtual void collect_stages(std::vector<const Decoder *> *stages) const;
 };
 
 std::unique_ptr<Decoder> with_decoder(
@@ -37,8 +61,8 @@ std::unique_ptr<Decoder> with_decoder(
 class WordPieceDecoder : public Decoder {
  public:
   explicit WordPieceDecoder(std::string prefix = "##", bool cleanup = true);
-  std::vector<std::string> decode_chain(
-      std::vector<std::string> tokens) const override;
+  void decode_into(const DecodedTokens &tokens,
+                   DecodedTokens *output) const override;
 
  private:
   std::string prefix;
@@ -48,34 +72,37 @@ class WordPieceDecoder : public Decoder {
 class ReplaceDecoder : public Decoder {
  public:
   explicit ReplaceDecoder(const std::string &pattern,
-                          const std::string &content);
-  std::vector<std::string> decode_chain(
-      std::vector<std::string> tokens) const override;
+                          const std::string &content,
+                          PATTERN_TYPE pattern_type = STRING_PATTERN_TYPE);
+  void decode_into(const DecodedTokens &tokens,
+                   DecodedTokens *output) const override;
 
  private:
   std::string pattern;
   std::string content;
+  PATTERN_TYPE pattern_type;
+  Regex regex;
 };
 
 class ByteFallbackDecoder : public Decoder {
  public:
   ByteFallbackDecoder();
-  std::vector<std::string> decode_chain(
-      std::vector<std::string> tokens) const override;
+  void decode_into(const DecodedTokens &tokens,
+                   DecodedTokens *output) const override;
 };
 
 class FuseDecoder : public Decoder {
  public:
   FuseDecoder();
-  std::vector<std::string> decode_chain(
-      std::vector<std::string> tokens) const override;
+  void decode_into(const DecodedTokens &tokens,
+                   DecodedTokens *output) const override;
 };
 
 class StripDecoder : public Decoder {
  public:
   explicit StripDecoder(const std::string &content, int start, int stop);
-  std::vector<std::string> decode_chain(
-      std::vector<std::string> tokens) const override;
+  void decode_into(const DecodedTokens &tokens,
+                   DecodedTokens *output) const override;
 
  private:
   std::string content;
@@ -83,11 +110,24 @@ class StripDecoder : public Decoder {
   int stop;
 };
 
+class MetaspaceDecoder : public Decoder {
+ public:
+  explicit MetaspaceDecoder(const std::string &replacement = "\u2581",
+                            const std::string &prepend_scheme = "always");
+  void decode_into(const DecodedTokens &tokens,
+                   DecodedTokens *output) const override;
+
+ private:
+  std::string replacement;
+  PREPEND_SCHEME prepend_scheme;
+};
+
 class SequenceDecoder : public Decoder {
  public:
   explicit SequenceDecoder(std::vector<std::unique_ptr<Decoder>> decoders);
-  std::vector<std::string> decode_chain(
-      std::vector<std::string> tokens) const override;
+  void decode_into(const DecodedTokens &tokens,
+                   DecodedTokens *output) const override;
+  void collect_stages(std::vector<const Decoder *> *stages) const override;
 
  private:
   std::vector<std::unique_ptr<Decoder>> decoders;
@@ -96,9 +136,99 @@ class SequenceDecoder : public Decoder {
 class ByteLevelDecoder : public Decoder {
  public:
   ByteLevelDecoder();
-  std::vector<std::string> decode_chain(
-      std::vector<std::string> tokens) const override;
+  void decode_into(const DecodedTokens &tokens,
+                   DecodedTokens *output) const override;
+  void append_bytes(std::string_view token, std::string *bytes) const;
+
+ private:
+  std::vector<int> CHAR_BYTES;
+};
+
+// Decoded bytes of every id, built once for decoder chains whose stages up
+// to the first fusing one (Fuse or ByteLevel) act on each token on its own.
+// Decoding is then a gather of entries, and only the stages after the fusing
+// one run on the joined result.
+class DecodeTable {
+ public:
+  DecodeTable();
+  explicit DecodeTable(const Decoder *decoder,
+                       const std::vector<std::optional<std::string>> &tokens,
+                       const std::vector<bool> &special);
+  bool is_enabled() const;
+  std::string decode(const std::vector<int> &ids,
+                     bool skip_special_tokens = true) const;
+  void decode_into(const int *ids, size_t length, bool skip_special_tokens,
+                   std::string *output) const;
+  int size() const;
+  // Bytes of id when decoded after other tokens.
+  std::optional<std::string_view> token_bytes(int id) const;
+
+ private:
+  bool enabled;
+  bool byte_fallback;
+  bool position_dependent;
+  const ByteLevelDecoder *byte_level;
+  std::vector<const Decoder *> per_token;
+  std::vector<const Decoder *> fused;
+  DecodedTokens entries;
+  DecodedTokens sources;
+  std::vector<bool> known;
+  std::vector<bool> special;
+  std::vector<bool> fallback_bytes;
+  std::string entry(std::string_view token, bool *is_byte) const;
+};
+
+// Byte trie over the decoded bytes of every id, as they decode after other
+// tokens. Ids are kept sorted by their bytes so every node covers a range.
+class VocabularyIndex {
+ public:
+  explicit VocabularyIndex(
+      const std::vector<std::optional<std::string>> &token_bytes);
+  explicit VocabularyIndex(const DecodeTable &table);
+  // Ids whose bytes start with prefix.
+  std::vector<bool> starting_with(std::string_view prefix) const;
+  // Ids whose bytes are a prefix of text, including all of it.
+  std::vector<bool> prefixes_of(std::string_view text) const;
+
+ private:
+  int size;
+  std::vector<int> order;
+  std::vector<int> begins;
+  std::vector<int> exact_ends;
+  std::vector<int> ends;
+  std::vector<int> edge_begins;
+  std::vector<int> edge_ends;
+  std::vector<uint8_t> edge_bytes;
+  std::vector<int> edge_targets;
+  void build(const std::vector<std::string_view> &bytes);
+  int add_node(const std::vector<std::string_view> &bytes, int begin, int end,
+               int depth);
+  int child(int node, uint8_t byte) const;
+};
+
+class StopMatch {
+ public:
+  int stop;
+  int token;
+  size_t start;
+  size_t end;
+  StopMatch(int stop, int token, size_t start, size_t end);
+};
+
+// Aho-Corasick automaton over the bytes of stop sequences, fed with the text
+// streamed for each token. Positions count bytes fed since the last reset.
+class StopSequenceMatcher {
+ public:
+  explicit StopSequenceMatcher(const std::vector<std::string> &stops);
+  // Returns the first stop sequence completed by text, which was decoded up
+  // to the token at index token, preferring the longest one ending first.
+  std::optional<StopMatch> feed(std::string_view text, int token);
+  void reset();
 
  private:
-  std::unordered_map<std::string, uint16_t> CHAR_BYTES;
+  std::vector<int> transitions;
+  std::vector<int> matches;
+  std::vector<int> lengths;
+  int state;
+  size_t position;
 };
@@ -1,11 +1,15 @@
 // Copyright 2024 Omkar Prabhu
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
 #include <optional>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -24,20 +28,97 @@ enum MODEL {
 
 MODEL get_model(std::string type);
 
+// Tokens and ids in one flat blob: a header, a linear probing table of
+// {offset, length, id, tag} slots by token, pointing into a string arena,
+// and a table of slots by id. The blob is built and owned, or borrowed from
+// a mapped file kept alive by owner, and used in place either way.
+class Vocab {
+ public:
+  Vocab();
+  explicit Vocab(const std::unordered_map<std::string, int> &vocab);
+  // The first of tokens repeated is kept.
+  explicit Vocab(const std::vector<std::pair<std::string_view, int>> &tokens);
+  // Views the blob of size bytes at data, which must be 4-byte aligned.
+  Vocab(const char *data, size_t size, std::shared_ptr<const void> owner);
+  int size() const;
+  // One past the largest id.
+  int id_count() const;
+  std::optional<int> find(std::string_view token) const;
+  std::optional<std::string_view> token(int id) const;
+  std::string_view blob() const;
+
+ private:
+  // Hash bits compared before the bytes, zero for empty slots.
+  struct Slot {
+    uint32_t offset;
+    uint32_t length;
+    int32_t id;
+    uint32_t tag;
+  };
+  std::shared_ptr<const void> owner;
+  const char *data;
+  size_t data_size;
+  uint32_t count;
+  uint32_t slot_mask;
+  const Slot *slots;
+  const int32_t *ids;
+  uint32_t ids_size;
+  const char *bytes;
+  uint32_t bytes_size;
+  void view(const char *data, size_t size);
+};
+
+// BPE merge of the pair (left, right) into new_id, applied by rank.
+struct MergeEntry {
+  int32_t left;
+  int32_t right;
+  int32_t rank;
+  int32_t new_id;
+};
+
+// Merges in one flat blob: a header and a linear probing table of entries by
+// pair, empty slots having a negative left. Owned or borrowed as for Vocab.
+class MergeTable {
+ public:
+  MergeTable();
+  // The first merge of each pair is kept.
+  explicit MergeTable(const std::vector<MergeEntry> &merges);
+  MergeTable(const char *data, size_t size, std::shared_ptr<const void> owner);
+  int size() const;
+  const MergeEntry *find(int left, int right) const;
+  std::string_view blob() const;
+
+ private:
+  std::shared_ptr<const void> owner;
+  const char *data;
+  size_t data_size;
+  uint32_t count;
+  uint32_t slot_mask;
+  const MergeEntry *slots;
+  void view(const char *data, size_t size);
+};
+
 class Model {
  public:
-  std::unordered_map<std::string, int> vocab;
-  std::unordered_map<int, std::string> vocab_r;
+  Vocab vocab;
   virtual ~Model() = default;
   virtual PreTokenizedString tokenize(
       PreTokenizedString pre_tokenized) const = 0;
   explicit Model(const std::unordered_map<std::string, int> &vocab);
+  explicit Model(Vocab vocab);
   int get_vocab_size() const;
   std::optional<int> token_to_id(std::string token);
   std::optional<std::string> id_to_token(int id);
 };
 
-std::unique_ptr<Model> with_model(simdjson::ondemand::object model_params);
+// Model of model_params, read in one pass, with vocab and merges, when given,
+// in place of those in model_params. Large merge lists are resolved on up to
+// num_threads threads, or all hardware threads when num_threads is not
+// positive.
+std::unique_ptr<Model> with_model(simdjson::ondemand::object model_params,
+                                  const Vocab *vocab = nullptr,
+                                  const MergeTable *merges = nullptr,
+                                  int num_threads = 1);
 
 class WordPiece : public Model {
  public:
@@ -45,10 +126,15 @@ class WordPiece : public Model {
   int max_input_chars_per_word;
   std::string continuing_subword_prefix;
   PreTokenizedString tokenize(PreTokenizedString pre_tokenized) const override;
+  // Tokens of a single pre-tokenized word, offsets relative to the word.
+  std::vector<Token> tokenize_word(const std::string &sequence) const;
   explicit WordPiece(const std::unordered_map<std::string, int> &vocab,
                      const std::string &unk_token = "[UNK]",
                      int max_input_chars_per_word = 100,
                      const std::string &continuing_subword_prefix = "##");
+  explicit WordPiece(Vocab vocab, const std::string &unk_token,
+                     int max_input_chars_per_word,
+                     const std::string &continuing_subword_prefix);
 };
 
 class Symbol {
@@ -70,30 +156,30 @@ class Merge {
   bool operator<(const Merge &other) const { return rank < other.rank; }
 };
 
-struct PairHash {
-  template <class T1, class T2>
-  std::size_t operator()(const std::pair<T1, T2> &p) const {
-    auto h1 = std::hash<T1>{}(p.first);
-    auto h2 = std::hash<T2>{}(p.second);
-    return h1 ^ (h2 << 1);
-  }
-};
-
+// Symbols allocated from resource, which may be a per-call arena. Copies
+// allocate from the default resource and so outlive the arena.
 class Word {
  public:
-  std::vector<Symbol> symbols;
-  Word() = default;
+  std::pmr::vector<Symbol> symbols;
+  explicit Word(std::pmr::memory_resource *resource =
+                    std::pmr::get_default_resource());
   explicit Word(const std::vector<Symbol> &symbols);
   void add(int c, int len);
-  void merge_all(
-      std::unordered_map<std::pair<int, int>, std::pair<int, int>, PairHash>
-          merges,
-      float dropout);
+  void merge_all(const MergeTable &merges, float dropout);
 };
 
+// Stack bytes backing the scratch arena of each BPE tokenize call.
+const int WORD_ARENA_SIZE = 8192;
+
+// Words of at least BPE_CACHE_WORD_SIZE bytes, such as whole normalized
+// sequences without a pre-tokenizer, are not cached, and the cache stops
+// growing at BPE_CACHE_CAPACITY words.
+const int BPE_CACHE_WORD_SIZE = 256;
+const int BPE_CACHE_CAPACITY = 10000;
+
 class BPE : public Model {
  public:
-  std::unordered_map<std::pair<int, int>, std::pair<int, int>, PairHash> merges;
+  MergeTable merges;
   float dropout;
   std::string unk_token;
   std::string continuing_subword_prefix;
@@ -102,16 +188,33 @@ class BPE : public Model {
   bool byte_fallback;
   bool ignore_merges;
   PreTokenizedString tokenize(PreTokenizedString pre_tokenized) const override;
+  // Tokens of a single pre-tokenized word, offsets relative to the word.
+  // Scratch symbols are allocated from resource.
+  std::vector<Token> tokenize_word(const std::string &sequence,
+                                   std::pmr::memory_resource *resource) const;
   explicit BPE(const std::unordered_map<std::string, int> &vocab,
                const std::vector<std::string> &merges_list, float dropout,
                const std::string &unk_token,
                const std::string &continuing_subword_prefix,
                const std::string &end_of_word_suffix, bool fuse_unk,
                bool byte_fallback, bool ignore_merges);
+  explicit BPE(Vocab vocab, MergeTable merges, float dropout,
+               const std::string &unk_token,
+               const std::string &continuing_subword_prefix,
+               const std::string &end_of_word_suffix, bool fuse_unk,
+               bool byte_fallback, bool ignore_merges);
 
  private:
   mutable std::unordered_map<std::string, Word> cache;
-  Word merge_word(std::string sequence) const;
-  std::vector<Token> word_to_tokens(const Word &word) const;
-  std::vector<Token> tokenize_with_cache(const std::string &sequence) const;
+  std::shared_ptr<std::shared_mutex> cache_mutex;
+  // Symbols of sequence, their lengths in bytes so each byte fallback token
+  // has one.
+  Word merge_word(const std::string &sequence,
+                  std::pmr::memory_resource *resource) const;
+  // Tokens of the symbols of sequence, each offset by the UTF-16 units of
+  // the characters it overlaps.
+  std::vector<Token> word_to_tokens(const Word &word,
+                                    const std::string &sequence) const;
+  std::vector<Token> tokenize_with_cache(
+      const std::string &sequence, std::pmr::memory_resource *resource) const;
 };
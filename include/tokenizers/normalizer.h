@@ -14,6 +14,7 @@
 
 #include "simdjson.h"
 #include "tokenizers/common.h"
+#include "tokenizers/regex.h"
 
 enum NORMALIZER {
   SEQUENCE_NORMALIZER,
@@ -39,7 +40,10 @@ class NormalizedString {
   std::wstring normalized;
   std::vector<std::pair<int, int>> offsets;
   std::vector<std::pair<int, int>> offset_ranges;
-  explicit NormalizedString(std::wstring normalized);
+  // Whether offsets and offset_ranges are kept to map back to the original.
+  bool track_offsets;
+  explicit NormalizedString(std::wstring normalized,
+                            bool track_offsets = true);
   NormalizedString(std::wstring normalized,
                    const std::vector<std::pair<int, int>> &offsets);
   void transform(int i, std::string op, int n);
@@ -47,6 +51,11 @@ class NormalizedString {
                        NormalizedString sub_normalized);
 };
 
+// Range of the original sequence the normalized range [start, end) came
+// from, or the range itself when offsets are not tracked.
+std::pair<int, int> original_offsets(const NormalizedString &normalized,
+                                     int start, int end);
+
 class Normalizer {
  public:
   virtual ~Normalizer() = default;
@@ -72,8 +81,13 @@ class BertNormalizer : public Normalizer {
   static NormalizedString do_handle_chinese_chars(NormalizedString normalized);
   static NormalizedString do_strip_accents(NormalizedString normalized);
   static NormalizedString do_lowercase(NormalizedString normalized);
+  friend class FusedBertPipeline;
 };
 
+bool is_whitespace(wchar_t c);
+bool is_control(wchar_t c);
+bool is_chinese_char(wchar_t c);
+
 class Prepend : public Normalizer {
  public:
   explicit Prepend(const std::string &prepend);
@@ -81,16 +95,21 @@ class Prepend : public Normalizer {
 
  private:
   std::string prepend;
+  friend class FusedSentencePiecePipeline;
 };
 
 class Replace : public Normalizer {
  public:
-  explicit Replace(const std::string &pattern, const std::string &content);
+  explicit Replace(const std::string &pattern, const std::string &content,
+                   PATTERN_TYPE pattern_type = STRING_PATTERN_TYPE);
   NormalizedString normalize(NormalizedString normalized) const override;
 
  private:
-  std::string pattern;
-  std::string content;
+  std::wstring pattern;
+  std::wstring content;
+  PATTERN_TYPE pattern_type;
+  Regex regex;
+  friend class FusedSentencePiecePipeline;
 };
 
 class NFC : public Normalizer {
@@ -125,6 +144,7 @@ class SequenceNormalizer : public Normalizer {
 
  private:
   std::vector<std::unique_ptr<Normalizer>> normalizers;
+  friend class FusedSentencePiecePipeline;
 };
 
 class Strip : public Normalizer {
@@ -0,0 +1,193 @@
+// Copyright 2024 Omkar Prabhu
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tokenizers/added_vocabulary.h"
+#include "tokenizers/common.h"
+#include "tokenizers/model.h"
+#include "tokenizers/normalizer.h"
+#include "tokenizers/post_processor.h"
+#include "tokenizers/pre_tokenizer.h"
+
+enum PIPELINE {
+  DYNAMIC_PIPELINE,
+  BERT_PIPELINE,
+  BERT_PROCESSING_PIPELINE,
+  BYTE_LEVEL_PIPELINE,
+  ROBERTA_PIPELINE,
+  FUSED_BERT_PIPELINE,
+  FUSED_BYTE_LEVEL_PIPELINE,
+  FUSED_SENTENCE_PIECE_PIPELINE
+};
+
+// Normalizer, pre-tokenizer, model and post-processor run as one unit.
+class Pipeline {
+ public:
+  virtual ~Pipeline() = default;
+  virtual PIPELINE type() const = 0;
+  // Normalizes sequence around the added tokens, then pre-tokenizes and
+  // tokenizes it.
+  virtual PreTokenizedString tokenize(const std::wstring &sequence,
+                                      const AddedVocabulary *added_vocabulary,
+                                      bool track_offsets) const = 0;
+  virtual void process(Encoding *encoding, bool add_special_tokens) const = 0;
+};
+
+// Pipeline over any components, dispatching each stage virtually and
+// skipping missing ones.
+class DynamicPipeline : public Pipeline {
+ public:
+  DynamicPipeline(const Normalizer *normalizer,
+                  const PreTokenizer *pre_tokenizer, const Model *model,
+                  const PostProcessor *post_processor);
+  PIPELINE type() const override;
+  PreTokenizedString tokenize(const std::wstring &sequence,
+                              const AddedVocabulary *added_vocabulary,
+                              bool track_offsets) const override;
+  void process(Encoding *encoding, bool add_special_tokens) const override;
+
+ private:
+  const Normalizer *normalizer;
+  const PreTokenizer *pre_tokenizer;
+  const Model *model;
+  const PostProcessor *post_processor;
+};
+
+// Pipeline over components of known types, calling each stage directly so
+// the stages can be inlined into one another. A void Norm stands for no
+// normalizer.
+template <typename Norm, typename PreTok, typename Mod, typename Post>
+class StaticPipeline : public Pipeline {
+ public:
+  StaticPipeline(PIPELINE pipeline_type, const Norm *normalizer,
+                 const PreTok *pre_tokenizer, const Mod *model,
+                 const Post *post_processor)
+      : pipeline_type(pipeline_type),
+        normalizer(normalizer),
+        pre_tokenizer(pre_tokenizer),
+        model(model),
+        post_processor(post_processor) {}
+
+  PIPELINE type() const override { return pipeline_type; }
+
+  PreTokenizedString tokenize(const std::wstring &sequence,
+                              const AddedVocabulary *added_vocabulary,
+                              bool track_offsets) const override {
+    PreTokenizedString pre_tokenized =
+        added_vocabulary == nullptr
+            ? PreTokenizedString(NormalizedString(sequence, track_offsets))
+            : added_vocabulary->extract_and_normalize(
+                  static_cast<const Normalizer *>(normalizer), sequence,
+                  track_offsets);
+    pre_tokenized =
+        pre_tokenizer->PreTok::pre_tokenize(std::move(pre_tokenized));
+    return model->Mod::tokenize(std::move(pre_tokenized));
+  }
+
+  void process(Encoding *encoding, bool add_special_tokens) const override {
+    post_processor->Post::process(encoding, add_special_tokens);
+  }
+
+ private:
+  PIPELINE pipeline_type;
+  const Norm *normalizer;
+  const PreTok *pre_tokenizer;
+  const Mod *model;
+  const Post *post_processor;
+};
+
+// Pipeline running a recognized family of components as one fused kernel,
+// building the splits straight from the sequence. Post-processing, and
+// sequences the kernel does not cover, go to the pipeline it was fused over.
+class FusedPipeline : public Pipeline {
+ public:
+  explicit FusedPipeline(std::unique_ptr<Pipeline> fallback);
+  void process(Encoding *encoding, bool add_special_tokens) const override;
+
+ protected:
+  std::unique_ptr<Pipeline> fallback;
+};
+
+// BertNormalizer, BertPreTokenizer and WordPiece (bert-base-uncased and
+// alike). Each character is cleaned, decomposed and lowercased, then ends or
+// extends the current word, which is tokenized as soon as it ends.
+class FusedBertPipeline : public FusedPipeline {
+ public:
+  FusedBertPipeline(const BertNormalizer *normalizer, const WordPiece *model,
+                    std::unique_ptr<Pipeline> fallback);
+  PIPELINE type() const override;
+  PreTokenizedString tokenize(const std::wstring &sequence,
+                              const AddedVocabulary *added_vocabulary,
+                              bool track_offsets) const override;
+  // Kernel over fallback for components of this family, taking ownership of
+  // fallback, or nullptr.
+  static std::unique_ptr<Pipeline> fuse(const Normalizer *normalizer,
+                                        const PreTokenizer *pre_tokenizer,
+                                        const Model *model,
+                                        std::unique_ptr<Pipeline> *fallback);
+
+ private:
+  const BertNormalizer *normalizer;
+  const WordPiece *model;
+  void tokenize_range(const std::wstring &sequence, int start, int end,
+                      int unit, std::vector<Split> *splits) const;
+};
+
+// ByteLevel pre-tokenizer, alone or after a regex Split, and BPE without a
+// normalizer (GPT-2, RoBERTa and Llama-3). Each regex match is byte-mapped
+// and merged as soon as it is found.
+class FusedByteLevelPipeline : public FusedPipeline {
+ public:
+  FusedByteLevelPipeline(const Regex *regex, const BPE *model,
+                         std::unique_ptr<Pipeline> fallback);
+  PIPELINE type() const override;
+  PreTokenizedString tokenize(const std::wstring &sequence,
+                              const AddedVocabulary *added_vocabulary,
+                              bool track_offsets) const override;
+  static std::unique_ptr<Pipeline> fuse(const Normalizer *normalizer,
+                                        const PreTokenizer *pre_tokenizer,
+                                        const Model *model,
+                                        std::unique_ptr<Pipeline> *fallback);
+
+ private:
+  const Regex *regex;
+  const BPE *model;
+  std::array<std::string, 256> byte_chars;
+};
+
+// Prepend and space Replace normalizers with BPE and no pre-tokenizer
+// (Llama-2). The normalized sequence is built in one pass and merged whole.
+class FusedSentencePiecePipeline : public FusedPipeline {
+ public:
+  FusedSentencePiecePipeline(const std::string &prepend,
+                             const std::string &replacement, const BPE *model,
+                             std::unique_ptr<Pipeline> fallback);
+  PIPELINE type() const override;
+  PreTokenizedString tokenize(const std::wstring &sequence,
+                              const AddedVocabulary *added_vocabulary,
+                              bool track_offsets) const override;
+  static std::unique_ptr<Pipeline> fuse(const Normalizer *normalizer,
+                                        const PreTokenizer *pre_tokenizer,
+                                        const Model *model,
+                                        std::unique_ptr<Pipeline> *fallback);
+
+ private:
+  std::string prepend;
+  std::string replacement;
+  const BPE *model;
+  void tokenize_range(const std::wstring &sequence, int start, int end,
+                      int unit, std::vector<Split> *splits) const;
+};
+
+// Picks the fused kernel for the family the components belong to, over the
+// StaticPipeline matching their exact types, falling back to a
+// DynamicPipeline.
+std::unique_ptr<Pipeline> make_pipeline(const Normalizer *normalizer,
+                                        const PreTokenizer *pre_tokenizer,
+                                        const Model *model,
+                                        const PostProcessor *post_processor);
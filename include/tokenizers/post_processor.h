@@ -1,8 +1,11 @@
 // Copyright 2024 Omkar Prabhu
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -38,47 +41,128 @@ class Piece {
   Piece(std::string id, int type_id);
 };
 
+enum TEMPLATE_INSTRUCTION {
+  SEQUENCE_TEMPLATE_INSTRUCTION,
+  SPECIAL_TOKEN_TEMPLATE_INSTRUCTION
+};
+
+// Template piece with its special token resolved to a span of the flattened
+// special token ids and tokens.
+class TemplateInstruction {
+ public:
+  TEMPLATE_INSTRUCTION type;
+  int sequence;
+  int type_id;
+  int begin;
+  int end;
+  TemplateInstruction(TEMPLATE_INSTRUCTION type, int sequence, int type_id,
+                      int begin, int end);
+};
+
 class PostProcessor {
  public:
   virtual ~PostProcessor() = default;
-  virtual Encoding process(Encoding encoding,
-                           bool add_special_tokens) const = 0;
+  virtual void process(Encoding *encoding,
+                       bool add_special_tokens) const = 0;
+  // Processes the encodings of a sequence pair, which stay separate until a
+  // processor merges them.
+  virtual std::vector<Encoding> process_encodings(
+      std::vector<Encoding> encodings, bool add_special_tokens) const;
+  virtual int added_tokens(bool is_pair) const;
+  // Gives the processor the token of every id once the vocabulary is loaded.
+  virtual void set_vocabulary(
+      const std::vector<std::optional<std::string>> &tokens);
 };
 
+// Concatenates encodings, pairing up their overflowing parts.
+Encoding merge_encodings(std::vector<Encoding> encodings);
+
 std::unique_ptr<PostProcessor> with_post_processor(
     simdjson::ondemand::object post_processor_params);
 
 class TemplateProcessing : public PostProcessor {
  public:
+  // Throws when a template refers to a token missing from special_tokens.
   TemplateProcessing(const std::vector<std::pair<std::string, Piece>> &single,
                      const std::vector<std::pair<std::string, Piece>> &pair,
                      const std::vector<SpecialToken> &special_tokens);
-  Encoding process(Encoding encoding, bool add_special_tokens) const override;
+  void process(Encoding *encoding, bool add_special_tokens) const override;
+  std::vector<Encoding> process_encodings(
+      std::vector<Encoding> encodings, bool add_special_tokens) const override;
+  int added_tokens(bool is_pair) const override;
 
  private:
-  std::vector<std::pair<std::string, Piece>> single;
-  std::vector<std::pair<std::string, Piece>> pair;
-  std::vector<SpecialToken> special_tokens;
+  std::vector<TemplateInstruction> single;
+  std::vector<TemplateInstruction> pair;
+  std::vector<int> special_ids;
+  std::vector<std::string> special_tokens;
+  std::vector<TemplateInstruction> compile(
+      const std::vector<std::pair<std::string, Piece>> &pieces,
+      const std::vector<SpecialToken> &special_tokens);
+  Encoding apply(const std::vector<TemplateInstruction> &program,
+                 Encoding *const *sequences,
+                 bool add_special_tokens) const;
+  void apply_in_place(Encoding *encoding, bool add_special_tokens) const;
+};
+
+class BertProcessing : public PostProcessor {
+ public:
+  BertProcessing(const std::pair<std::string, int> &sep,
+                 const std::pair<std::string, int> &cls);
+  void process(Encoding *encoding, bool add_special_tokens) const override;
+  std::vector<Encoding> process_encodings(
+      std::vector<Encoding> encodings, bool add_special_tokens) const override;
+  int added_tokens(bool is_pair) const override;
+
+ private:
+  std::pair<std::string, int> sep;
+  std::pair<std::string, int> cls;
+};
+
+class RobertaProcessing : public PostProcessor {
+ public:
+  RobertaProcessing(const std::pair<std::string, int> &sep,
+                    const std::pair<std::string, int> &cls, bool trim_offsets,
+                    bool add_prefix_space);
+  void process(Encoding *encoding, bool add_special_tokens) const override;
+  std::vector<Encoding> process_encodings(
+      std::vector<Encoding> encodings, bool add_special_tokens) const override;
+  int added_tokens(bool is_pair) const override;
+  void set_vocabulary(
+      const std::vector<std::optional<std::string>> &tokens) override;
+
+ private:
+  std::pair<std::string, int> sep;
+  std::pair<std::string, int> cls;
+  bool trim_offsets;
+  bool add_prefix_space;
+  std::vector<std::pair<uint16_t, uint16_t>> byte_level_spaces;
 };
 
 class ByteLevelProcessing : public PostProcessor {
  public:
   explicit ByteLevelProcessing(bool add_prefix_space, bool trim_offsets);
-  Encoding process(Encoding encoding, bool add_special_tokens) const override;
+  void process(Encoding *encoding, bool add_special_tokens) const override;
+  void set_vocabulary(
+      const std::vector<std::optional<std::string>> &tokens) override;
 
  private:
   bool add_prefix_space;
   bool trim_offsets;
-  std::unordered_map<uint16_t, std::string> BYTES_CHAR;
-  Encoding process_offsets(const Encoding &encoding,
-                           bool add_prefix_space) const;
+  // Leading and trailing byte-level spaces of every token, by id.
+  std::vector<std::pair<uint16_t, uint16_t>> byte_level_spaces;
 };
 
 class SequenceProcessing : public PostProcessor {
  public:
   explicit SequenceProcessing(
       std::vector<std::unique_ptr<PostProcessor>> processors);
-  Encoding process(Encoding encoding, bool add_special_tokens) const override;
+  void process(Encoding *encoding, bool add_special_tokens) const override;
+  std::vector<Encoding> process_encodings(
+      std::vector<Encoding> encodings, bool add_special_tokens) const override;
+  int added_tokens(bool is_pair) const override;
+  void set_vocabulary(
+      const std::vector<std::optional<std::string>> &tokens) override;
 
  private:
   std::vector<std::unique_ptr<PostProcessor>> processors;
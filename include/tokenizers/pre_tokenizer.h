@@ -14,6 +14,7 @@
 #include "simdjson.h"
 #include "tokenizers/common.h"
 #include "tokenizers/normalizer.h"
+#include "tokenizers/regex.h"
 
 enum PRE_TOKENIZER {
   BERT_PRE_TOKENIZER,
@@ -37,13 +38,22 @@ class PreTokenizedString {
  public:
   NormalizedString normalized;
   std::vector<Split> splits;
-  explicit PreTokenizedString(const NormalizedString &normalized);
+  explicit PreTokenizedString(NormalizedString normalized);
   void split(std::function<std::vector<std::pair<std::pair<int, int>, bool>>(
                  icu::UnicodeString)>
                  split_fn,
              SPLIT_DELIMITER_BEHAVIOR pattern);
+  void split_on_class(uint8_t char_class, SPLIT_DELIMITER_BEHAVIOR behavior);
+  void split_on_char(UChar32 delimiter, SPLIT_DELIMITER_BEHAVIOR behavior);
+  void split_on_string(const std::string &literal,
+                       SPLIT_DELIMITER_BEHAVIOR behavior, bool invert = false);
+  void split_on_regex(const Regex &regex, SPLIT_DELIMITER_BEHAVIOR behavior,
+                      bool invert = false);
 };
 
+// UTF-16 units of the UTF-8 bytes [start, end) of data.
+int utf16_length(const char *data, int start, int end);
+
 class PreTokenizer {
  public:
   virtual ~PreTokenizer() = default;
@@ -70,19 +80,89 @@ class SequencePreTokenizer : public PreTokenizer {
 
  private:
   std::vector<std::unique_ptr<PreTokenizer>> pretokenizers;
+  friend class FusedByteLevelPipeline;
 };
 
 class SplitPreTokenizer : public PreTokenizer {
  public:
   explicit SplitPreTokenizer(const std::string &pattern,
-                             const std::string &behavior, bool invert);
+                             const std::string &behavior, bool invert,
+                             PATTERN_TYPE pattern_type = REGEX_PATTERN_TYPE);
   PreTokenizedString pre_tokenize(
       PreTokenizedString pre_tokenized) const override;
 
  private:
   std::string pattern;
+  PATTERN_TYPE pattern_type;
+  Regex regex;
   SPLIT_DELIMITER_BEHAVIOR behavior;
   bool invert;
+  friend class FusedByteLevelPipeline;
+};
+
+class WhitespacePreTokenizer : public PreTokenizer {
+ public:
+  WhitespacePreTokenizer();
+  PreTokenizedString pre_tokenize(
+      PreTokenizedString pre_tokenized) const override;
+};
+
+class WhitespaceSplitPreTokenizer : public PreTokenizer {
+ public:
+  WhitespaceSplitPreTokenizer();
+  PreTokenizedString pre_tokenize(
+      PreTokenizedString pre_tokenized) const override;
+};
+
+class PunctuationPreTokenizer : public PreTokenizer {
+ public:
+  explicit PunctuationPreTokenizer(const std::string &behavior = "Isolated");
+  PreTokenizedString pre_tokenize(
+      PreTokenizedString pre_tokenized) const override;
+
+ private:
+  SPLIT_DELIMITER_BEHAVIOR behavior;
+};
+
+class DigitsPreTokenizer : public PreTokenizer {
+ public:
+  explicit DigitsPreTokenizer(bool individual_digits = false);
+  PreTokenizedString pre_tokenize(
+      PreTokenizedString pre_tokenized) const override;
+
+ private:
+  bool individual_digits;
+};
+
+class CharDelimiterSplitPreTokenizer : public PreTokenizer {
+ public:
+  explicit CharDelimiterSplitPreTokenizer(const std::string &delimiter);
+  PreTokenizedString pre_tokenize(
+      PreTokenizedString pre_tokenized) const override;
+
+ private:
+  UChar32 delimiter;
+};
+
+class UnicodeScriptsPreTokenizer : public PreTokenizer {
+ public:
+  UnicodeScriptsPreTokenizer();
+  PreTokenizedString pre_tokenize(
+      PreTokenizedString pre_tokenized) const override;
+};
+
+class MetaspacePreTokenizer : public PreTokenizer {
+ public:
+  explicit MetaspacePreTokenizer(const std::string &replacement = "\u2581",
+                                 const std::string &prepend_scheme = "always",
+                                 bool split = true);
+  PreTokenizedString pre_tokenize(
+      PreTokenizedString pre_tokenized) const override;
+
+ private:
+  std::string replacement;
+  PREPEND_SCHEME prepend_scheme;
+  bool split;
 };
 
 class ByteLevelPreTokenizer : public PreTokenizer {
@@ -94,6 +174,7 @@ class ByteLevelPreTokenizer : public PreTokenizer {
  private:
   bool add_prefix_space;
   bool use_regex;
-  std::string regex;
+  Regex regex;
   std::unordered_map<uint16_t, std::string> BYTES_CHAR;
+  friend class FusedByteLevelPipeline;
 };
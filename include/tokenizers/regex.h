@@ -0,0 +1,49 @@
+// Copyright 2024 Omkar Prabhu
+#pragma once
+
+#include <unicode/regex.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+enum REGEX_ACCEPT {
+  NO_REGEX_ACCEPT,
+  CURRENT_REGEX_ACCEPT,
+  PREVIOUS_REGEX_ACCEPT
+};
+
+// Regular expression lowered ahead of time to a DFA over codepoint classes
+// with leftmost-first semantics. Matches are searched in one forward pass
+// finding where each ends, then a backward pass over the match finding where
+// it starts. Patterns using constructs the DFA cannot express are matched by
+// ICU instead.
+class Regex {
+ public:
+  Regex();
+  explicit Regex(const std::string &pattern);
+  bool is_dfa() const;
+  // Byte ranges of the non-empty, non-overlapping matches in UTF-8 input.
+  std::vector<std::pair<int, int>> find_matches(std::string_view input) const;
+
+ private:
+  int num_classes;
+  std::vector<uint16_t> class_index;
+  std::vector<uint16_t> class_blocks;
+  std::vector<int> transitions;
+  std::vector<uint8_t> accepts;
+  std::vector<uint8_t> eof_accepts;
+  std::vector<int> search_transitions;
+  std::vector<uint8_t> search_accepts;
+  std::vector<uint8_t> search_eof_accepts;
+  std::vector<int> reverse_starts;
+  std::vector<int> reverse_transitions;
+  std::vector<uint8_t> reverse_accepts;
+  std::shared_ptr<icu::RegexPattern> fallback;
+  int class_of(UChar32 c) const;
+  std::vector<std::pair<int, int>> search_matches(const uint8_t *data,
+                                                  int length) const;
+};
@@ -2,29 +2,121 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "tokenizers/added_vocabulary.h"
+#include "tokenizers/binary.h"
 #include "tokenizers/common.h"
 #include "tokenizers/decoder.h"
 #include "tokenizers/model.h"
 #include "tokenizers/normalizer.h"
+#include "tokenizers/pipeline.h"
 #include "tokenizers/post_processor.h"
 #include "tokenizers/pre_tokenizer.h"
 #include "tokenizers/utils.h"
 
+class Tokenizer;
+
+// Decoded sequences stored back to back, sequence i spanning
+// [offsets[i], offsets[i + 1]).
+class DecodedBatch {
+ public:
+  std::string buffer;
+  std::vector<size_t> offsets;
+  int size() const;
+  std::string_view sequence(int i) const;
+};
+
+// Incremental detokenizer for generated ids. Each step decodes only a short
+// window of recent ids, returning the newly finalized text, and holds back
+// output while it ends in an incomplete UTF-8 sequence.
+class DecodeStream {
+ public:
+  explicit DecodeStream(const Tokenizer *tokenizer,
+                        bool skip_special_tokens = true);
+  std::optional<std::string> step(int id);
+
+ private:
+  const Tokenizer *tokenizer;
+  bool skip_special_tokens;
+  std::vector<int> ids;
+  std::string prefix;
+  int prefix_index;
+};
+
+// Detokenizes hypotheses sharing prefixes, as in beam search. Each node
+// extends a parent node (-1 for none) by one id, copying only the parent's
+// short DecodeStream window, so extending costs one stream step.
+class DecodeTree {
+ public:
+  explicit DecodeTree(const Tokenizer *tokenizer,
+                      bool skip_special_tokens = true);
+  int extend(int parent, int id);
+  std::vector<int> extend(const std::vector<std::pair<int, int>> &steps);
+  int size() const;
+  // Text finalized by the id of node.
+  const std::string &new_text(int node) const;
+  std::string text(int node) const;
+
+ private:
+  DecodeStream root;
+  std::vector<int> parents;
+  std::vector<DecodeStream> streams;
+  std::vector<std::string> texts;
+};
+
 class Tokenizer {
  public:
+  // Reads tokenizer.json in one pass, resolving large merge lists on up to
+  // num_threads threads, or all hardware threads when num_threads is not
+  // positive.
   explicit Tokenizer(const std::string &path = "",
-                     const std::string &config = "");
+                     const std::string &config = "", int num_threads = 0);
+  // Tokenizer of a file written by save_binary, mapped read-only. The
+  // vocabulary and merges are used in place, so loading does not depend on
+  // their size and processes loading the same file share their pages.
+  static Tokenizer load_binary(const std::string &path);
+  // Writes the configuration the tokenizer was loaded with, tokens added
+  // since excluded.
+  void save_binary(const std::string &path) const;
 
-  Encoding encode(const std::wstring &sequence, bool add_special_tokens = true);
+  // Fills ids and the Encoding fields requested by options, skipping the
+  // work behind the rest.
+  Encoding encode(const std::wstring &sequence, bool add_special_tokens = true,
+                  EncodeOptions options = ALL_ENCODE_OPTION);
+  Encoding encode_pair(const std::wstring &sequence, const std::wstring &pair,
+                       bool add_special_tokens = true,
+                       EncodeOptions options = ALL_ENCODE_OPTION);
+  // Encodes UTF-8 sequence into encoding, reusing its capacity.
+  void encode_into(std::string_view sequence, Encoding *encoding,
+                   bool add_special_tokens = true,
+                   EncodeOptions options = ALL_ENCODE_OPTION) const;
+  void encode_batch_into(const std::vector<std::string_view> &sequences,
+                         std::vector<Encoding> *encodings,
+                         bool add_special_tokens = true,
+                         EncodeOptions options = ALL_ENCODE_OPTION) const;
+  std::vector<Encoding> encode_pair_batch(
+      const std::vector<std::pair<std::wstring, std::wstring>> &pairs,
+      bool add_special_tokens = true,
+      EncodeOptions options = ALL_ENCODE_OPTION);
   std::string decode(const std::vector<int> &ids,
-                     bool skip_special_tokens = true);
+                     bool skip_special_tokens = true) const;
+  DecodeStream decode_stream(bool skip_special_tokens = true) const;
+  VocabularyIndex get_vocabulary_index() const;
+  PIPELINE get_pipeline() const;
+  // Decodes the sequences ids[offsets[i], offsets[i + 1]) across threads,
+  // using all hardware threads when num_threads is not positive. Offsets
+  // must be non-decreasing and within ids.
+  DecodedBatch decode_batch(const std::vector<int> &ids,
+                            const std::vector<size_t> &offsets,
+                            bool skip_special_tokens = true,
+                            int num_threads = 0) const;
   int add_tokens(const std::vector<AddedToken> &tokens);
   int add_special_tokens(const std::vector<AddedToken> &tokens);
 
@@ -38,8 +130,27 @@ class Tokenizer {
   std::unique_ptr<Model> model;
   std::unique_ptr<PostProcessor> post_processor;
   std::unique_ptr<Decoder> decoder;
+  std::unique_ptr<Pipeline> pipeline;
+  std::unique_ptr<TokenStorage> token_storage;
+  // tokenizer.json without the model vocab and merges
+  std::string config;
+  // Tables over the whole vocabulary, built on first use.
+  mutable DecodeTable decode_table;
+  mutable std::unique_ptr<std::once_flag> decode_table_flag;
+  mutable std::unique_ptr<std::once_flag> post_processor_flag;
 
-  Encoding do_tokenize(PreTokenizedString pre_tokenized,
-                       std::optional<int> word_idx, int type_id) const;
-  Encoding do_post_process(Encoding encoding, bool add_special_tokens) const;
+  explicit Tokenizer(const BinaryReader &reader);
+  void configure(const BinaryReader *reader);
+  void do_post_process(Encoding *encoding, bool add_special_tokens) const;
+  void encode_sequence(const std::wstring &sequence, int type_id,
+                       EncodeOptions options, Encoding *encoding) const;
+  Encoding do_post_process_pair(Encoding encoding, Encoding pair,
+                                bool add_special_tokens) const;
+  void refresh_vocabulary_tables();
+  void prepare_post_processor() const;
+  void prepare_decode_table() const;
+  void collect_tokens(std::vector<std::optional<std::string>> *tokens,
+                      std::vector<bool> *special) const;
+  void decode_into(const int *ids, size_t length, bool skip_special_tokens,
+                   std::string *output) const;
 };
@@ -32,7 +32,10 @@ class Truncation {
  public:
   Truncation(const std::string &direction, const std::string &strategy,
              int max_length, int stride);
-  Encoding truncate_encoding(Encoding encoding) const;
+  // Truncates to max_length less the special tokens added afterwards.
+  void truncate_encoding(Encoding *encoding, int added_tokens = 0) const;
+  void truncate_pair(Encoding *encoding, Encoding *pair,
+                     int added_tokens = 0) const;
 
  private:
   TRUNCATION_DIRECTION direction;
@@ -62,7 +65,8 @@ class Padding {
   Padding(const std::string &direction, const std::string &strategy,
           int fixed_size, int pad_id, int pad_type_id,
           const std::string &pad_token, int pad_to_multiple_of);
-  Encoding pad_encoding(const Encoding &encoding) const;
+  void pad_encoding(Encoding *encoding) const;
+  void pad_encodings(std::vector<Encoding> *encodings) const;
 
  private:
   PADDING_DIRECTION direction;
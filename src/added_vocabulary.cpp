@@ -52,6 +52,11 @@ std::optional<std::string> AddedVocabulary::id_to_token(int id) {
   return std::nullopt;
 }
 
+const std::unordered_map<int, AddedToken>&
+AddedVocabulary::get_added_tokens_decoder() const {
+  return added_tokens_map_r;
+}
+
 int AddedVocabulary::add_tokens(const std::vector<AddedToken>& tokens,
                                 Model* model, Normalizer* normalizer) {
   for (auto token : tokens) {
@@ -173,7 +178,7 @@ size_t space_rightmost_at_start(std::string sentence) {
 std::vector<std::pair<std::optional<int>, std::pair<int, int>>>
 AddedVocabulary::find_matches(
     std::string sentence,
-    std::pair<std::vector<std::string>, std::vector<int>> split_re) {
+    std::pair<std::vector<std::string>, std::vector<int>> split_re) const {
   // TODO(omkar): update to find matches from trie
   std::vector<std::tuple<int, int, int>> matches;
   std::unordered_map<std::string, int> word_ids;
@@ -206,7 +211,9 @@ AddedVocabulary::find_matches(
   for (auto match : matches) {
     int start = std::get<0>(match), stop = std::get<1>(match),
         id = std::get<2>(match);
-    AddedToken added_token = added_tokens_map_r[id];
+    auto it = added_tokens_map_r.find(id);
+    AddedToken added_token =
+        it != added_tokens_map_r.end() ? it->second : AddedToken();
     if (encode_special_tokens &&
         special_tokens_set.count(added_token.content) > 0) {
       continue;
@@ -246,9 +253,10 @@ int AddedVocabulary::add_special_tokens(const std::vector<AddedToken>& tokens,
 }
 
 PreTokenizedString AddedVocabulary::extract_and_normalize(
-    const Normalizer* normalizer, const std::wstring& sequence) {
+    const Normalizer* normalizer, const std::wstring& sequence,
+    bool track_offsets) const {
   PreTokenizedString pre_tokenized =
-      PreTokenizedString(NormalizedString(sequence));
+      PreTokenizedString(NormalizedString(sequence, track_offsets));
   auto matches =
       find_matches(convert_to_string(pre_tokenized.normalized.normalized),
                    split_non_normalized_trie);
@@ -267,7 +275,7 @@ PreTokenizedString AddedVocabulary::extract_and_normalize(
     }
   }
   if (non_normalized_splits.size() > 0) {
-    pre_tokenized.splits = non_normalized_splits;
+    pre_tokenized.splits = std::move(non_normalized_splits);
   }
 
   std::vector<Split> normalized_splits;
@@ -277,13 +285,14 @@ PreTokenizedString AddedVocabulary::extract_and_normalize(
       Split new_split = original_split;
       new_split.offsets = {ending_idx,
                            ending_idx + new_split.normalized.length()};
-      normalized_splits.push_back(new_split);
       ending_idx += new_split.normalized.length();
+      normalized_splits.push_back(std::move(new_split));
     } else {
       NormalizedString split_normalized =
-          NormalizedString(convert_from_string(original_split.normalized));
+          NormalizedString(convert_from_string(original_split.normalized),
+                           track_offsets);
       if (normalizer != nullptr) {
-        split_normalized = normalizer->normalize(split_normalized);
+        split_normalized = normalizer->normalize(std::move(split_normalized));
       }
       std::pair<int, int> new_split_offset = {
           ending_idx, ending_idx + original_split.offsets.second -
@@ -314,12 +323,22 @@ PreTokenizedString AddedVocabulary::extract_and_normalize(
     }
   }
   if (normalized_splits.size() > 0) {
-    pre_tokenized.splits = normalized_splits;
+    pre_tokenized.splits = std::move(normalized_splits);
   }
 
   return pre_tokenized;
 }
 
+bool AddedVocabulary::has_normalized_tokens() const {
+  return !split_normalized_trie.first.empty();
+}
+
+std::vector<std::pair<std::optional<int>, std::pair<int, int>>>
+AddedVocabulary::find_non_normalized_matches(
+    const std::wstring& sequence) const {
+  return find_matches(convert_to_string(sequence), split_non_normalized_trie);
+}
+
 std::unique_ptr<AddedVocabulary> with_added_vocabulary(
     simdjson::ondemand::array added_tokens_params) {
   std::vector<AddedToken> added_tokens;
@@ -0,0 +1,144 @@
+// Copyright 2024 Omkar Prabhu
+#include "tokenizers/binary.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct BinaryHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t section_count;
+  uint32_t reserved;
+};
+
+struct BinarySectionEntry {
+  uint32_t kind;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+};
+
+size_t align_binary(size_t offset) {
+  return (offset + BINARY_ALIGNMENT - 1) / BINARY_ALIGNMENT * BINARY_ALIGNMENT;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Unable to open " + path);
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    throw std::runtime_error("Unable to map " + path);
+  }
+  length = file_stat.st_size;
+  address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) {
+    throw std::runtime_error("Unable to map " + path);
+  }
+}
+
+MappedFile::~MappedFile() { munmap(address, length); }
+
+const char* MappedFile::data() const {
+  return static_cast<const char*>(address);
+}
+
+size_t MappedFile::size() const { return length; }
+
+void BinaryWriter::add_section(BINARY_SECTION kind, std::string_view data) {
+  sections.push_back({kind, data});
+}
+
+void BinaryWriter::write(const std::string& path) const {
+  BinaryHeader header = {BINARY_MAGIC, BINARY_VERSION,
+                         static_cast<uint32_t>(sections.size()), 0};
+  std::vector<BinarySectionEntry> entries;
+  size_t offset = align_binary(sizeof(BinaryHeader) +
+                               sections.size() * sizeof(BinarySectionEntry));
+  for (const auto& section : sections) {
+    entries.push_back({static_cast<uint32_t>(section.first), 0, offset,
+                       section.second.size()});
+    offset = align_binary(offset + section.second.size());
+  }
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Unable to write " + path);
+  }
+  std::string padding(BINARY_ALIGNMENT, '\0');
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(entries.data()),
+             entries.size() * sizeof(BinarySectionEntry));
+  size_t written =
+      sizeof(BinaryHeader) + entries.size() * sizeof(BinarySectionEntry);
+  for (int i = 0; i < sections.size(); i++) {
+    file.write(padding.data(), entries[i].offset - written);
+    file.write(sections[i].second.data(), sections[i].second.size());
+    written = entries[i].offset + sections[i].second.size();
+  }
+  if (!file) {
+    throw std::runtime_error("Unable to write " + path);
+  }
+}
+
+BinaryReader::BinaryReader(const std::string& path)
+    : mapped(std::make_shared<MappedFile>(path)) {
+  BinaryHeader header;
+  if (mapped->size() < sizeof(header)) {
+    throw std::runtime_error("Invalid tokenizer binary");
+  }
+  std::memcpy(&header, mapped->data(), sizeof(header));
+  if (header.magic != BINARY_MAGIC) {
+    throw std::runtime_error("Invalid tokenizer binary");
+  }
+  if (header.version != BINARY_VERSION) {
+    throw std::runtime_error("Unsupported tokenizer binary version " +
+                             std::to_string(header.version));
+  }
+  if (header.section_count >
+      (mapped->size() - sizeof(header)) / sizeof(BinarySectionEntry)) {
+    throw std::runtime_error("Invalid tokenizer binary");
+  }
+  for (int i = 0; i < header.section_count; i++) {
+    BinarySectionEntry entry;
+    std::memcpy(&entry,
+                mapped->data() + sizeof(header) + i * sizeof(entry),
+                sizeof(entry));
+    if (entry.offset % BINARY_ALIGNMENT != 0 ||
+        entry.offset > mapped->size() ||
+        entry.size > mapped->size() - entry.offset) {
+      throw std::runtime_error("Invalid tokenizer binary");
+    }
+    BINARY_SECTION kind = entry.kind < UNKNOWN_BINARY_SECTION
+                              ? static_cast<BINARY_SECTION>(entry.kind)
+                              : UNKNOWN_BINARY_SECTION;
+    sections.push_back(
+        {kind, std::string_view(mapped->data() + entry.offset, entry.size)});
+  }
+}
+
+std::optional<std::string_view> BinaryReader::section(
+    BINARY_SECTION kind) const {
+  for (const auto& section : sections) {
+    if (section.first == kind) {
+      return section.second;
+    }
+  }
+  return std::nullopt;
+}
+
+std::shared_ptr<const MappedFile> BinaryReader::file() const { return mapped; }
@@ -2,13 +2,18 @@
 #include "tokenizers/common.h"
 
 #include <unicode/uchar.h>
+#include <unicode/uscript.h>
 #include <unicode/unistr.h>
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -21,33 +26,52 @@ Token::Token(int id, std::string value, std::pair<int, int> offsets)
 
 SPLIT_DELIMITER_BEHAVIOR get_split_delimiter_behavior(
     const std::string& behavior) {
-  if (behavior == "Isolated") {
-    return ISOLATED;
+  static const std::unordered_map<std::string, SPLIT_DELIMITER_BEHAVIOR>
+      behaviors = {{"Removed", REMOVED},
+                   {"Isolated", ISOLATED},
+                   {"MergedWithPrevious", MERGED_WITH_PREVIOUS},
+                   {"MergedWithNext", MERGED_WITH_NEXT},
+                   {"Contiguous", CONTIGUOUS}};
+
+  auto it = behaviors.find(behavior);
+  if (it != behaviors.end()) {
+    return it->second;
   }
   return REMOVED;
 }
 
+PREPEND_SCHEME get_prepend_scheme(const std::string& scheme) {
+  static const std::unordered_map<std::string, PREPEND_SCHEME> schemes = {
+      {"always", ALWAYS_PREPEND_SCHEME},
+      {"first", FIRST_PREPEND_SCHEME},
+      {"never", NEVER_PREPEND_SCHEME}};
+
+  auto it = schemes.find(scheme);
+  if (it != schemes.end()) {
+    return it->second;
+  }
+  return ALWAYS_PREPEND_SCHEME;
+}
+
 Split::Split() {}
 
 Split::Split(std::string normalized, std::pair<int, int> offsets)
     : normalized(normalized), offsets(offsets) {}
 
-Encoding::Encoding()
-    : ids({}),
-      type_ids({}),
-      tokens({}),
-      words({}),
-      offsets({}),
-      special_tokens_mask({}),
-      attention_mask({}) {}
-
-Encoding::Encoding(const std::vector<int>& ids,
-                   const std::vector<int>& type_ids,
-                   const std::vector<std::string>& tokens,
-                   const std::vector<std::optional<int>>& words,
-                   const std::vector<std::pair<int, int>>& offsets,
-                   const std::vector<int>& special_tokens_mask,
-                   const std::vector<int>& attention_mask)
+std::string_view TokenStorage::intern(std::string_view token) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return *tokens.insert(std::string(token)).first;
+}
+
+Encoding::Encoding() {}
+
+Encoding::Encoding(const std::vector<int32_t>& ids,
+                   const std::vector<uint32_t>& type_ids,
+                   const std::vector<std::string_view>& tokens,
+                   const std::vector<int32_t>& words,
+                   const std::vector<std::pair<uint32_t, uint32_t>>& offsets,
+                   const std::vector<uint8_t>& special_tokens_mask,
+                   const std::vector<uint8_t>& attention_mask)
     : ids(ids),
       type_ids(type_ids),
       tokens(tokens),
@@ -56,6 +80,39 @@ Encoding::Encoding(const std::vector<int>& ids,
       special_tokens_mask(special_tokens_mask),
       attention_mask(attention_mask) {}
 
+void Encoding::reserve(size_t length) {
+  ids.reserve(length);
+  if (fields & TYPE_IDS_ENCODE_OPTION) {
+    type_ids.reserve(length);
+  }
+  if (fields & TOKENS_ENCODE_OPTION) {
+    tokens.reserve(length);
+  }
+  if (fields & WORDS_ENCODE_OPTION) {
+    words.reserve(length);
+  }
+  if (fields & OFFSETS_ENCODE_OPTION) {
+    offsets.reserve(length);
+  }
+  if (fields & SPECIAL_TOKENS_MASK_ENCODE_OPTION) {
+    special_tokens_mask.reserve(length);
+  }
+  if (fields & ATTENTION_MASK_ENCODE_OPTION) {
+    attention_mask.reserve(length);
+  }
+}
+
+void Encoding::clear() {
+  ids.clear();
+  type_ids.clear();
+  tokens.clear();
+  words.clear();
+  offsets.clear();
+  special_tokens_mask.clear();
+  attention_mask.clear();
+  overflowing.clear();
+}
+
 std::string convert_to_string(std::wstring sequence) {
   std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
   return converter.to_bytes(sequence);
@@ -108,3 +165,87 @@ std::unordered_map<uint16_t, std::string> bytes_char() {
   }
   return result;
 }
+
+uint8_t compute_char_class(UChar32 c) {
+  uint8_t result = 0;
+  if (u_isUWhiteSpace(c)) {
+    result |= WHITESPACE_CHAR_CLASS;
+  }
+  int32_t mask = U_GET_GC_MASK(c);
+  if ((mask & U_GC_P_MASK) != 0 || (c >= '!' && c <= '/') ||
+      (c >= ':' && c <= '@') || (c >= '[' && c <= '`') ||
+      (c >= '{' && c <= '~')) {
+    result |= PUNCTUATION_CHAR_CLASS;
+  }
+  if ((mask & U_GC_N_MASK) != 0) {
+    result |= NUMERIC_CHAR_CLASS;
+  }
+  if (u_hasBinaryProperty(c, UCHAR_ALPHABETIC) ||
+      (mask & (U_GC_M_MASK | U_GC_ND_MASK | U_GC_PC_MASK)) != 0 ||
+      u_hasBinaryProperty(c, UCHAR_JOIN_CONTROL)) {
+    result |= WORD_CHAR_CLASS;
+  }
+  return result;
+}
+
+uint8_t get_char_class(UChar32 c) {
+  static const std::array<uint8_t, 0x10000> table = []() {
+    std::array<uint8_t, 0x10000> result;
+    for (UChar32 i = 0; i < 0x10000; i++) {
+      result[i] = compute_char_class(i);
+    }
+    return result;
+  }();
+  if (c >= 0 && c < 0x10000) {
+    return table[c];
+  }
+  return compute_char_class(c);
+}
+
+uint8_t compute_char_script(UChar32 c) {
+  if (c == ' ') {
+    return ANY_SCRIPT;
+  }
+  if (c == 0x30FC) {
+    return USCRIPT_HAN;
+  }
+  UErrorCode status = U_ZERO_ERROR;
+  UScriptCode script = uscript_getScript(c, &status);
+  if (U_FAILURE(status)) {
+    return USCRIPT_UNKNOWN;
+  }
+  if (script == USCRIPT_HIRAGANA || script == USCRIPT_KATAKANA) {
+    return USCRIPT_HAN;
+  }
+  return static_cast<uint8_t>(script);
+}
+
+class ScriptTable {
+ public:
+  std::vector<uint16_t> index;
+  std::vector<uint8_t> blocks;
+  ScriptTable() : index(0x110000 >> 8) {
+    std::unordered_map<std::string, uint16_t> seen;
+    std::string block(256, '\0');
+    for (UChar32 start = 0; start < 0x110000; start += 256) {
+      for (int i = 0; i < 256; i++) {
+        block[i] = static_cast<char>(compute_char_script(start + i));
+      }
+      auto it = seen.find(block);
+      if (it == seen.end()) {
+        uint16_t id = seen.size();
+        it = seen.insert({block, id}).first;
+        blocks.insert(blocks.end(), block.begin(), block.end());
+      }
+      index[start >> 8] = it->second;
+    }
+  }
+};
+
+uint8_t get_char_script(UChar32 c) {
+  static const ScriptTable table;
+  if (c < 0 || c >= 0x110000) {
+    return USCRIPT_UNKNOWN;
+  }
+  return table.blocks[(table.index[c >> 8] << 8) | (c & 0xFF)];
+}
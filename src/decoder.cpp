@@ -3,10 +3,14 @@
 
 #include <unicode/uchar.h>
 #include <unicode/unistr.h>
+#include <unicode/utf8.h>
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -81,17 +85,47 @@ std::unique_ptr<Decoder> with_decoder(
     return std::make_unique<StripDecoder>(StripDecoder(content, start, stop));
   } else if (get_decoder(type) == REPLACE_DECODER) {
     val = decoder_params["pattern"].value();
-    std::string pattern =
-        std::string(val.type() == simdjson::ondemand::json_type::null
-                        ? ""
-                        : static_cast<std::string_view>(
-                              val["String"].value().get_string()));
+    std::string pattern;
+    PATTERN_TYPE pattern_type = STRING_PATTERN_TYPE;
+    if (val.type() != simdjson::ondemand::json_type::null) {
+      simdjson::ondemand::object pattern_params = val.get_object();
+      auto regex_val = pattern_params["Regex"];
+      if (regex_val.error() == simdjson::SUCCESS) {
+        pattern = std::string(
+            static_cast<std::string_view>(regex_val.get_string()));
+        pattern_type = REGEX_PATTERN_TYPE;
+      } else {
+        pattern = std::string(static_cast<std::string_view>(
+            pattern_params["String"].get_string()));
+      }
+    }
     val = decoder_params["content"].value();
     std::string content =
         std::string(val.type() == simdjson::ondemand::json_type::null
                         ? ""
                         : static_cast<std::string_view>(val.get_string()));
-    return std::make_unique<ReplaceDecoder>(ReplaceDecoder(pattern, content));
+    return std::make_unique<ReplaceDecoder>(
+        ReplaceDecoder(pattern, content, pattern_type));
+  } else if (get_decoder(type) == METASPACE_DECODER) {
+    val = decoder_params["replacement"].value();
+    std::string replacement =
+        val.type() == simdjson::ondemand::json_type::null
+            ? "\u2581"
+            : std::string(static_cast<std::string_view>(val.get_string()));
+    std::string prepend_scheme = "always";
+    auto prepend_scheme_val = decoder_params["prepend_scheme"];
+    if (prepend_scheme_val.error() == simdjson::SUCCESS) {
+      prepend_scheme = std::string(
+          static_cast<std::string_view>(prepend_scheme_val.get_string()));
+    } else {
+      auto add_prefix_space_val = decoder_params["add_prefix_space"];
+      if (add_prefix_space_val.error() == simdjson::SUCCESS &&
+          !static_cast<bool>(add_prefix_space_val.get_bool())) {
+        prepend_scheme = "never";
+      }
+    }
+    return std::make_unique<MetaspaceDecoder>(
+        MetaspaceDecoder(replacement, prepend_scheme));
   } else if (get_decoder(type) == BYTE_FALLBACK_DECODER) {
     return std::make_unique<ByteFallbackDecoder>(ByteFallbackDecoder());
   } else if (get_decoder(type) == FUSE_DECODER) {
@@ -102,6 +136,67 @@ std::unique_ptr<Decoder> with_decoder(
   return nullptr;
 }
 
+DecodedTokens::DecodedTokens() {}
+
+DecodedTokens::DecodedTokens(const std::vector<std::string>& tokens) {
+  size_t length = 0;
+  for (const std::string& token : tokens) {
+    length += token.length();
+  }
+  buffer.reserve(length);
+  ends.reserve(tokens.size());
+  for (const std::string& token : tokens) {
+    push_back(token);
+  }
+}
+
+int DecodedTokens::size() const { return ends.size(); }
+
+std::string_view DecodedTokens::token(int i) const {
+  int start = i == 0 ? 0 : ends[i - 1];
+  return std::string_view(buffer).substr(start, ends[i] - start);
+}
+
+void DecodedTokens::push_back(std::string_view token) {
+  buffer.append(token);
+  end_token();
+}
+
+void DecodedTokens::end_token() { ends.push_back(buffer.length()); }
+
+void DecodedTokens::clear() {
+  buffer.clear();
+  ends.clear();
+}
+
+std::vector<std::string> DecodedTokens::to_vector() const {
+  std::vector<std::string> result;
+  result.reserve(ends.size());
+  for (int i = 0; i < size(); i++) {
+    result.push_back(std::string(token(i)));
+  }
+  return result;
+}
+
+std::vector<std::string> Decoder::decode_chain(
+    std::vector<std::string> tokens) const {
+  DecodedTokens output;
+  decode_into(DecodedTokens(tokens), &output);
+  return output.to_vector();
+}
+
+std::string Decoder::decode(const DecodedTokens& tokens) const {
+  DecodedTokens output;
+  output.buffer.reserve(tokens.buffer.length());
+  output.ends.reserve(tokens.size());
+  decode_into(tokens, &output);
+  return std::move(output.buffer);
+}
+
+void Decoder::collect_stages(std::vector<const Decoder*>* stages) const {
+  stages->push_back(this);
+}
+
 WordPieceDecoder::WordPieceDecoder(std::string prefix, bool cleanup)
     : prefix(prefix), cleanup(cleanup) {}
 
@@ -114,6 +209,19 @@ std::string replace(std::string input, std::string from, std::string to) {
   return input;
 }
 
+bool needs_cleanup(std::string_view input) {
+  for (size_t i = input.find(' '); i != std::string_view::npos &&
+                                   i + 1 < input.length();
+       i = input.find(' ', i + 1)) {
+    char next = input[i + 1];
+    if (next == '.' || next == '?' || next == '!' || next == ',' ||
+        next == '\'' || next == 'n' || next == 'd') {
+      return true;
+    }
+  }
+  return false;
+}
+
 std::string cleanup_token(std::string dirty_input) {
   dirty_input = replace(dirty_input, " .", ".");
   dirty_input = replace(dirty_input, " ?", "?");
@@ -129,90 +237,624 @@ std::string cleanup_token(std::string dirty_input) {
   return dirty_input;
 }
 
-std::vector<std::string> WordPieceDecoder::decode_chain(
-    std::vector<std::string> tokens) const {
-  std::vector<std::string> result;
+void WordPieceDecoder::decode_into(const DecodedTokens& tokens,
+                                   DecodedTokens* output) const {
   for (int i = 0; i < tokens.size(); i++) {
-    std::string token = tokens[i];
+    std::string_view token = tokens.token(i);
+    size_t start = output->buffer.length();
     if (i != 0) {
-      if (token.find(prefix) == 0) {
-        token.replace(0, prefix.length(), "");
+      if (token.compare(0, prefix.length(), prefix) == 0) {
+        token.remove_prefix(prefix.length());
       } else {
-        token = " " + token;
+        output->buffer.push_back(' ');
       }
     }
-    if (cleanup) {
-      token = cleanup_token(token);
+    output->buffer.append(token);
+    std::string_view written = std::string_view(output->buffer).substr(start);
+    if (cleanup && needs_cleanup(written)) {
+      std::string cleaned = cleanup_token(std::string(written));
+      output->buffer.replace(start, std::string::npos, cleaned);
     }
-    result.push_back(token);
+    output->end_token();
   }
-  return result;
 }
 
 ReplaceDecoder::ReplaceDecoder(const std::string& pattern,
-                               const std::string& content)
-    : pattern(pattern), content(content) {}
+                               const std::string& content,
+                               PATTERN_TYPE pattern_type)
+    : pattern(pattern), content(content), pattern_type(pattern_type) {
+  if (pattern_type == REGEX_PATTERN_TYPE) {
+    regex = Regex(pattern);
+  }
+}
 
-std::vector<std::string> ReplaceDecoder::decode_chain(
-    std::vector<std::string> tokens) const {
-  return {};
+void ReplaceDecoder::decode_into(const DecodedTokens& tokens,
+                                 DecodedTokens* output) const {
+  std::string_view literal = pattern;
+  for (int i = 0; i < tokens.size(); i++) {
+    std::string_view token = tokens.token(i);
+    size_t start = 0;
+    if (pattern_type == REGEX_PATTERN_TYPE) {
+      for (auto match : regex.find_matches(token)) {
+        output->buffer.append(token.substr(start, match.first - start));
+        output->buffer.append(content);
+        start = match.second;
+      }
+    } else {
+      size_t found = find_literal(token, literal);
+      while (found != std::string_view::npos) {
+        output->buffer.append(token.substr(start, found - start));
+        output->buffer.append(content);
+        start = found + literal.length();
+        found = find_literal(token, literal, start);
+      }
+    }
+    output->buffer.append(token.substr(start));
+    output->end_token();
+  }
 }
 
 ByteFallbackDecoder::ByteFallbackDecoder() {}
 
-std::vector<std::string> ByteFallbackDecoder::decode_chain(
-    std::vector<std::string> tokens) const {
-  return {};
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+bool is_valid_utf8(std::string_view input) {
+  int i = 0, length = input.length();
+  while (i < length) {
+    UChar32 c;
+    U8_NEXT(input.data(), i, length, c);
+    if (c < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int fallback_byte(std::string_view token) {
+  if (token.length() == 6 && token.compare(0, 3, "<0x") == 0 &&
+      token[5] == '>' && hex_value(token[3]) >= 0 &&
+      hex_value(token[4]) >= 0) {
+    return hex_value(token[3]) * 16 + hex_value(token[4]);
+  }
+  return -1;
+}
+
+void ByteFallbackDecoder::decode_into(const DecodedTokens& tokens,
+                                      DecodedTokens* output) const {
+  size_t pending_start = output->buffer.length();
+  int pending = 0;
+  auto flush = [&]() {
+    if (pending == 0) {
+      return;
+    }
+    if (is_valid_utf8(std::string_view(output->buffer).substr(pending_start))) {
+      output->end_token();
+    } else {
+      output->buffer.resize(pending_start);
+      for (int j = 0; j < pending; j++) {
+        output->push_back("\uFFFD");
+      }
+    }
+    pending = 0;
+  };
+  for (int i = 0; i < tokens.size(); i++) {
+    std::string_view token = tokens.token(i);
+    int byte = fallback_byte(token);
+    if (byte >= 0) {
+      if (pending == 0) {
+        pending_start = output->buffer.length();
+      }
+      output->buffer.push_back(static_cast<char>(byte));
+      pending++;
+      continue;
+    }
+    flush();
+    output->push_back(token);
+  }
+  flush();
 }
 
 FuseDecoder::FuseDecoder() {}
 
-std::vector<std::string> FuseDecoder::decode_chain(
-    std::vector<std::string> tokens) const {
-  return {};
+void FuseDecoder::decode_into(const DecodedTokens& tokens,
+                              DecodedTokens* output) const {
+  output->push_back(tokens.buffer);
 }
 
 StripDecoder::StripDecoder(const std::string& content, int start, int stop)
     : content(content), start(start), stop(stop) {}
 
-std::vector<std::string> StripDecoder::decode_chain(
-    std::vector<std::string> tokens) const {
-  return {};
+void StripDecoder::decode_into(const DecodedTokens& tokens,
+                               DecodedTokens* output) const {
+  for (int i = 0; i < tokens.size(); i++) {
+    std::string_view token = tokens.token(i);
+    std::string_view literal = content;
+    if (literal.length() != 0) {
+      for (int j = 0; j < start && token.substr(0, literal.length()) == literal;
+           j++) {
+        token.remove_prefix(literal.length());
+      }
+      for (int j = 0; j < stop && token.length() >= literal.length() &&
+                      token.substr(token.length() - literal.length()) ==
+                          literal;
+           j++) {
+        token.remove_suffix(literal.length());
+      }
+    }
+    output->push_back(token);
+  }
 }
 
-SequenceDecoder::SequenceDecoder(std::vector<std::unique_ptr<Decoder>> decoders)
-    : decoders(std::move(decoders)) {}
+MetaspaceDecoder::MetaspaceDecoder(const std::string& replacement,
+                                   const std::string& prepend_scheme)
+    : replacement(replacement),
+      prepend_scheme(get_prepend_scheme(prepend_scheme)) {}
 
-std::vector<std::string> SequenceDecoder::decode_chain(
-    std::vector<std::string> tokens) const {
+void MetaspaceDecoder::decode_into(const DecodedTokens& tokens,
+                                   DecodedTokens* output) const {
+  std::string_view literal = replacement;
+  for (int i = 0; i < tokens.size(); i++) {
+    std::string_view token = tokens.token(i);
+    bool strip = i == 0 && prepend_scheme != NEVER_PREPEND_SCHEME;
+    size_t start = 0;
+    size_t found = find_literal(token, literal);
+    while (found != std::string_view::npos) {
+      output->buffer.append(token.substr(start, found - start));
+      if (!strip) {
+        output->buffer.push_back(' ');
+      }
+      start = found + literal.length();
+      found = find_literal(token, literal, start);
+    }
+    output->buffer.append(token.substr(start));
+    output->end_token();
+  }
+}
+
+SequenceDecoder::SequenceDecoder(
+    std::vector<std::unique_ptr<Decoder>> decoders) {
+  for (std::unique_ptr<Decoder>& decoder : decoders) {
+    SequenceDecoder* sequence = dynamic_cast<SequenceDecoder*>(decoder.get());
+    if (sequence != nullptr) {
+      for (std::unique_ptr<Decoder>& inner : sequence->decoders) {
+        this->decoders.push_back(std::move(inner));
+      }
+    } else {
+      this->decoders.push_back(std::move(decoder));
+    }
+  }
+}
+
+void SequenceDecoder::decode_into(const DecodedTokens& tokens,
+                                  DecodedTokens* output) const {
+  if (decoders.size() == 0) {
+    for (int i = 0; i < tokens.size(); i++) {
+      output->push_back(tokens.token(i));
+    }
+    return;
+  }
+  DecodedTokens scratch[2];
+  const DecodedTokens* input = &tokens;
+  for (int i = 0; i < decoders.size(); i++) {
+    DecodedTokens* target = output;
+    if (i + 1 != decoders.size()) {
+      target = &scratch[i % 2];
+      target->clear();
+      target->buffer.reserve(input->buffer.length() + input->size());
+      target->ends.reserve(input->size());
+    }
+    decoders[i]->decode_into(*input, target);
+    input = target;
+  }
+}
+
+void SequenceDecoder::collect_stages(
+    std::vector<const Decoder*>* stages) const {
   for (const std::unique_ptr<Decoder>& decoder : decoders) {
-    tokens = decoder->decode_chain(tokens);
+    decoder->collect_stages(stages);
   }
-  return tokens;
 }
 
 ByteLevelDecoder::ByteLevelDecoder() {
-  auto BYTES_CHAR = bytes_char();
-  for (auto elem : BYTES_CHAR) {
-    CHAR_BYTES[elem.second] = elem.first;
+  for (auto elem : bytes_char()) {
+    int i = 0;
+    UChar32 c;
+    U8_NEXT(elem.second.data(), i, static_cast<int>(elem.second.length()), c);
+    if (c >= static_cast<int>(CHAR_BYTES.size())) {
+      CHAR_BYTES.resize(c + 1, -1);
+    }
+    CHAR_BYTES[c] = elem.first;
   }
 }
 
-std::vector<std::string> ByteLevelDecoder::decode_chain(
-    std::vector<std::string> tokens) const {
-  std::string result;
-  for (const auto& token : tokens) {
-    icu::UnicodeString unicode_token = icu::UnicodeString::fromUTF8(token);
-    for (int i = 0; i < unicode_token.length(); i++) {
-      auto ch = unicode_token.char32At(i);
-      auto it = CHAR_BYTES.find(std::string(1, ch));
-      if (it != CHAR_BYTES.end()) {
-        result.push_back(static_cast<char>(it->second));
+void ByteLevelDecoder::append_bytes(std::string_view token,
+                                    std::string* bytes) const {
+  size_t start = bytes->length();
+  int i = 0, length = token.length();
+  while (i < length) {
+    UChar32 c;
+    U8_NEXT(token.data(), i, length, c);
+    if (c < 0 || c >= CHAR_BYTES.size() || CHAR_BYTES[c] < 0) {
+      bytes->resize(start);
+      bytes->append(token);
+      return;
+    }
+    bytes->push_back(static_cast<char>(CHAR_BYTES[c]));
+  }
+}
+
+void append_lossy_utf8(std::string_view bytes, std::string* output) {
+  int i = 0, run = 0, length = bytes.length();
+  while (i < length) {
+    int previous = i;
+    UChar32 c;
+    U8_NEXT(bytes.data(), i, length, c);
+    if (c < 0) {
+      output->append(bytes.substr(run, previous - run));
+      output->append("\uFFFD");
+      run = i;
+    }
+  }
+  output->append(bytes.substr(run));
+}
+
+void ByteLevelDecoder::decode_into(const DecodedTokens& tokens,
+                                   DecodedTokens* output) const {
+  std::string bytes;
+  bytes.reserve(tokens.buffer.length());
+  for (int i = 0; i < tokens.size(); i++) {
+    append_bytes(tokens.token(i), &bytes);
+  }
+  append_lossy_utf8(bytes, &output->buffer);
+  output->end_token();
+}
+
+DecodedTokens decode_stages(const std::vector<const Decoder*>& stages,
+                            DecodedTokens tokens) {
+  for (const Decoder* stage : stages) {
+    DecodedTokens output;
+    output.buffer.reserve(tokens.buffer.length() + tokens.size());
+    output.ends.reserve(tokens.size());
+    stage->decode_into(tokens, &output);
+    tokens = std::move(output);
+  }
+  return tokens;
+}
+
+DecodeTable::DecodeTable()
+    : enabled(false),
+      byte_fallback(false),
+      position_dependent(false),
+      byte_level(nullptr) {}
+
+DecodeTable::DecodeTable(const Decoder* decoder,
+                         const std::vector<std::optional<std::string>>& tokens,
+                         const std::vector<bool>& special)
+    : DecodeTable() {
+  std::vector<const Decoder*> stages;
+  decoder->collect_stages(&stages);
+  size_t fuse = 0;
+  for (; fuse < stages.size(); fuse++) {
+    const Decoder* stage = stages[fuse];
+    byte_level = dynamic_cast<const ByteLevelDecoder*>(stage);
+    if (byte_level != nullptr ||
+        dynamic_cast<const FuseDecoder*>(stage) != nullptr) {
+      break;
+    }
+    // stages after ByteFallback would see byte runs grouped into one token
+    if (byte_fallback) {
+      return;
+    }
+    if (dynamic_cast<const ByteFallbackDecoder*>(stage) != nullptr) {
+      byte_fallback = true;
+      continue;
+    }
+    if (dynamic_cast<const WordPieceDecoder*>(stage) != nullptr ||
+        dynamic_cast<const MetaspaceDecoder*>(stage) != nullptr) {
+      position_dependent = true;
+    } else if (dynamic_cast<const ReplaceDecoder*>(stage) == nullptr &&
+               dynamic_cast<const StripDecoder*>(stage) == nullptr) {
+      return;
+    }
+    per_token.push_back(stage);
+  }
+  if (byte_fallback && byte_level != nullptr) {
+    return;
+  }
+  fused.assign(stages.begin() + std::min(fuse + 1, stages.size()),
+               stages.end());
+
+  // decode every token after an empty one so none is treated as the first
+  DecodedTokens input;
+  input.end_token();
+  for (const std::optional<std::string>& token : tokens) {
+    input.push_back(token.has_value() ? token.value() : "");
+  }
+  DecodedTokens output = decode_stages(per_token, std::move(input));
+  known.resize(tokens.size());
+  fallback_bytes.resize(tokens.size());
+  for (int id = 0; id < tokens.size(); id++) {
+    bool is_byte;
+    entries.push_back(entry(output.token(id + 1), &is_byte));
+    known[id] = tokens[id].has_value();
+    fallback_bytes[id] = is_byte;
+    if (position_dependent) {
+      sources.push_back(tokens[id].has_value() ? tokens[id].value() : "");
+    }
+  }
+  this->special = special;
+  this->special.resize(tokens.size());
+  enabled = true;
+}
+
+bool DecodeTable::is_enabled() const { return enabled; }
+
+int DecodeTable::size() const { return known.size(); }
+
+std::optional<std::string_view> DecodeTable::token_bytes(int id) const {
+  if (id < 0 || id >= known.size() || !known[id]) {
+    return std::nullopt;
+  }
+  return entries.token(id);
+}
+
+std::string DecodeTable::entry(std::string_view token, bool* is_byte) const {
+  int byte = byte_fallback ? fallback_byte(token) : -1;
+  *is_byte = byte >= 0;
+  if (*is_byte) {
+    return std::string(1, static_cast<char>(byte));
+  }
+  if (byte_level != nullptr) {
+    std::string bytes;
+    byte_level->append_bytes(token, &bytes);
+    return bytes;
+  }
+  return std::string(token);
+}
+
+std::string DecodeTable::decode(const std::vector<int>& ids,
+                                bool skip_special_tokens) const {
+  std::string output;
+  decode_into(ids.data(), ids.size(), skip_special_tokens, &output);
+  return output;
+}
+
+void DecodeTable::decode_into(const int* ids, size_t length,
+                              bool skip_special_tokens,
+                              std::string* output) const {
+  size_t start = output->length();
+  size_t pending_start = start;
+  int pending = 0;
+  auto flush = [&]() {
+    if (pending != 0 &&
+        !is_valid_utf8(std::string_view(*output).substr(pending_start))) {
+      output->resize(pending_start);
+      for (int j = 0; j < pending; j++) {
+        output->append("\uFFFD");
+      }
+    }
+    pending = 0;
+  };
+  bool first = true;
+  for (size_t i = 0; i < length; i++) {
+    int id = ids[i];
+    if (id < 0 || id >= known.size() || !known[id] ||
+        (skip_special_tokens && special[id])) {
+      continue;
+    }
+    bool is_byte = fallback_bytes[id];
+    std::string first_entry;
+    std::string_view token = entries.token(id);
+    if (first && position_dependent) {
+      DecodedTokens source;
+      source.push_back(sources.token(id));
+      source = decode_stages(per_token, std::move(source));
+      first_entry = entry(source.token(0), &is_byte);
+      token = first_entry;
+    }
+    first = false;
+    if (!is_byte) {
+      flush();
+    } else if (pending++ == 0) {
+      pending_start = output->length();
+    }
+    output->append(token);
+  }
+  flush();
+  std::string_view decoded = std::string_view(*output).substr(start);
+  if (fused.size() == 0 && (byte_level == nullptr || is_valid_utf8(decoded))) {
+    return;
+  }
+  DecodedTokens joined;
+  if (byte_level != nullptr) {
+    append_lossy_utf8(decoded, &joined.buffer);
+    joined.end_token();
+  } else {
+    joined.push_back(decoded);
+  }
+  output->resize(start);
+  output->append(decode_stages(fused, std::move(joined)).buffer);
+}
+
+StopMatch::StopMatch(int stop, int token, size_t start, size_t end)
+    : stop(stop), token(token), start(start), end(end) {}
+
+StopSequenceMatcher::StopSequenceMatcher(const std::vector<std::string>& stops)
+    : transitions(256, -1), matches(1, -1), state(0), position(0) {
+  for (int i = 0; i < stops.size(); i++) {
+    lengths.push_back(stops[i].length());
+    if (stops[i].empty()) {
+      continue;
+    }
+    int node = 0;
+    for (unsigned char c : stops[i]) {
+      if (transitions[node * 256 + c] < 0) {
+        transitions[node * 256 + c] = matches.size();
+        transitions.resize(transitions.size() + 256, -1);
+        matches.push_back(-1);
+      }
+      node = transitions[node * 256 + c];
+    }
+    if (matches[node] < 0 || lengths[matches[node]] < lengths[i]) {
+      matches[node] = i;
+    }
+  }
+  // breadth first, so failure targets are complete before their dependents
+  std::vector<int> failures(matches.size(), 0);
+  std::vector<int> queue;
+  for (int c = 0; c < 256; c++) {
+    int& next = transitions[c];
+    if (next < 0) {
+      next = 0;
+    } else {
+      queue.push_back(next);
+    }
+  }
+  for (int i = 0; i < queue.size(); i++) {
+    int node = queue[i];
+    int failure = failures[node];
+    // stops ending through the failure link are suffixes, so shorter
+    if (matches[node] < 0) {
+      matches[node] = matches[failure];
+    }
+    for (int c = 0; c < 256; c++) {
+      int& next = transitions[node * 256 + c];
+      if (next < 0) {
+        next = transitions[failure * 256 + c];
       } else {
-        result.push_back(ch);
+        failures[next] = transitions[failure * 256 + c];
+        queue.push_back(next);
       }
     }
   }
+}
+
+std::optional<StopMatch> StopSequenceMatcher::feed(std::string_view text,
+                                                   int token) {
+  for (unsigned char c : text) {
+    state = transitions[state * 256 + c];
+    position++;
+    if (matches[state] >= 0) {
+      int stop = matches[state];
+      return StopMatch(stop, token, position - lengths[stop], position);
+    }
+  }
+  return std::nullopt;
+}
+
+void StopSequenceMatcher::reset() {
+  state = 0;
+  position = 0;
+}
+
+VocabularyIndex::VocabularyIndex(
+    const std::vector<std::optional<std::string>>& token_bytes)
+    : size(token_bytes.size()) {
+  std::vector<std::string_view> bytes(size);
+  for (int id = 0; id < size; id++) {
+    if (token_bytes[id].has_value()) {
+      order.push_back(id);
+      bytes[id] = token_bytes[id].value();
+    }
+  }
+  build(bytes);
+}
 
-  return {result};
+VocabularyIndex::VocabularyIndex(const DecodeTable& table)
+    : size(table.size()) {
+  std::vector<std::string_view> bytes(size);
+  for (int id = 0; id < size; id++) {
+    std::optional<std::string_view> token = table.token_bytes(id);
+    if (token.has_value()) {
+      order.push_back(id);
+      bytes[id] = token.value();
+    }
+  }
+  build(bytes);
+}
+
+void VocabularyIndex::build(const std::vector<std::string_view>& bytes) {
+  std::sort(order.begin(), order.end(),
+            [&](int a, int b) { return bytes[a] < bytes[b]; });
+  add_node(bytes, 0, order.size(), 0);
+}
+
+int VocabularyIndex::add_node(const std::vector<std::string_view>& bytes,
+                              int begin, int end, int depth) {
+  int node = begins.size();
+  int exact_end = begin;
+  while (exact_end < end && bytes[order[exact_end]].length() == depth) {
+    exact_end++;
+  }
+  begins.push_back(begin);
+  exact_ends.push_back(exact_end);
+  ends.push_back(end);
+  std::vector<int> splits;
+  for (int i = exact_end; i < end; i++) {
+    if (i == exact_end ||
+        bytes[order[i]][depth] != bytes[order[i - 1]][depth]) {
+      splits.push_back(i);
+    }
+  }
+  splits.push_back(end);
+  int edge_begin = edge_bytes.size();
+  edge_begins.push_back(edge_begin);
+  edge_ends.push_back(edge_begin + splits.size() - 1);
+  edge_bytes.resize(edge_ends[node]);
+  edge_targets.resize(edge_ends[node]);
+  for (int i = 0; i + 1 < splits.size(); i++) {
+    edge_bytes[edge_begin + i] = bytes[order[splits[i]]][depth];
+    int target = add_node(bytes, splits[i], splits[i + 1], depth + 1);
+    edge_targets[edge_begin + i] = target;
+  }
+  return node;
+}
+
+int VocabularyIndex::child(int node, uint8_t byte) const {
+  auto first = edge_bytes.begin() + edge_begins[node];
+  auto last = edge_bytes.begin() + edge_ends[node];
+  auto it = std::lower_bound(first, last, byte);
+  if (it == last || *it != byte) {
+    return -1;
+  }
+  return edge_targets[it - edge_bytes.begin()];
+}
+
+std::vector<bool> VocabularyIndex::starting_with(
+    std::string_view prefix) const {
+  std::vector<bool> result(size);
+  int node = 0;
+  for (int i = 0; i < prefix.length() && node >= 0; i++) {
+    node = child(node, prefix[i]);
+  }
+  if (node >= 0) {
+    for (int i = begins[node]; i < ends[node]; i++) {
+      result[order[i]] = true;
+    }
+  }
+  return result;
+}
+
+std::vector<bool> VocabularyIndex::prefixes_of(std::string_view text) const {
+  std::vector<bool> result(size);
+  int node = 0;
+  for (int i = 0; node >= 0; i++) {
+    for (int j = begins[node]; j < exact_ends[node]; j++) {
+      result[order[j]] = true;
+    }
+    if (i == text.length()) {
+      break;
+    }
+    node = child(node, text[i]);
+  }
+  return result;
 }
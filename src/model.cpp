@@ -3,14 +3,25 @@
 
 #include <unicode/uchar.h>
 #include <unicode/unistr.h>
+#include <unicode/utf16.h>
+#include <unicode/utf8.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <exception>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
 #include <queue>
 #include <random>
-#include <sstream>
+#include <shared_mutex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -33,101 +44,447 @@ MODEL get_model(std::string type) {
   return UNKNOWN_MODEL;
 }
 
-std::unique_ptr<Model> with_model(simdjson::ondemand::object model_params) {
-  simdjson::ondemand::value val;
-  std::string type = std::string(
-      static_cast<std::string_view>(model_params["type"].get_string()));
-  val = model_params["vocab"].value();
-  std::unordered_map<std::string, int> vocab =
-      val.type() == simdjson::ondemand::json_type::null
-          ? std::unordered_map<std::string, int>()
-          : get_map_ints_from_json(val.get_object());
-  if (get_model(type) == WORD_PIECE_MODEL) {
-    val = model_params["unk_token"].value();
-    std::string unk_token =
-        val.type() == simdjson::ondemand::json_type::null
-            ? ""
-            : std::string(static_cast<std::string_view>(val.get_string()));
-    val = model_params["max_input_chars_per_word"].value();
-    int max_input_chars_per_word =
-        val.type() == simdjson::ondemand::json_type::null
-            ? 0
-            : static_cast<int>(val.get_int64());
-    val = model_params["continuing_subword_prefix"].value();
-    std::string continuing_subword_prefix =
-        val.type() == simdjson::ondemand::json_type::null
-            ? ""
-            : std::string(static_cast<std::string_view>(val.get_string()));
-    return std::make_unique<WordPiece>(WordPiece(
-        vocab, unk_token, max_input_chars_per_word, continuing_subword_prefix));
-  } else if (get_model(type) == BPE_MODEL) {
-    val = model_params["merges"].value();
-    std::vector<std::string> merges;
-    if (val.type() != simdjson::ondemand::json_type::null) {
+// Fewest merges for resolving them on several threads.
+const int PARALLEL_MERGES_SIZE = 16384;
+
+bool is_merge_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' ||
+         c == '\r';
+}
+
+std::pair<std::string_view, std::string_view> split_merge(
+    std::string_view merge) {
+  std::string_view parts[2];
+  size_t end = 0;
+  for (std::string_view& part : parts) {
+    size_t start = end;
+    while (start < merge.size() && is_merge_space(merge[start])) {
+      start++;
+    }
+    end = start;
+    while (end < merge.size() && !is_merge_space(merge[end])) {
+      end++;
+    }
+    part = merge.substr(start, end - start);
+  }
+  return {parts[0], parts[1]};
+}
+
+// Parts of a merge given as "a b" or, for parts with spaces, as ["a", "b"].
+// Both are empty for a malformed merge.
+std::pair<std::string_view, std::string_view> get_merge_parts(
+    simdjson::ondemand::value merge) {
+  if (merge.type() == simdjson::ondemand::json_type::string) {
+    return split_merge(merge.get_string());
+  }
+  std::vector<std::string_view> parts;
+  for (auto part : merge.get_array()) {
+    parts.push_back(part.get_string());
+  }
+  if (parts.size() != 2) {
+    return {};
+  }
+  return {parts[0], parts[1]};
+}
+
+// Merges of the parts of each merge between tokens of vocab, ranked by
+// position, resolved on up to num_threads threads, or all hardware threads
+// when num_threads is not positive. Merges of unknown tokens have a negative
+// left.
+std::vector<MergeEntry> get_merges(
+    const Vocab& vocab,
+    const std::vector<std::pair<std::string_view, std::string_view>>& parts,
+    const std::string& continuing_subword_prefix, int num_threads) {
+  int size = parts.size();
+  std::vector<MergeEntry> merges(size);
+  auto resolve_chunk = [&](int begin, int end) {
+    std::string new_token;
+    for (int i = begin; i < end; i++) {
+      merges[i] = {-1, -1, i, -1};
+      std::string_view left = parts[i].first;
+      std::string_view right = parts[i].second;
+      if (left.empty() || right.empty()) {
+        continue;
+      }
+      std::optional<int> left_id = vocab.find(left);
+      std::optional<int> right_id = vocab.find(right);
+      if (!left_id.has_value() || !right_id.has_value()) {
+        continue;
+      }
+      new_token.assign(left);
+      new_token.append(right.substr(
+          std::min(continuing_subword_prefix.length(), right.length())));
+      std::optional<int> new_id = vocab.find(new_token);
+      if (new_id.has_value()) {
+        merges[i] = {*left_id, *right_id, i, *new_id};
+      }
+    }
+  };
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::max(
+      1, std::min(num_threads, size / PARALLEL_MERGES_SIZE));
+  std::vector<std::exception_ptr> errors(num_threads);
+  auto resolve = [&](int t) {
+    try {
+      resolve_chunk(static_cast<int64_t>(size) * t / num_threads,
+                    static_cast<int64_t>(size) * (t + 1) / num_threads);
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; t++) {
+    threads.push_back(std::thread(resolve, t));
+  }
+  resolve(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (std::exception_ptr& error : errors) {
+    if (error != nullptr) {
+      std::rethrow_exception(error);
+    }
+  }
+  return merges;
+}
+
+std::unique_ptr<Model> with_model(simdjson::ondemand::object model_params,
+                                  const Vocab* vocab, const MergeTable* merges,
+                                  int num_threads) {
+  std::string type;
+  std::vector<std::pair<std::string_view, int>> tokens;
+  std::vector<std::pair<std::string_view, std::string_view>> merge_parts;
+  std::string unk_token;
+  int max_input_chars_per_word = 0;
+  std::string continuing_subword_prefix;
+  std::string end_of_word_suffix;
+  float dropout = 0.0;
+  bool fuse_unk = false;
+  bool byte_fallback = false;
+  bool ignore_merges = false;
+  for (auto field : model_params) {
+    std::string_view key = field.escaped_key();
+    simdjson::ondemand::value val = field.value();
+    if (val.is_null()) {
+      continue;
+    }
+    if (key == "type") {
+      type = std::string(static_cast<std::string_view>(val.get_string()));
+    } else if (key == "vocab" && vocab == nullptr) {
+      // tokens view the parser's buffers until the model is built
+      simdjson::ondemand::object vocab_params = val.get_object();
+      tokens.reserve(vocab_params.count_fields());
+      for (auto element : vocab_params) {
+        std::string_view token = element.unescaped_key();
+        tokens.push_back(
+            {token, static_cast<int>(element.value().get_int64())});
+      }
+    } else if (key == "merges" && merges == nullptr) {
       simdjson::ondemand::array merges_array = val.get_array();
+      merge_parts.reserve(merges_array.count_elements());
       for (auto element : merges_array) {
-        merges.push_back(
-            std::string(static_cast<std::string_view>(element.get_string())));
+        merge_parts.push_back(get_merge_parts(element.value()));
       }
+    } else if (key == "unk_token") {
+      unk_token = std::string(static_cast<std::string_view>(val.get_string()));
+    } else if (key == "max_input_chars_per_word") {
+      max_input_chars_per_word = static_cast<int>(val.get_int64());
+    } else if (key == "continuing_subword_prefix") {
+      continuing_subword_prefix =
+          std::string(static_cast<std::string_view>(val.get_string()));
+    } else if (key == "end_of_word_suffix") {
+      end_of_word_suffix =
+          std::string(static_cast<std::string_view>(val.get_string()));
+    } else if (key == "dropout") {
+      dropout = static_cast<float>(val.get_double());
+    } else if (key == "fuse_unk") {
+      fuse_unk = static_cast<bool>(val.get_bool());
+    } else if (key == "byte_fallback") {
+      byte_fallback = static_cast<bool>(val.get_bool());
+    } else if (key == "ignore_merges") {
+      ignore_merges = static_cast<bool>(val.get_bool());
     }
-    val = model_params["dropout"].value();
-    float dropout = val.type() == simdjson::ondemand::json_type::null
-                        ? 0.0
-                        : static_cast<float>(val.get_double());
-    val = model_params["unk_token"].value();
-    std::string unk_token =
-        val.type() == simdjson::ondemand::json_type::null
-            ? ""
-            : std::string(static_cast<std::string_view>(val.get_string()));
-    val = model_params["continuing_subword_prefix"].value();
-    std::string continuing_subword_prefix =
-        val.type() == simdjson::ondemand::json_type::null
-            ? ""
-            : std::string(static_cast<std::string_view>(val.get_string()));
-    val = model_params["end_of_word_suffix"].value();
-    std::string end_of_word_suffix =
-        val.type() == simdjson::ondemand::json_type::null
-            ? ""
-            : std::string(static_cast<std::string_view>(val.get_string()));
-    val = model_params["fuse_unk"].value();
-    bool fuse_unk = val.type() == simdjson::ondemand::json_type::null
-                        ? false
-                        : static_cast<bool>(val.get_bool());
-    val = model_params["byte_fallback"].value();
-    bool byte_fallback = val.type() == simdjson::ondemand::json_type::null
-                             ? false
-                             : static_cast<bool>(val.get_bool());
-    val = model_params["ignore_merges"].value();
-    bool ignore_merges = val.type() == simdjson::ondemand::json_type::null
-                             ? false
-                             : static_cast<bool>(val.get_bool());
-    return std::make_unique<BPE>(
-        BPE(vocab, merges, dropout, unk_token, continuing_subword_prefix,
-            end_of_word_suffix, fuse_unk, byte_fallback, ignore_merges));
   }
-  return nullptr;
+  if (get_model(type) != WORD_PIECE_MODEL && get_model(type) != BPE_MODEL) {
+    return nullptr;
+  }
+  Vocab model_vocab = vocab != nullptr ? *vocab : Vocab(tokens);
+  if (get_model(type) == WORD_PIECE_MODEL) {
+    return std::make_unique<WordPiece>(
+        WordPiece(model_vocab, unk_token, max_input_chars_per_word,
+                  continuing_subword_prefix));
+  }
+  MergeTable model_merges =
+      merges != nullptr
+          ? *merges
+          : MergeTable(get_merges(model_vocab, merge_parts,
+                                  continuing_subword_prefix, num_threads));
+  return std::make_unique<BPE>(
+      BPE(model_vocab, model_merges, dropout, unk_token,
+          continuing_subword_prefix, end_of_word_suffix, fuse_unk,
+          byte_fallback, ignore_merges));
 }
 
-Model::Model(const std::unordered_map<std::string, int>& vocab) : vocab(vocab) {
-  for (auto pair : vocab) {
-    vocab_r[pair.second] = pair.first;
+// Bytes of the Vocab header: tokens, slots, ids and bytes.
+const size_t VOCAB_HEADER_SIZE = 4 * sizeof(uint32_t);
+
+// Bytes of the MergeTable header: merges and slots.
+const size_t MERGE_TABLE_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+// Hashes are part of the binary format, so changing them requires a new
+// BINARY_VERSION.
+uint64_t hash_token(std::string_view token) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : token) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ULL;
   }
+  return hash ^ (hash >> 32);
 }
 
-int Model::get_vocab_size() const { return vocab.size(); }
+// Non-zero tag of a token hash, zero marking empty Vocab slots.
+uint32_t get_tag(uint64_t hash) { return (hash >> 32) | 1; }
 
-std::optional<int> Model::token_to_id(std::string token) {
-  auto it = vocab.find(token);
-  if (it != vocab.end()) {
-    return it->second;
+uint64_t hash_pair(int left, int right) {
+  uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(left)) << 32) |
+                 static_cast<uint32_t>(right);
+  return (key * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+// Smallest power of two slots keeping the load factor at most a half.
+uint32_t get_slot_count(size_t size) {
+  uint32_t slot_count = 1;
+  while (slot_count < 2 * size) {
+    slot_count <<= 1;
+  }
+  return slot_count;
+}
+
+Vocab::Vocab() : Vocab(std::vector<std::pair<std::string_view, int>>()) {}
+
+Vocab::Vocab(const std::unordered_map<std::string, int>& vocab)
+    : Vocab(std::vector<std::pair<std::string_view, int>>(vocab.begin(),
+                                                          vocab.end())) {}
+
+Vocab::Vocab(const std::vector<std::pair<std::string_view, int>>& tokens) {
+  uint32_t slot_count = get_slot_count(tokens.size());
+  int id_count = 0;
+  size_t bytes_size = 0;
+  for (const auto& token : tokens) {
+    id_count = std::max(id_count, token.second + 1);
+    bytes_size += token.first.size();
+  }
+  if (bytes_size >= UINT32_MAX) {
+    throw std::invalid_argument("Vocabulary too large");
+  }
+  size_t size = VOCAB_HEADER_SIZE + slot_count * sizeof(Slot) +
+                id_count * sizeof(int32_t) + bytes_size;
+  auto buffer = std::make_shared<std::vector<uint64_t>>((size + 7) / 8);
+  char* out = reinterpret_cast<char*>(buffer->data());
+  Slot* out_slots = reinterpret_cast<Slot*>(out + VOCAB_HEADER_SIZE);
+  int32_t* out_ids = reinterpret_cast<int32_t*>(out_slots + slot_count);
+  char* out_bytes = reinterpret_cast<char*>(out_ids + id_count);
+  std::fill(out_ids, out_ids + id_count, -1);
+  uint32_t count = 0;
+  uint32_t offset = 0;
+  for (const auto& token : tokens) {
+    uint64_t hash = hash_token(token.first);
+    uint32_t tag = get_tag(hash);
+    uint32_t slot = hash & (slot_count - 1);
+    while (out_slots[slot].tag != 0 &&
+           (out_slots[slot].tag != tag ||
+            std::string_view(out_bytes + out_slots[slot].offset,
+                             out_slots[slot].length) != token.first)) {
+      slot = (slot + 1) & (slot_count - 1);
+    }
+    if (out_slots[slot].tag != 0) {
+      continue;
+    }
+    std::memcpy(out_bytes + offset, token.first.data(), token.first.size());
+    out_slots[slot] = {offset, static_cast<uint32_t>(token.first.size()),
+                       token.second, tag};
+    offset += token.first.size();
+    count++;
+    if (token.second >= 0) {
+      out_ids[token.second] = slot;
+    }
+  }
+  uint32_t header[] = {count, slot_count, static_cast<uint32_t>(id_count),
+                       offset};
+  std::memcpy(out, header, sizeof(header));
+  owner = buffer;
+  view(out, size - (bytes_size - offset));
+}
+
+Vocab::Vocab(const char* data, size_t size, std::shared_ptr<const void> owner)
+    : owner(owner) {
+  view(data, size);
+}
+
+void Vocab::view(const char* data, size_t size) {
+  if (size < VOCAB_HEADER_SIZE) {
+    throw std::runtime_error("Invalid vocabulary table");
+  }
+  uint32_t header[4];
+  std::memcpy(header, data, sizeof(header));
+  uint32_t slot_count = header[1];
+  uint64_t expected = static_cast<uint64_t>(VOCAB_HEADER_SIZE) +
+                      static_cast<uint64_t>(slot_count) * sizeof(Slot) +
+                      static_cast<uint64_t>(header[2]) * sizeof(int32_t) +
+                      header[3];
+  if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0 ||
+      header[0] > slot_count || expected != size) {
+    throw std::runtime_error("Invalid vocabulary table");
+  }
+  this->data = data;
+  data_size = size;
+  count = header[0];
+  slot_mask = slot_count - 1;
+  ids_size = header[2];
+  bytes_size = header[3];
+  slots = reinterpret_cast<const Slot*>(data + VOCAB_HEADER_SIZE);
+  ids = reinterpret_cast<const int32_t*>(slots + slot_count);
+  bytes = reinterpret_cast<const char*>(ids + ids_size);
+}
+
+int Vocab::size() const { return count; }
+
+int Vocab::id_count() const { return ids_size; }
+
+std::optional<int> Vocab::find(std::string_view token) const {
+  uint64_t hash = hash_token(token);
+  uint32_t tag = get_tag(hash);
+  uint32_t slot = hash & slot_mask;
+  for (uint32_t probe = 0; probe <= slot_mask; probe++) {
+    const Slot& entry = slots[slot];
+    if (entry.tag == 0) {
+      return std::nullopt;
+    }
+    if (entry.tag == tag && entry.length == token.size() &&
+        static_cast<uint64_t>(entry.offset) + entry.length <= bytes_size &&
+        std::memcmp(bytes + entry.offset, token.data(), token.size()) == 0) {
+      return entry.id;
+    }
+    slot = (slot + 1) & slot_mask;
   }
   return std::nullopt;
 }
 
+std::optional<std::string_view> Vocab::token(int id) const {
+  if (id < 0 || id >= ids_size || ids[id] < 0 || ids[id] > slot_mask) {
+    return std::nullopt;
+  }
+  const Slot& entry = slots[ids[id]];
+  if (static_cast<uint64_t>(entry.offset) + entry.length > bytes_size) {
+    return std::nullopt;
+  }
+  return std::string_view(bytes + entry.offset, entry.length);
+}
+
+std::string_view Vocab::blob() const {
+  return std::string_view(data, data_size);
+}
+
+MergeTable::MergeTable() : MergeTable(std::vector<MergeEntry>()) {}
+
+MergeTable::MergeTable(const std::vector<MergeEntry>& merges) {
+  uint32_t slot_count = get_slot_count(merges.size());
+  size_t size = MERGE_TABLE_HEADER_SIZE + slot_count * sizeof(MergeEntry);
+  auto buffer = std::make_shared<std::vector<uint64_t>>((size + 7) / 8);
+  char* out = reinterpret_cast<char*>(buffer->data());
+  MergeEntry* out_slots =
+      reinterpret_cast<MergeEntry*>(out + MERGE_TABLE_HEADER_SIZE);
+  std::fill(out_slots, out_slots + slot_count, MergeEntry{-1, -1, -1, -1});
+  uint32_t merge_count = 0;
+  for (const MergeEntry& merge : merges) {
+    if (merge.left < 0) {
+      continue;
+    }
+    uint32_t slot = hash_pair(merge.left, merge.right) & (slot_count - 1);
+    while (out_slots[slot].left >= 0 &&
+           (out_slots[slot].left != merge.left ||
+            out_slots[slot].right != merge.right)) {
+      slot = (slot + 1) & (slot_count - 1);
+    }
+    if (out_slots[slot].left < 0) {
+      out_slots[slot] = merge;
+      merge_count++;
+    }
+  }
+  uint32_t header[] = {merge_count, slot_count};
+  std::memcpy(out, header, sizeof(header));
+  owner = buffer;
+  view(out, size);
+}
+
+MergeTable::MergeTable(const char* data, size_t size,
+                       std::shared_ptr<const void> owner)
+    : owner(owner) {
+  view(data, size);
+}
+
+void MergeTable::view(const char* data, size_t size) {
+  if (size < MERGE_TABLE_HEADER_SIZE) {
+    throw std::runtime_error("Invalid merge table");
+  }
+  uint32_t header[2];
+  std::memcpy(header, data, sizeof(header));
+  uint32_t slot_count = header[1];
+  if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0 ||
+      header[0] > slot_count ||
+      MERGE_TABLE_HEADER_SIZE +
+              static_cast<uint64_t>(slot_count) * sizeof(MergeEntry) !=
+          size) {
+    throw std::runtime_error("Invalid merge table");
+  }
+  this->data = data;
+  data_size = size;
+  count = header[0];
+  slot_mask = slot_count - 1;
+  slots = reinterpret_cast<const MergeEntry*>(data + MERGE_TABLE_HEADER_SIZE);
+}
+
+int MergeTable::size() const { return count; }
+
+const MergeEntry* MergeTable::find(int left, int right) const {
+  if (left < 0) {
+    return nullptr;
+  }
+  uint32_t slot = hash_pair(left, right) & slot_mask;
+  for (uint32_t probe = 0; probe <= slot_mask; probe++) {
+    const MergeEntry& entry = slots[slot];
+    if (entry.left < 0) {
+      return nullptr;
+    }
+    if (entry.left == left && entry.right == right) {
+      return &entry;
+    }
+    slot = (slot + 1) & slot_mask;
+  }
+  return nullptr;
+}
+
+std::string_view MergeTable::blob() const {
+  return std::string_view(data, data_size);
+}
+
+Model::Model(const std::unordered_map<std::string, int>& vocab)
+    : vocab(vocab) {}
+
+Model::Model(Vocab vocab) : vocab(std::move(vocab)) {}
+
+int Model::get_vocab_size() const { return vocab.size(); }
+
+std::optional<int> Model::token_to_id(std::string token) {
+  return vocab.find(token);
+}
+
 std::optional<std::string> Model::id_to_token(int id) {
-  auto it = vocab_r.find(id);
-  if (it != vocab_r.end()) {
-    return it->second;
+  std::optional<std::string_view> token = vocab.token(id);
+  if (token.has_value()) {
+    return std::string(*token);
   }
   return std::nullopt;
 }
@@ -140,62 +497,55 @@ WordPiece::WordPiece(const std::unordered_map<std::string, int>& vocab,
       max_input_chars_per_word(max_input_chars_per_word),
       continuing_subword_prefix(continuing_subword_prefix) {}
 
+WordPiece::WordPiece(Vocab vocab, const std::string& unk_token,
+                     int max_input_chars_per_word,
+                     const std::string& continuing_subword_prefix)
+    : Model(std::move(vocab)),
+      unk_token(unk_token),
+      max_input_chars_per_word(max_input_chars_per_word),
+      continuing_subword_prefix(continuing_subword_prefix) {}
+
 PreTokenizedString WordPiece::tokenize(PreTokenizedString pre_tokenized) const {
   for (auto& split : pre_tokenized.splits) {
-    icu::UnicodeString unicode_sequence =
-        icu::UnicodeString::fromUTF8(split.normalized);
-    int char_len = unicode_sequence.length();
-    if (char_len > max_input_chars_per_word) {
-      auto it = vocab.find(unk_token);
-      if (it == vocab.end()) {
-        split.tokens = {Token(0, unk_token, {0, char_len})};
-        continue;
-      }
-      split.tokens = {Token(it->second, unk_token, {0, char_len})};
-      continue;
-    }
-    bool is_bad = false;
-    int start = 0;
-    std::vector<Token> sub_tokens;
-    while (start < unicode_sequence.length()) {
-      int end = unicode_sequence.length();
-      std::optional<Token> cur_sequence_token = std::nullopt;
-      while (start < end) {
-        std::string sub_sequence;
-        icu::UnicodeString unicode_sub_sequence =
-            unicode_sequence.tempSubString(start, end - start);
-        unicode_sub_sequence.toUTF8String(sub_sequence);
-        if (start > 0) {
-          sub_sequence = continuing_subword_prefix + sub_sequence;
-        }
-        if (vocab.count(sub_sequence) != 0) {
-          auto it = vocab.find(sub_sequence);
-          if (it != vocab.end()) {
-            cur_sequence_token = Token(it->second, sub_sequence, {start, end});
-          }
-          break;
-        }
-        end -= 1;
+    split.tokens = tokenize_word(split.normalized);
+  }
+  return pre_tokenized;
+}
+
+std::vector<Token> WordPiece::tokenize_word(const std::string& sequence) const {
+  icu::UnicodeString unicode_sequence = icu::UnicodeString::fromUTF8(sequence);
+  int char_len = unicode_sequence.length();
+  if (char_len > max_input_chars_per_word) {
+    return {Token(vocab.find(unk_token).value_or(0), unk_token, {0, char_len})};
+  }
+  int start = 0;
+  std::vector<Token> sub_tokens;
+  while (start < unicode_sequence.length()) {
+    int end = unicode_sequence.length();
+    std::optional<Token> cur_sequence_token = std::nullopt;
+    while (start < end) {
+      std::string sub_sequence;
+      icu::UnicodeString unicode_sub_sequence =
+          unicode_sequence.tempSubString(start, end - start);
+      unicode_sub_sequence.toUTF8String(sub_sequence);
+      if (start > 0) {
+        sub_sequence = continuing_subword_prefix + sub_sequence;
       }
-      if (!cur_sequence_token.has_value()) {
-        is_bad = true;
+      std::optional<int> id = vocab.find(sub_sequence);
+      if (id.has_value()) {
+        cur_sequence_token = Token(*id, sub_sequence, {start, end});
         break;
       }
-      sub_tokens.push_back(cur_sequence_token.value());
-      start = end;
+      end -= 1;
     }
-    if (is_bad) {
-      auto it = vocab.find(unk_token);
-      if (it == vocab.end()) {
-        split.tokens = {Token(0, unk_token, {0, char_len})};
-        continue;
-      }
-      split.tokens = {Token(it->second, unk_token, {0, char_len})};
-      continue;
+    if (!cur_sequence_token.has_value()) {
+      return {
+          Token(vocab.find(unk_token).value_or(0), unk_token, {0, char_len})};
     }
-    split.tokens = sub_tokens;
+    sub_tokens.push_back(std::move(cur_sequence_token.value()));
+    start = end;
   }
-  return pre_tokenized;
+  return sub_tokens;
 }
 
 Symbol::Symbol(int c, int prev, int next, int len)
@@ -210,7 +560,10 @@ void Symbol::merge_with(const Symbol* other, int new_c) {
 Merge::Merge(int pos, int rank, int new_id)
     : pos(pos), rank(rank), new_id(new_id) {}
 
-Word::Word(const std::vector<Symbol>& symbols) : symbols(symbols) {}
+Word::Word(std::pmr::memory_resource* resource) : symbols(resource) {}
+
+Word::Word(const std::vector<Symbol>& symbols)
+    : symbols(symbols.begin(), symbols.end()) {}
 
 void Word::add(int c, int len) {
   int prev = -1, next = -1;
@@ -223,17 +576,17 @@ void Word::add(int c, int len) {
   symbols.emplace_back(Symbol(c, prev, next, len));
 }
 
-void Word::merge_all(
-    std::unordered_map<std::pair<int, int>, std::pair<int, int>, PairHash>
-        merges,
-    float dropout) {
-  std::priority_queue<Merge> queue;
-  std::vector<Merge> skip;
-  for (int i = 0; i < symbols.size() - 1; i++) {
-    std::pair<int, int> pair = {symbols[i].c, symbols[i + 1].c};
-    auto it = merges.find(pair);
-    if (it != merges.end()) {
-      queue.emplace(i, it->second.first, it->second.second);
+void Word::merge_all(const MergeTable& merges, float dropout) {
+  std::pmr::memory_resource* resource = symbols.get_allocator().resource();
+  std::pmr::vector<Merge> heap(resource);
+  heap.reserve(symbols.size());
+  std::priority_queue<Merge, std::pmr::vector<Merge>> queue(std::less<Merge>(),
+                                                            std::move(heap));
+  std::pmr::vector<Merge> skip(resource);
+  for (int i = 0; i + 1 < symbols.size(); i++) {
+    const MergeEntry* merge = merges.find(symbols[i].c, symbols[i + 1].c);
+    if (merge != nullptr) {
+      queue.emplace(i, merge->rank, merge->new_id);
     }
   }
   std::default_random_engine rng;
@@ -260,9 +613,8 @@ void Word::merge_all(
       continue;
     }
     const Symbol& right = symbols[next_pos];
-    std::pair<int, int> target_new_pair = {symbols[top.pos].c, right.c};
-    auto target_it = merges.find(target_new_pair);
-    if (target_it == merges.end() || target_it->second.second != top.new_id) {
+    const MergeEntry* target = merges.find(symbols[top.pos].c, right.c);
+    if (target == nullptr || target->new_id != top.new_id) {
       continue;
     }
     symbols[top.pos].merge_with(&right, top.new_id);
@@ -274,21 +626,17 @@ void Word::merge_all(
     if (current.prev >= 0) {
       int prev = current.prev;
       if (prev < symbols.size()) {
-        const Symbol& prev_symbol = symbols[prev];
-        std::pair<int, int> new_pair = {prev_symbol.c, current.c};
-        auto new_it = merges.find(new_pair);
-        if (new_it != merges.end()) {
-          queue.emplace(prev, new_it->second.first, new_it->second.second);
+        const MergeEntry* merge = merges.find(symbols[prev].c, current.c);
+        if (merge != nullptr) {
+          queue.emplace(prev, merge->rank, merge->new_id);
         }
       }
     }
     int next = current.next;
     if (next < symbols.size()) {
-      const Symbol& next_symbol = symbols[next];
-      std::pair<int, int> new_pair = {current.c, next_symbol.c};
-      auto new_it = merges.find(new_pair);
-      if (new_it != merges.end()) {
-        queue.emplace(top.pos, new_it->second.first, new_it->second.second);
+      const MergeEntry* merge = merges.find(current.c, symbols[next].c);
+      if (merge != nullptr) {
+        queue.emplace(top.pos, merge->rank, merge->new_id);
       }
     }
   }
@@ -303,8 +651,25 @@ BPE::BPE(const std::unordered_map<std::string, int>& vocab,
          const std::string& continuing_subword_prefix,
          const std::string& end_of_word_suffix, bool fuse_unk,
          bool byte_fallback, bool ignore_merges)
-    : Model(vocab),
-      merges(),
+    : BPE(Vocab(vocab), MergeTable(), dropout, unk_token,
+          continuing_subword_prefix, end_of_word_suffix, fuse_unk,
+          byte_fallback, ignore_merges) {
+  std::vector<std::pair<std::string_view, std::string_view>> parts;
+  parts.reserve(merges_list.size());
+  for (const std::string& merge : merges_list) {
+    parts.push_back(split_merge(merge));
+  }
+  merges = MergeTable(
+      get_merges(this->vocab, parts, continuing_subword_prefix, 1));
+}
+
+BPE::BPE(Vocab vocab, MergeTable merges, float dropout,
+         const std::string& unk_token,
+         const std::string& continuing_subword_prefix,
+         const std::string& end_of_word_suffix, bool fuse_unk,
+         bool byte_fallback, bool ignore_merges)
+    : Model(std::move(vocab)),
+      merges(std::move(merges)),
       dropout(dropout),
       unk_token(unk_token),
       continuing_subword_prefix(continuing_subword_prefix),
@@ -312,40 +677,25 @@ BPE::BPE(const std::unordered_map<std::string, int>& vocab,
       fuse_unk(fuse_unk),
       byte_fallback(byte_fallback),
       ignore_merges(ignore_merges),
-      cache({}) {
-  int prefix_len = continuing_subword_prefix.length();
-  for (int i = 0; i < merges_list.size(); ++i) {
-    std::istringstream iss(merges_list[i]);
-    std::string part1, part2;
-    if (iss >> part1 >> part2) {
-      auto it1 = vocab.find(part1);
-      auto it2 = vocab.find(part2);
-      if (it1 != vocab.end() && it2 != vocab.end()) {
-        int a_id = it1->second;
-        int b_id = it2->second;
-        std::string new_token =
-            part1 + (prefix_len != 0 ? part2.substr(prefix_len) : part2);
-        auto it_new = vocab.find(new_token);
-        if (it_new != vocab.end()) {
-          int new_id = it_new->second;
-          merges.insert({{a_id, b_id}, {i, new_id}});
-        }
-      }
-    }
-  }
-}
+      cache({}),
+      cache_mutex(std::make_shared<std::shared_mutex>()) {}
 
-Word BPE::merge_word(std::string sequence) const {
+Word BPE::merge_word(const std::string& sequence,
+                     std::pmr::memory_resource* resource) const {
   int length = sequence.size();
-  Word word;
+  Word word(resource);
+  word.symbols.reserve(length);
   std::optional<std::pair<int, int>> unk;
-  for (int i = 0; i < length; i++) {
-    int end = (i + 1 < length) ? i + 1 : length;
+  int end = 0;
+  while (end < length) {
+    int i = end;
+    UChar32 c;
+    U8_NEXT(sequence.data(), end, length, c);
     bool is_first = (i == 0);
     bool is_last = (end == length);
 
     std::string sub_sequence = sequence.substr(i, end - i);
-    int sub_len = sub_sequence.length();
+    int sub_len = end - i;
 
     if (!is_first && continuing_subword_prefix.size() != 0) {
       sub_sequence = (continuing_subword_prefix + sub_sequence);
@@ -355,35 +705,37 @@ Word BPE::merge_word(std::string sequence) const {
       sub_sequence += end_of_word_suffix;
     }
 
-    auto it = vocab.find(sub_sequence);
-    if (it != vocab.end()) {
+    std::optional<int> id = vocab.find(sub_sequence);
+    if (id.has_value()) {
       if (unk.has_value()) {
         word.add(unk->first, unk->second);
         unk.reset();
       }
-      word.add(it->second, sub_len);
+      word.add(*id, sub_len);
     } else {
       if (byte_fallback) {
-        std::vector<std::optional<int>> tokens;
-        for (auto b : sub_sequence) {
-          std::ostringstream oss;
-          oss << "<" << std::hex << std::setw(4) << std::setfill('0') << b
-              << ">";
-          auto code = oss.str();
-          auto token_it = vocab.find(code);
-          tokens.push_back((token_it != vocab.end())
-                               ? std::optional<int>(token_it->second)
-                               : std::nullopt);
-        }
-        bool added = false;
-        for (auto& token : tokens) {
-          if (token.has_value()) {
-            word.add(token.value(), 1);
-            added = true;
+        std::pmr::vector<int> tokens(resource);
+        for (int b = i; b < end; b++) {
+          char code[7];
+          std::snprintf(code, sizeof(code), "<0x%02X>",
+                        static_cast<uint8_t>(sequence[b]));
+          std::optional<int> token_id = vocab.find(code);
+          if (!token_id.has_value()) {
+            tokens.clear();
+            break;
           }
+          tokens.push_back(*token_id);
         }
-        if (added)
+        if (tokens.size() != 0) {
+          if (unk.has_value()) {
+            word.add(unk->first, unk->second);
+            unk.reset();
+          }
+          for (int token : tokens) {
+            word.add(token, 1);
+          }
           continue;
+        }
       }
       if (unk_token.size() != 0) {
         if (unk.has_value() && fuse_unk) {
@@ -392,9 +744,9 @@ Word BPE::merge_word(std::string sequence) const {
           if (unk.has_value()) {
             word.add(unk->first, unk->second);
           }
-          auto unk_it = vocab.find(unk_token);
-          if (unk_it != vocab.end()) {
-            unk = {unk_it->second, sub_len};
+          std::optional<int> unk_id = vocab.find(unk_token);
+          if (unk_id.has_value()) {
+            unk = {*unk_id, sub_len};
           }
         }
       }
@@ -407,43 +759,84 @@ Word BPE::merge_word(std::string sequence) const {
   return word;
 }
 
-std::vector<Token> BPE::word_to_tokens(const Word& word) const {
+std::vector<Token> BPE::word_to_tokens(const Word& word,
+                                       const std::string& sequence) const {
   std::vector<Token> result;
+  result.reserve(word.symbols.size());
+  int length = sequence.size();
+  // start of the character holding pos, in bytes and UTF-16 units
+  int byte = 0;
+  int unit = 0;
   int pos = 0;
   for (auto symbol : word.symbols) {
     int new_pos = pos + symbol.len;
-    result.push_back(Token(symbol.c, vocab_r.at(symbol.c), {pos, new_pos}));
+    while (byte < length) {
+      int next = byte;
+      UChar32 c;
+      U8_NEXT(sequence.data(), next, length, c);
+      if (next > pos) {
+        break;
+      }
+      byte = next;
+      unit += c < 0 ? 1 : U16_LENGTH(c);
+    }
+    int end_byte = byte;
+    int end_unit = unit;
+    while (end_byte < new_pos && end_byte < length) {
+      UChar32 c;
+      U8_NEXT(sequence.data(), end_byte, length, c);
+      end_unit += c < 0 ? 1 : U16_LENGTH(c);
+    }
+    result.push_back(
+        Token(symbol.c, std::string(vocab.token(symbol.c).value()),
+              {unit, end_unit}));
     pos = new_pos;
   }
   return result;
 }
 
-std::vector<Token> BPE::tokenize_with_cache(const std::string& sequence) const {
+std::vector<Token> BPE::tokenize_with_cache(
+    const std::string& sequence, std::pmr::memory_resource* resource) const {
   if (ignore_merges) {
-    auto it = vocab.find(sequence);
-    if (it != vocab.end()) {
-      return {Token(it->second, sequence, {0, 0})};
+    std::optional<int> id = vocab.find(sequence);
+    if (id.has_value()) {
+      int char_len = icu::UnicodeString::fromUTF8(sequence).length();
+      return {Token(*id, sequence, {0, char_len})};
     }
   }
-  auto it = cache.find(sequence);
-  if (it != cache.end()) {
-    return word_to_tokens(it->second);
+  if (sequence.length() >= BPE_CACHE_WORD_SIZE) {
+    return word_to_tokens(merge_word(sequence, resource), sequence);
+  }
+  {
+    std::shared_lock<std::shared_mutex> lock(*cache_mutex);
+    auto it = cache.find(sequence);
+    if (it != cache.end()) {
+      return word_to_tokens(it->second, sequence);
+    }
+  }
+  auto word = merge_word(sequence, resource);
+  auto result = word_to_tokens(word, sequence);
+  std::unique_lock<std::shared_mutex> lock(*cache_mutex);
+  if (cache.size() < BPE_CACHE_CAPACITY) {
+    cache.insert({sequence, word});
   }
-  auto word = merge_word(sequence);
-  auto result = word_to_tokens(word);
-  cache.insert({sequence, word});
   return result;
 }
 
 PreTokenizedString BPE::tokenize(PreTokenizedString pre_tokenized) const {
+  alignas(std::max_align_t) char buffer[WORD_ARENA_SIZE];
+  std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
   for (auto& split : pre_tokenized.splits) {
-    std::string sequence = split.normalized;
-    if (dropout == 0.0f) {
-      split.tokens = tokenize_with_cache(sequence);
-    } else {
-      auto word = merge_word(sequence);
-      split.tokens = word_to_tokens(word);
-    }
+    split.tokens = tokenize_word(split.normalized, &arena);
+    arena.release();
   }
   return pre_tokenized;
 }
+
+std::vector<Token> BPE::tokenize_word(
+    const std::string& sequence, std::pmr::memory_resource* resource) const {
+  if (dropout == 0.0f) {
+    return tokenize_with_cache(sequence, resource);
+  }
+  return word_to_tokens(merge_word(sequence, resource), sequence);
+}
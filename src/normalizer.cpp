@@ -4,15 +4,16 @@
 #include <unicode/normlzr.h>
 #include <unicode/uchar.h>
 #include <unicode/unistr.h>
+#include <unicode/utf8.h>
 
 #include <algorithm>
 #include <functional>
 #include <iostream>
 #include <memory>
-#include <numeric>
 #include <optional>
 #include <regex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -42,11 +43,15 @@ NORMALIZER get_normalizer(std::string type) {
   return UNKNOWN_NORMALIZER;
 }
 
-NormalizedString::NormalizedString(std::wstring normalized)
-    : normalized(normalized) {
+NormalizedString::NormalizedString(std::wstring normalized,
+                                   bool track_offsets)
+    : normalized(std::move(normalized)), track_offsets(track_offsets) {
+  if (!track_offsets) {
+    return;
+  }
   icu::UnicodeString unicode_normalized = icu::UnicodeString::fromUTF32(
-      reinterpret_cast<const UChar32*>(normalized.c_str()),
-      normalized.length());
+      reinterpret_cast<const UChar32*>(this->normalized.c_str()),
+      this->normalized.length());
   int idx = 0;
   for (int i = 0; i < unicode_normalized.length(); i++) {
     icu::UnicodeString unicode_normalized_str;
@@ -63,7 +68,9 @@ NormalizedString::NormalizedString(std::wstring normalized)
 
 NormalizedString::NormalizedString(
     std::wstring normalized, const std::vector<std::pair<int, int>>& offsets)
-    : normalized(normalized), offsets(offsets) {}
+    : normalized(std::move(normalized)),
+      offsets(offsets),
+      track_offsets(true) {}
 
 std::unique_ptr<Normalizer> with_normalizer(
     simdjson::ondemand::object normalizer_params) {
@@ -102,17 +109,26 @@ std::unique_ptr<Normalizer> with_normalizer(
     return std::make_unique<Prepend>(Prepend(prepend));
   } else if (get_normalizer(type) == REPLACE_NORMALIZER) {
     val = normalizer_params["pattern"].value();
-    std::string pattern =
-        std::string(val.type() == simdjson::ondemand::json_type::null
-                        ? ""
-                        : static_cast<std::string_view>(
-                              val["String"].value().get_string()));
+    std::string pattern;
+    PATTERN_TYPE pattern_type = STRING_PATTERN_TYPE;
+    if (val.type() != simdjson::ondemand::json_type::null) {
+      simdjson::ondemand::object pattern_params = val.get_object();
+      auto regex_val = pattern_params["Regex"];
+      if (regex_val.error() == simdjson::SUCCESS) {
+        pattern = std::string(
+            static_cast<std::string_view>(regex_val.get_string()));
+        pattern_type = REGEX_PATTERN_TYPE;
+      } else {
+        pattern = std::string(static_cast<std::string_view>(
+            pattern_params["String"].get_string()));
+      }
+    }
     val = normalizer_params["content"].value();
     std::string content =
         std::string(val.type() == simdjson::ondemand::json_type::null
                         ? ""
                         : static_cast<std::string_view>(val.get_string()));
-    return std::make_unique<Replace>(Replace(pattern, content));
+    return std::make_unique<Replace>(Replace(pattern, content, pattern_type));
   } else if (get_normalizer(type) == BERT_NORMALIZER) {
     val = normalizer_params["clean_text"].value();
     bool clean_text = val.type() == simdjson::ondemand::json_type::null
@@ -151,6 +167,9 @@ std::unique_ptr<Normalizer> with_normalizer(
 
 void NormalizedString::transform_range(std::pair<int, int> original_offsets,
                                        NormalizedString sub_normalized) {
+  if (!track_offsets) {
+    return;
+  }
   int original_start = original_offsets.first;
   int original_end = original_offsets.second;
   int offsets_start = offset_ranges[original_start].first;
@@ -201,7 +220,29 @@ void NormalizedString::transform_range(std::pair<int, int> original_offsets,
                  sub_normalized.offsets.begin(), sub_normalized.offsets.end());
 }
 
+std::pair<int, int> original_offsets(const NormalizedString& normalized,
+                                     int start, int end) {
+  int size = normalized.offset_ranges.size();
+  if (size == 0 || normalized.offsets.size() == 0) {
+    return {start, end};
+  }
+  int byte_size = normalized.offsets.size();
+  int first = std::min(std::max(start, 0), size - 1);
+  int last = std::min(std::max(end - 1, first), size - 1);
+  std::pair<int, int> first_offsets = normalized.offsets[std::min(
+      normalized.offset_ranges[first].first, byte_size - 1)];
+  std::pair<int, int> last_offsets = normalized.offsets[std::min(
+      normalized.offset_ranges[last].first, byte_size - 1)];
+  if (end <= start) {
+    return {first_offsets.first, first_offsets.first};
+  }
+  return {first_offsets.first, last_offsets.second};
+}
+
 void NormalizedString::transform(int i, std::string op, int n) {
+  if (!track_offsets) {
+    return;
+  }
   int start = offset_ranges[i].first;
   int limit = offset_ranges[i].second;
   if (op == "erase") {
@@ -283,7 +324,7 @@ NormalizedString NFC::normalize(NormalizedString normalized) const {
     normalized.transform(i + multi, "grow", 0);
     multi += 1;
   }
-  normalized.normalized = result;
+  normalized.normalized = std::move(result);
   return normalized;
 }
 
@@ -321,7 +362,7 @@ NormalizedString NFD::normalize(NormalizedString normalized) const {
     normalized.transform(i + multi, "grow", 0);
     multi += 1;
   }
-  normalized.normalized = result;
+  normalized.normalized = std::move(result);
   return normalized;
 }
 
@@ -359,7 +400,7 @@ NormalizedString NFKC::normalize(NormalizedString normalized) const {
     normalized.transform(i + multi, "grow", 0);
     multi += 1;
   }
-  normalized.normalized = result;
+  normalized.normalized = std::move(result);
   return normalized;
 }
 
@@ -397,7 +438,7 @@ NormalizedString NFKD::normalize(NormalizedString normalized) const {
     normalized.transform(i + multi, "grow", 0);
     multi += 1;
   }
-  normalized.normalized = result;
+  normalized.normalized = std::move(result);
   return normalized;
 }
 
@@ -410,16 +451,16 @@ BertNormalizer::BertNormalizer(bool clean_text, bool handle_chinese_chars,
 
 NormalizedString BertNormalizer::normalize(NormalizedString normalized) const {
   if (clean_text) {
-    normalized = do_clean_text(normalized);
+    normalized = do_clean_text(std::move(normalized));
   }
   if (handle_chinese_chars) {
-    normalized = do_handle_chinese_chars(normalized);
+    normalized = do_handle_chinese_chars(std::move(normalized));
   }
   if (strip_accents || lowercase) {
-    normalized = do_strip_accents(normalized);
+    normalized = do_strip_accents(std::move(normalized));
   }
   if (lowercase) {
-    normalized = do_lowercase(normalized);
+    normalized = do_lowercase(std::move(normalized));
   }
   return normalized;
 }
@@ -455,6 +496,7 @@ bool is_chinese_char(wchar_t c) {
 
 NormalizedString BertNormalizer::do_clean_text(NormalizedString normalized) {
   std::wstring result;
+  result.reserve(normalized.normalized.length());
   int i = 0;
   for (wchar_t c : normalized.normalized) {
     if (c != 0 && c != 0xFFFD && !is_control(c)) {
@@ -468,7 +510,7 @@ NormalizedString BertNormalizer::do_clean_text(NormalizedString normalized) {
     }
     i++;
   }
-  normalized.normalized = result;
+  normalized.normalized = std::move(result);
   return normalized;
 }
 
@@ -492,7 +534,7 @@ NormalizedString BertNormalizer::do_handle_chinese_chars(
     multi += 2;
     normalized.transform(ti, "pad", 0);
   }
-  std::wstring result = normalized.normalized;
+  std::wstring result = std::move(normalized.normalized);
   i = 0;
   for (const auto& change : new_chars) {
     if (change.second > 0) {
@@ -505,13 +547,14 @@ NormalizedString BertNormalizer::do_handle_chinese_chars(
     }
     i++;
   }
-  normalized.normalized = result;
+  normalized.normalized = std::move(result);
   return normalized;
 }
 
 NormalizedString BertNormalizer::do_strip_accents(NormalizedString normalized) {
-  auto nfd_normalized = NFD().normalize(normalized);
+  auto nfd_normalized = NFD().normalize(std::move(normalized));
   std::wstring result;
+  result.reserve(nfd_normalized.normalized.length());
   int i = 0;
   std::vector<int> shrink_ids;
   for (wchar_t c : nfd_normalized.normalized) {
@@ -527,14 +570,13 @@ NormalizedString BertNormalizer::do_strip_accents(NormalizedString normalized) {
     nfd_normalized.transform(id + multi, "shrink", 0);
     multi -= 1;
   }
-  nfd_normalized.normalized = result;
+  nfd_normalized.normalized = std::move(result);
   return nfd_normalized;
 }
 
 NormalizedString BertNormalizer::do_lowercase(NormalizedString normalized) {
-  std::wstring result = normalized.normalized;
-  std::transform(result.begin(), result.end(), result.begin(), std::towlower);
-  normalized.normalized = result;
+  std::transform(normalized.normalized.begin(), normalized.normalized.end(),
+                 normalized.normalized.begin(), std::towlower);
   return normalized;
 }
 
@@ -544,49 +586,108 @@ SequenceNormalizer::SequenceNormalizer(
 
 NormalizedString SequenceNormalizer::normalize(
     NormalizedString normalized) const {
-  normalized =
-      std::accumulate(normalizers.begin(), normalizers.end(), normalized,
-                      [](const NormalizedString& normalized,
-                         const std::unique_ptr<Normalizer>& normalizer) {
-                        return normalizer->normalize(normalized);
-                      });
+  for (const std::unique_ptr<Normalizer>& normalizer : normalizers) {
+    normalized = normalizer->normalize(std::move(normalized));
+  }
   return normalized;
 }
 
 Prepend::Prepend(const std::string& prepend) : prepend(prepend) {}
 
 NormalizedString Prepend::normalize(NormalizedString normalized) const {
-  std::wstring result = convert_from_string(prepend) + normalized.normalized;
   normalized.transform(0, "add", prepend.length());
-  normalized.normalized = result;
+  normalized.normalized.insert(0, convert_from_string(prepend));
   return normalized;
 }
 
-Replace::Replace(const std::string& pattern, const std::string& content)
-    : pattern(pattern), content(content) {}
+Replace::Replace(const std::string& pattern, const std::string& content,
+                 PATTERN_TYPE pattern_type)
+    : pattern(convert_from_string(pattern)),
+      content(convert_from_string(content)),
+      pattern_type(pattern_type) {
+  if (pattern_type == REGEX_PATTERN_TYPE) {
+    regex = Regex(pattern);
+  }
+}
 
 NormalizedString Replace::normalize(NormalizedString normalized) const {
-  std::wregex regex_pattern(convert_from_string(pattern));
-  std::vector<int> replace_ids;
-  std::wsregex_iterator it(normalized.normalized.begin(),
-                           normalized.normalized.end(), regex_pattern);
-  std::wsregex_iterator end;
-  std::wstring replace_content = convert_from_string(content);
-  while (it != end) {
-    std::wsmatch match = *it;
-    replace_ids.push_back(match.position());
-    normalized.normalized.erase(normalized.normalized.begin() +
-                                match.position());
-    normalized.normalized.insert(
-        normalized.normalized.begin() + match.position(),
-        replace_content.begin(), replace_content.end());
-    ++it;
+  std::vector<std::pair<int, int>> matches;
+  if (pattern_type == STRING_PATTERN_TYPE) {
+    std::wstring_view input = normalized.normalized;
+    size_t found = find_literal(input, std::wstring_view(pattern));
+    while (found != std::wstring_view::npos) {
+      matches.push_back({found, found + pattern.length()});
+      found = find_literal(input, std::wstring_view(pattern),
+                           found + pattern.length());
+    }
+  } else {
+    std::string input = convert_to_string(normalized.normalized);
+    int byte_idx = 0, char_idx = 0;
+    auto char_at = [&](int byte) {
+      for (; byte_idx < byte; byte_idx++) {
+        char_idx += U8_IS_TRAIL(input[byte_idx]) ? 0 : 1;
+      }
+      return char_idx;
+    };
+    for (auto match : regex.find_matches(input)) {
+      int start = char_at(match.first);
+      matches.push_back({start, char_at(match.second)});
+    }
   }
-  int multi = 0;
-  for (auto i : replace_ids) {
-    normalized.transform(i + multi, "replace", content.length());
-    multi += replace_content.length();
+  if (matches.empty()) {
+    return normalized;
+  }
+  std::vector<int> content_lens;
+  for (wchar_t ch : content) {
+    content_lens.push_back(U8_LENGTH(ch));
+  }
+  if (!normalized.track_offsets) {
+    std::wstring result;
+    result.reserve(normalized.normalized.length());
+    int i = 0;
+    for (auto match : matches) {
+      result.append(normalized.normalized, i, match.first - i);
+      result += content;
+      i = match.second;
+    }
+    result.append(normalized.normalized, i, std::wstring::npos);
+    normalized.normalized = std::move(result);
+    return normalized;
   }
+  std::wstring result;
+  std::vector<std::pair<int, int>> offsets;
+  std::vector<std::pair<int, int>> offset_ranges;
+  result.reserve(normalized.normalized.length());
+  offsets.reserve(normalized.offsets.size());
+  offset_ranges.reserve(normalized.offset_ranges.size());
+  auto copy_until = [&](int end, int* i) {
+    for (; *i < end; (*i)++) {
+      std::pair<int, int> range = normalized.offset_ranges[*i];
+      offset_ranges.push_back({offsets.size(), range.second});
+      offsets.insert(offsets.end(), normalized.offsets.begin() + range.first,
+                     normalized.offsets.begin() + range.first + range.second);
+      result.push_back(normalized.normalized[*i]);
+    }
+  };
+  int i = 0;
+  for (auto match : matches) {
+    copy_until(match.first, &i);
+    std::pair<int, int> first = normalized.offset_ranges[match.first];
+    std::pair<int, int> last = normalized.offset_ranges[match.second - 1];
+    std::pair<int, int> original = {
+        normalized.offsets[first.first].first,
+        normalized.offsets[last.first + last.second - 1].second};
+    for (int j = 0; j < content.length(); j++) {
+      offset_ranges.push_back({offsets.size(), content_lens[j]});
+      offsets.insert(offsets.end(), content_lens[j], original);
+    }
+    result += content;
+    i = match.second;
+  }
+  copy_until(normalized.normalized.length(), &i);
+  normalized.normalized = std::move(result);
+  normalized.offsets = std::move(offsets);
+  normalized.offset_ranges = std::move(offset_ranges);
   return normalized;
 }
 
@@ -608,7 +709,8 @@ NormalizedString Strip::normalize(NormalizedString normalized) const {
       --end;
     }
   }
-  normalized.normalized = normalized.normalized.substr(start, end - start);
+  normalized.normalized.erase(end);
+  normalized.normalized.erase(0, start);
   return normalized;
 }
 
@@ -617,12 +719,9 @@ bool isCombiningMark(wchar_t ch) { return (ch >= 0x0300 && ch <= 0x036F); }
 StripAccents::StripAccents() {}
 
 NormalizedString StripAccents::normalize(NormalizedString normalized) const {
-  std::wstring result;
-  for (wchar_t ch : normalized.normalized) {
-    if (!isCombiningMark(ch)) {
-      result += ch;
-    }
-  }
-  normalized.normalized = result;
+  normalized.normalized.erase(
+      std::remove_if(normalized.normalized.begin(),
+                     normalized.normalized.end(), isCombiningMark),
+      normalized.normalized.end());
   return normalized;
 }
@@ -0,0 +1,497 @@
+// Copyright 2024 Omkar Prabhu
+#include "tokenizers/pipeline.h"
+
+#include <unicode/normalizer2.h>
+#include <unicode/uchar.h>
+#include <unicode/unistr.h>
+#include <unicode/utf16.h>
+#include <unicode/utf8.h>
+
+#include <algorithm>
+#include <cwctype>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "tokenizers/added_vocabulary.h"
+#include "tokenizers/common.h"
+#include "tokenizers/model.h"
+#include "tokenizers/normalizer.h"
+#include "tokenizers/post_processor.h"
+#include "tokenizers/pre_tokenizer.h"
+
+DynamicPipeline::DynamicPipeline(const Normalizer* normalizer,
+                                 const PreTokenizer* pre_tokenizer,
+                                 const Model* model,
+                                 const PostProcessor* post_processor)
+    : normalizer(normalizer),
+      pre_tokenizer(pre_tokenizer),
+      model(model),
+      post_processor(post_processor) {}
+
+PIPELINE DynamicPipeline::type() const { return DYNAMIC_PIPELINE; }
+
+PreTokenizedString DynamicPipeline::tokenize(
+    const std::wstring& sequence, const AddedVocabulary* added_vocabulary,
+    bool track_offsets) const {
+  PreTokenizedString pre_tokenized =
+      added_vocabulary == nullptr
+          ? PreTokenizedString(NormalizedString(sequence, track_offsets))
+          : added_vocabulary->extract_and_normalize(normalizer, sequence,
+                                                    track_offsets);
+  if (pre_tokenizer != nullptr) {
+    pre_tokenized = pre_tokenizer->pre_tokenize(std::move(pre_tokenized));
+  }
+  if (model != nullptr) {
+    pre_tokenized = model->tokenize(std::move(pre_tokenized));
+  }
+  return pre_tokenized;
+}
+
+void DynamicPipeline::process(Encoding* encoding,
+                              bool add_special_tokens) const {
+  if (post_processor != nullptr) {
+    post_processor->process(encoding, add_special_tokens);
+  }
+}
+
+// Whether component is exactly a T, or missing when T is void.
+template <typename T, typename Base>
+bool is_component(const Base* component) {
+  if constexpr (std::is_void_v<T>) {
+    return component == nullptr;
+  } else {
+    return component != nullptr && typeid(*component) == typeid(T);
+  }
+}
+
+template <typename Norm, typename PreTok, typename Mod, typename Post>
+std::unique_ptr<Pipeline> match_pipeline(PIPELINE pipeline_type,
+                                         const Normalizer* normalizer,
+                                         const PreTokenizer* pre_tokenizer,
+                                         const Model* model,
+                                         const PostProcessor* post_processor) {
+  if (!is_component<Norm>(normalizer) ||
+      !is_component<PreTok>(pre_tokenizer) || !is_component<Mod>(model) ||
+      !is_component<Post>(post_processor)) {
+    return nullptr;
+  }
+  return std::make_unique<StaticPipeline<Norm, PreTok, Mod, Post>>(
+      StaticPipeline<Norm, PreTok, Mod, Post>(
+          pipeline_type, static_cast<const Norm*>(normalizer),
+          static_cast<const PreTok*>(pre_tokenizer),
+          static_cast<const Mod*>(model),
+          static_cast<const Post*>(post_processor)));
+}
+
+int utf16_units(const std::wstring& sequence, int start, int end) {
+  int units = 0;
+  for (int i = start; i < end; i++) {
+    units += U16_LENGTH(static_cast<UChar32>(sequence[i]));
+  }
+  return units;
+}
+
+// Normalized word built by a fused kernel, with the original range of each
+// of its UTF-16 units.
+class FusedWord {
+ public:
+  std::string normalized;
+  std::vector<std::pair<int, int>> offsets;
+
+  void append(UChar32 c, std::pair<int, int> original) {
+    char bytes[U8_MAX_LENGTH];
+    int length = 0;
+    U8_APPEND_UNSAFE(bytes, length, c);
+    normalized.append(bytes, length);
+    offsets.insert(offsets.end(), U16_LENGTH(c), original);
+  }
+
+  void append(const std::string& value, int units,
+              std::pair<int, int> original) {
+    normalized += value;
+    offsets.insert(offsets.end(), units, original);
+  }
+
+  // Moves the word into a split holding tokens, whose offsets are rebased
+  // from the word onto the original sequence the same way original_offsets
+  // maps them.
+  Split take(std::vector<Token> tokens) {
+    int size = offsets.size();
+    int start = offsets.front().first;
+    for (Token& token : tokens) {
+      int first = std::min(std::max(token.offsets.first, 0), size - 1);
+      int last = std::min(std::max(token.offsets.second - 1, first), size - 1);
+      token.offsets = token.offsets.second <= token.offsets.first
+                          ? std::make_pair(offsets[first].first - start,
+                                           offsets[first].first - start)
+                          : std::make_pair(offsets[first].first - start,
+                                           offsets[last].second - start);
+    }
+    Split split(std::move(normalized), {start, offsets.back().second});
+    split.tokens = std::move(tokens);
+    normalized.clear();
+    offsets.clear();
+    return split;
+  }
+};
+
+// Splits of sequence with its non-normalized added tokens split off and
+// tokenize_range(start, end, unit, splits) run over the rest. Offsets are
+// original UTF-16 units, so the normalized string is left untracked.
+template <typename F>
+PreTokenizedString tokenize_around_added_tokens(
+    const std::wstring& sequence, const AddedVocabulary& added_vocabulary,
+    F tokenize_range) {
+  PreTokenizedString pre_tokenized(NormalizedString(std::wstring(), false));
+  pre_tokenized.splits.clear();
+  int unit = 0;
+  for (auto match : added_vocabulary.find_non_normalized_matches(sequence)) {
+    int start = match.second.first, end = match.second.second;
+    int units = utf16_units(sequence, start, end);
+    if (match.first.has_value()) {
+      Split split(convert_to_string(sequence.substr(start, end - start)),
+                  {unit, unit + units});
+      split.tokens = {Token(match.first.value(), split.normalized, {0, units})};
+      pre_tokenized.splits.push_back(std::move(split));
+    } else {
+      tokenize_range(start, end, unit, &pre_tokenized.splits);
+    }
+    unit += units;
+  }
+  return pre_tokenized;
+}
+
+FusedPipeline::FusedPipeline(std::unique_ptr<Pipeline> fallback)
+    : fallback(std::move(fallback)) {}
+
+void FusedPipeline::process(Encoding* encoding, bool add_special_tokens) const {
+  fallback->process(encoding, add_special_tokens);
+}
+
+FusedBertPipeline::FusedBertPipeline(const BertNormalizer* normalizer,
+                                     const WordPiece* model,
+                                     std::unique_ptr<Pipeline> fallback)
+    : FusedPipeline(std::move(fallback)),
+      normalizer(normalizer),
+      model(model) {}
+
+PIPELINE FusedBertPipeline::type() const { return FUSED_BERT_PIPELINE; }
+
+std::unique_ptr<Pipeline> FusedBertPipeline::fuse(
+    const Normalizer* normalizer, const PreTokenizer* pre_tokenizer,
+    const Model* model, std::unique_ptr<Pipeline>* fallback) {
+  if (!is_component<BertNormalizer>(normalizer) ||
+      !is_component<BertPreTokenizer>(pre_tokenizer) ||
+      !is_component<WordPiece>(model)) {
+    return nullptr;
+  }
+  return std::make_unique<FusedBertPipeline>(FusedBertPipeline(
+      static_cast<const BertNormalizer*>(normalizer),
+      static_cast<const WordPiece*>(model), std::move(*fallback)));
+}
+
+PreTokenizedString FusedBertPipeline::tokenize(
+    const std::wstring& sequence, const AddedVocabulary* added_vocabulary,
+    bool track_offsets) const {
+  if (added_vocabulary == nullptr ||
+      added_vocabulary->has_normalized_tokens()) {
+    return fallback->tokenize(sequence, added_vocabulary, track_offsets);
+  }
+  return tokenize_around_added_tokens(
+      sequence, *added_vocabulary,
+      [&](int start, int end, int unit, std::vector<Split>* splits) {
+        tokenize_range(sequence, start, end, unit, splits);
+      });
+}
+
+void FusedBertPipeline::tokenize_range(const std::wstring& sequence,
+                                       int start, int end, int unit,
+                                       std::vector<Split>* splits) const {
+  bool strip_accents = normalizer->strip_accents || normalizer->lowercase;
+  const icu::Normalizer2* nfd = nullptr;
+  if (strip_accents) {
+    UErrorCode status = U_ZERO_ERROR;
+    nfd = icu::Normalizer2::getNFDInstance(status);
+    if (U_FAILURE(status)) {
+      throw std::runtime_error("ICU normalization failed with error code: " +
+                               std::to_string(status));
+    }
+  }
+  FusedWord word;
+  auto end_word = [&]() {
+    if (!word.offsets.empty()) {
+      splits->push_back(word.take(model->tokenize_word(word.normalized)));
+    }
+  };
+  auto push = [&](UChar32 c, std::pair<int, int> original) {
+    if (strip_accents && u_charType(c) == U_NON_SPACING_MARK) {
+      return;
+    }
+    if (normalizer->lowercase) {
+      c = std::towlower(c);
+    }
+    uint8_t char_class = get_char_class(c);
+    if ((char_class & WHITESPACE_CHAR_CLASS) != 0) {
+      end_word();
+    } else if ((char_class & PUNCTUATION_CHAR_CLASS) != 0) {
+      end_word();
+      word.append(c, original);
+      end_word();
+    } else {
+      word.append(c, original);
+    }
+  };
+  icu::UnicodeString decomposition;
+  for (int i = start; i < end; i++) {
+    UChar32 c = sequence[i];
+    std::pair<int, int> original = {unit, unit + U16_LENGTH(c)};
+    unit = original.second;
+    if (normalizer->clean_text) {
+      if (c == 0 || c == 0xFFFD || is_control(c)) {
+        continue;
+      }
+      if (is_whitespace(c)) {
+        c = ' ';
+      }
+    }
+    bool isolated = normalizer->handle_chinese_chars && is_chinese_char(c);
+    if (isolated) {
+      end_word();
+    }
+    if (nfd != nullptr && nfd->getDecomposition(c, decomposition)) {
+      for (int j = 0; j < decomposition.length();
+           j = decomposition.moveIndex32(j, 1)) {
+        push(decomposition.char32At(j), original);
+      }
+    } else {
+      push(c, original);
+    }
+    if (isolated) {
+      end_word();
+    }
+  }
+  end_word();
+}
+
+FusedByteLevelPipeline::FusedByteLevelPipeline(
+    const Regex* regex, const BPE* model, std::unique_ptr<Pipeline> fallback)
+    : FusedPipeline(std::move(fallback)), regex(regex), model(model) {
+  for (auto elem : bytes_char()) {
+    byte_chars[elem.first] = elem.second;
+  }
+}
+
+PIPELINE FusedByteLevelPipeline::type() const {
+  return FUSED_BYTE_LEVEL_PIPELINE;
+}
+
+std::unique_ptr<Pipeline> FusedByteLevelPipeline::fuse(
+    const Normalizer* normalizer, const PreTokenizer* pre_tokenizer,
+    const Model* model, std::unique_ptr<Pipeline>* fallback) {
+  if (normalizer != nullptr || !is_component<BPE>(model)) {
+    return nullptr;
+  }
+  const Regex* regex = nullptr;
+  if (is_component<ByteLevelPreTokenizer>(pre_tokenizer)) {
+    auto byte_level = static_cast<const ByteLevelPreTokenizer*>(pre_tokenizer);
+    if (byte_level->use_regex && !byte_level->add_prefix_space) {
+      regex = &byte_level->regex;
+    }
+  } else if (is_component<SequencePreTokenizer>(pre_tokenizer)) {
+    const auto& pretokenizers =
+        static_cast<const SequencePreTokenizer*>(pre_tokenizer)->pretokenizers;
+    if (pretokenizers.size() == 2 &&
+        is_component<SplitPreTokenizer>(pretokenizers[0].get()) &&
+        is_component<ByteLevelPreTokenizer>(pretokenizers[1].get())) {
+      auto split =
+          static_cast<const SplitPreTokenizer*>(pretokenizers[0].get());
+      auto byte_level =
+          static_cast<const ByteLevelPreTokenizer*>(pretokenizers[1].get());
+      if (split->pattern_type == REGEX_PATTERN_TYPE &&
+          split->behavior == ISOLATED && !split->invert &&
+          !byte_level->use_regex && !byte_level->add_prefix_space) {
+        regex = &split->regex;
+      }
+    }
+  }
+  if (regex == nullptr) {
+    return nullptr;
+  }
+  return std::make_unique<FusedByteLevelPipeline>(FusedByteLevelPipeline(
+      regex, static_cast<const BPE*>(model), std::move(*fallback)));
+}
+
+PreTokenizedString FusedByteLevelPipeline::tokenize(
+    const std::wstring& sequence, const AddedVocabulary* added_vocabulary,
+    bool track_offsets) const {
+  PreTokenizedString pre_tokenized =
+      added_vocabulary == nullptr
+          ? PreTokenizedString(NormalizedString(sequence, track_offsets))
+          : added_vocabulary->extract_and_normalize(nullptr, sequence,
+                                                    track_offsets);
+  alignas(std::max_align_t) char buffer[WORD_ARENA_SIZE];
+  std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+  std::vector<Split> splits;
+  for (Split& split : pre_tokenized.splits) {
+    if (split.tokens.size() > 0) {
+      splits.push_back(std::move(split));
+      continue;
+    }
+    const std::string& normalized = split.normalized;
+    int byte_start = 0, char_start = split.offsets.first;
+    auto push = [&](int byte_end) {
+      if (byte_end == byte_start) {
+        return;
+      }
+      int char_end =
+          char_start + utf16_length(normalized.data(), byte_start, byte_end);
+      std::string mapped;
+      mapped.reserve((byte_end - byte_start) * 2);
+      for (int i = byte_start; i < byte_end; i++) {
+        mapped += byte_chars[static_cast<uint8_t>(normalized[i])];
+      }
+      Split new_split(std::move(mapped), {char_start, char_end});
+      new_split.tokens = model->tokenize_word(new_split.normalized, &arena);
+      arena.release();
+      splits.push_back(std::move(new_split));
+      byte_start = byte_end;
+      char_start = char_end;
+    };
+    for (auto match : regex->find_matches(normalized)) {
+      push(match.first);
+      push(match.second);
+    }
+    push(normalized.length());
+  }
+  pre_tokenized.splits = std::move(splits);
+  return pre_tokenized;
+}
+
+FusedSentencePiecePipeline::FusedSentencePiecePipeline(
+    const std::string& prepend, const std::string& replacement,
+    const BPE* model, std::unique_ptr<Pipeline> fallback)
+    : FusedPipeline(std::move(fallback)),
+      prepend(prepend),
+      replacement(replacement),
+      model(model) {}
+
+PIPELINE FusedSentencePiecePipeline::type() const {
+  return FUSED_SENTENCE_PIECE_PIPELINE;
+}
+
+std::unique_ptr<Pipeline> FusedSentencePiecePipeline::fuse(
+    const Normalizer* normalizer, const PreTokenizer* pre_tokenizer,
+    const Model* model, std::unique_ptr<Pipeline>* fallback) {
+  if (!is_component<SequenceNormalizer>(normalizer) ||
+      !is_component<void>(pre_tokenizer) || !is_component<BPE>(model)) {
+    return nullptr;
+  }
+  const auto& normalizers =
+      static_cast<const SequenceNormalizer*>(normalizer)->normalizers;
+  if (normalizers.size() != 2 ||
+      !is_component<Prepend>(normalizers[0].get()) ||
+      !is_component<Replace>(normalizers[1].get())) {
+    return nullptr;
+  }
+  auto prepend = static_cast<const Prepend*>(normalizers[0].get());
+  auto replace = static_cast<const Replace*>(normalizers[1].get());
+  if (prepend->prepend.empty() ||
+      replace->pattern_type != STRING_PATTERN_TYPE ||
+      replace->pattern != L" ") {
+    return nullptr;
+  }
+  return std::make_unique<FusedSentencePiecePipeline>(
+      FusedSentencePiecePipeline(
+          prepend->prepend, convert_to_string(replace->content),
+          static_cast<const BPE*>(model), std::move(*fallback)));
+}
+
+PreTokenizedString FusedSentencePiecePipeline::tokenize(
+    const std::wstring& sequence, const AddedVocabulary* added_vocabulary,
+    bool track_offsets) const {
+  if (added_vocabulary == nullptr ||
+      added_vocabulary->has_normalized_tokens()) {
+    return fallback->tokenize(sequence, added_vocabulary, track_offsets);
+  }
+  return tokenize_around_added_tokens(
+      sequence, *added_vocabulary,
+      [&](int start, int end, int unit, std::vector<Split>* splits) {
+        tokenize_range(sequence, start, end, unit, splits);
+      });
+}
+
+void FusedSentencePiecePipeline::tokenize_range(
+    const std::wstring& sequence, int start, int end, int unit,
+    std::vector<Split>* splits) const {
+  if (start == end) {
+    return;
+  }
+  FusedWord word;
+  word.normalized.reserve(prepend.length() + (end - start) * 3);
+  word.append(prepend, utf16_length(prepend.data(), 0, prepend.length()),
+              {unit, unit + U16_LENGTH(static_cast<UChar32>(sequence[start]))});
+  int replacement_units =
+      utf16_length(replacement.data(), 0, replacement.length());
+  for (int i = start; i < end; i++) {
+    UChar32 c = sequence[i];
+    std::pair<int, int> original = {unit, unit + U16_LENGTH(c)};
+    unit = original.second;
+    if (c == ' ') {
+      word.append(replacement, replacement_units, original);
+    } else {
+      word.append(c, original);
+    }
+  }
+  alignas(std::max_align_t) char buffer[WORD_ARENA_SIZE];
+  std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+  splits->push_back(word.take(model->tokenize_word(word.normalized, &arena)));
+}
+
+std::unique_ptr<Pipeline> make_pipeline(const Normalizer* normalizer,
+                                        const PreTokenizer* pre_tokenizer,
+                                        const Model* model,
+                                        const PostProcessor* post_processor) {
+  std::unique_ptr<Pipeline> pipeline =
+      match_pipeline<BertNormalizer, BertPreTokenizer, WordPiece,
+                     TemplateProcessing>(BERT_PIPELINE, normalizer,
+                                         pre_tokenizer, model, post_processor);
+  if (pipeline == nullptr) {
+    pipeline =
+        match_pipeline<BertNormalizer, BertPreTokenizer, WordPiece,
+                       BertProcessing>(BERT_PROCESSING_PIPELINE, normalizer,
+                                       pre_tokenizer, model, post_processor);
+  }
+  if (pipeline == nullptr) {
+    pipeline = match_pipeline<void, ByteLevelPreTokenizer, BPE,
+                              ByteLevelProcessing>(
+        BYTE_LEVEL_PIPELINE, normalizer, pre_tokenizer, model, post_processor);
+  }
+  if (pipeline == nullptr) {
+    pipeline =
+        match_pipeline<void, ByteLevelPreTokenizer, BPE, RobertaProcessing>(
+            ROBERTA_PIPELINE, normalizer, pre_tokenizer, model,
+            post_processor);
+  }
+  if (pipeline == nullptr) {
+    pipeline = std::make_unique<DynamicPipeline>(
+        DynamicPipeline(normalizer, pre_tokenizer, model, post_processor));
+  }
+  std::unique_ptr<Pipeline> fused =
+      FusedBertPipeline::fuse(normalizer, pre_tokenizer, model, &pipeline);
+  if (fused == nullptr) {
+    fused = FusedByteLevelPipeline::fuse(normalizer, pre_tokenizer, model,
+                                         &pipeline);
+  }
+  if (fused == nullptr) {
+    fused = FusedSentencePiecePipeline::fuse(normalizer, pre_tokenizer, model,
+                                             &pipeline);
+  }
+  return fused != nullptr ? std::move(fused) : std::move(pipeline);
+}
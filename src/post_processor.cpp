@@ -1,15 +1,15 @@
 // Copyright 2024 Omkar Prabhu
 #include "tokenizers/post_processor.h"
 
-#include <unicode/uchar.h>
-#include <unicode/unistr.h>
-
 #include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <memory>
-#include <numeric>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -39,6 +39,86 @@ SpecialToken::SpecialToken(const std::string& id, const std::vector<int>& ids,
 
 Piece::Piece(std::string id, int type_id) : id(id), type_id(type_id) {}
 
+std::vector<Encoding> PostProcessor::process_encodings(
+    std::vector<Encoding> encodings, bool add_special_tokens) const {
+  for (Encoding& encoding : encodings) {
+    process(&encoding, add_special_tokens);
+  }
+  return encodings;
+}
+
+int PostProcessor::added_tokens(bool is_pair) const { return 0; }
+
+void PostProcessor::set_vocabulary(
+    const std::vector<std::optional<std::string>>& tokens) {}
+
+void append_encoding(Encoding* result, const Encoding& encoding) {
+  result->ids.insert(result->ids.end(), encoding.ids.begin(),
+                     encoding.ids.end());
+  result->type_ids.insert(result->type_ids.end(), encoding.type_ids.begin(),
+                          encoding.type_ids.end());
+  result->tokens.insert(result->tokens.end(), encoding.tokens.begin(),
+                        encoding.tokens.end());
+  result->words.insert(result->words.end(), encoding.words.begin(),
+                       encoding.words.end());
+  result->offsets.insert(result->offsets.end(), encoding.offsets.begin(),
+                         encoding.offsets.end());
+  result->special_tokens_mask.insert(result->special_tokens_mask.end(),
+                                     encoding.special_tokens_mask.begin(),
+                                     encoding.special_tokens_mask.end());
+  result->attention_mask.insert(result->attention_mask.end(),
+                                encoding.attention_mask.begin(),
+                                encoding.attention_mask.end());
+}
+
+Encoding merge_pair(const Encoding& encoding, const Encoding& pair) {
+  Encoding result;
+  result.fields = encoding.fields;
+  result.reserve(encoding.ids.size() + pair.ids.size());
+  append_encoding(&result, encoding);
+  append_encoding(&result, pair);
+  return result;
+}
+
+Encoding merge_encodings(std::vector<Encoding> encodings) {
+  if (encodings.empty()) {
+    return Encoding();
+  }
+  Encoding result = std::move(encodings[0]);
+  for (int i = 1; i < encodings.size(); i++) {
+    const Encoding& pair = encodings[i];
+    std::vector<Encoding> overflowing;
+    for (const Encoding& first : result.overflowing) {
+      overflowing.push_back(merge_pair(first, pair));
+      for (const Encoding& second : pair.overflowing) {
+        overflowing.push_back(merge_pair(first, second));
+      }
+    }
+    for (const Encoding& second : pair.overflowing) {
+      overflowing.push_back(merge_pair(result, second));
+    }
+    result.overflowing.clear();
+    append_encoding(&result, pair);
+    result.overflowing = std::move(overflowing);
+  }
+  return result;
+}
+
+std::pair<std::string, int> get_special_token_pair(
+    simdjson::ondemand::array special_token_params) {
+  std::pair<std::string, int> special_token;
+  int i = 0;
+  for (auto element : special_token_params) {
+    if (i++ == 0) {
+      special_token.first =
+          std::string(static_cast<std::string_view>(element.get_string()));
+    } else {
+      special_token.second = static_cast<int>(element.get_int64());
+    }
+  }
+  return special_token;
+}
+
 std::unique_ptr<PostProcessor> with_post_processor(
     simdjson::ondemand::object post_processor_params) {
   simdjson::ondemand::value val;
@@ -105,6 +185,27 @@ std::unique_ptr<PostProcessor> with_post_processor(
     }
     return std::make_unique<TemplateProcessing>(
         TemplateProcessing(single, pair, special_tokens));
+  } else if (get_post_processor(type) == BERT_PROCESSING) {
+    std::pair<std::string, int> sep =
+        get_special_token_pair(post_processor_params["sep"].get_array());
+    std::pair<std::string, int> cls =
+        get_special_token_pair(post_processor_params["cls"].get_array());
+    return std::make_unique<BertProcessing>(BertProcessing(sep, cls));
+  } else if (get_post_processor(type) == ROBERTA_PROCESSING) {
+    std::pair<std::string, int> sep =
+        get_special_token_pair(post_processor_params["sep"].get_array());
+    std::pair<std::string, int> cls =
+        get_special_token_pair(post_processor_params["cls"].get_array());
+    val = post_processor_params["trim_offsets"].value();
+    bool trim_offsets = val.type() == simdjson::ondemand::json_type::null
+                            ? true
+                            : static_cast<bool>(val.get_bool());
+    val = post_processor_params["add_prefix_space"].value();
+    bool add_prefix_space = val.type() == simdjson::ondemand::json_type::null
+                                ? true
+                                : static_cast<bool>(val.get_bool());
+    return std::make_unique<RobertaProcessing>(
+        RobertaProcessing(sep, cls, trim_offsets, add_prefix_space));
   } else if (get_post_processor(type) == SEQUENCE_PROCESSING) {
     simdjson::ondemand::array seq_processors_list =
         post_processor_params["processors"].get_array();
@@ -135,151 +236,528 @@ std::unique_ptr<PostProcessor> with_post_processor(
   return nullptr;
 }
 
+TemplateInstruction::TemplateInstruction(TEMPLATE_INSTRUCTION type,
+                                         int sequence, int type_id, int begin,
+                                         int end)
+    : type(type),
+      sequence(sequence),
+      type_id(type_id),
+      begin(begin),
+      end(end) {}
+
 TemplateProcessing::TemplateProcessing(
     const std::vector<std::pair<std::string, Piece>>& single,
     const std::vector<std::pair<std::string, Piece>>& pair,
-    const std::vector<SpecialToken>& special_tokens)
-    : single(single), pair(pair), special_tokens(special_tokens) {}
+    const std::vector<SpecialToken>& special_tokens) {
+  this->single = compile(single, special_tokens);
+  this->pair = compile(pair, special_tokens);
+}
 
-Encoding TemplateProcessing::process(Encoding encoding,
-                                     bool add_special_tokens) const {
-  std::vector<Encoding> final_encodings;
-  for (auto piece : single) {
+std::vector<TemplateInstruction> TemplateProcessing::compile(
+    const std::vector<std::pair<std::string, Piece>>& pieces,
+    const std::vector<SpecialToken>& special_tokens) {
+  std::vector<TemplateInstruction> program;
+  for (const std::pair<std::string, Piece>& piece : pieces) {
     if (piece.first == "Sequence") {
-      if (piece.second.id == "A") {
-        std::vector<int> type_ids(encoding.type_ids.size(),
-                                  piece.second.type_id);
-        encoding.type_ids = type_ids;
+      program.push_back(TemplateInstruction(SEQUENCE_TEMPLATE_INSTRUCTION,
+                                            piece.second.id == "B" ? 1 : 0,
+                                            piece.second.type_id, 0, 0));
+    } else if (piece.first == "SpecialToken") {
+      int begin = special_ids.size();
+      auto it = std::find_if(special_tokens.begin(), special_tokens.end(),
+                             [&piece](const SpecialToken& special_token) {
+                               return special_token.id == piece.second.id;
+                             });
+      if (it == special_tokens.end()) {
+        throw std::invalid_argument("Missing special token " +
+                                    piece.second.id + " of template");
       }
-      final_encodings.push_back(encoding);
+      special_ids.insert(special_ids.end(), it->ids.begin(), it->ids.end());
+      this->special_tokens.insert(this->special_tokens.end(),
+                                  it->tokens.begin(), it->tokens.end());
+      // keep ids and tokens aligned when a config lists fewer tokens
+      this->special_tokens.resize(special_ids.size());
+      program.push_back(TemplateInstruction(SPECIAL_TOKEN_TEMPLATE_INSTRUCTION,
+                                            0, piece.second.type_id, begin,
+                                            special_ids.size()));
     }
-    if (piece.first == "SpecialToken") {
-      if (add_special_tokens) {
-        Encoding new_encoding;
-        SpecialToken special_token;
-        auto it = std::find_if(special_tokens.begin(), special_tokens.end(),
-                               [&piece](const SpecialToken& special_token_it) {
-                                 return special_token_it.id == piece.second.id;
-                               });
-
-        if (it != special_tokens.end()) {
-          special_token = *it;
-        }
-        new_encoding.ids = special_token.ids;
-        new_encoding.tokens = special_token.tokens;
-        new_encoding.type_ids =
-            std::vector<int>(special_token.ids.size(), piece.second.type_id);
-        new_encoding.words = std::vector<std::optional<int>>(
-            special_token.ids.size(), std::nullopt);
-        new_encoding.offsets =
-            std::vector<std::pair<int, int>>(special_token.ids.size(), {0, 0});
-        new_encoding.special_tokens_mask =
-            std::vector<int>(special_token.ids.size(), 1);
-        new_encoding.attention_mask =
-            std::vector<int>(special_token.ids.size(), 1);
-        final_encodings.push_back(new_encoding);
-      }
+  }
+  return program;
+}
+
+Encoding TemplateProcessing::apply(
+    const std::vector<TemplateInstruction>& program,
+    Encoding* const* sequences, bool add_special_tokens) const {
+  size_t length = 0;
+  for (const TemplateInstruction& instruction : program) {
+    if (instruction.type == SEQUENCE_TEMPLATE_INSTRUCTION) {
+      length += sequences[instruction.sequence]->ids.size();
+    } else if (add_special_tokens) {
+      length += instruction.end - instruction.begin;
     }
   }
   Encoding result;
-  for (Encoding final_encoding : final_encodings) {
-    result.ids.insert(result.ids.end(), final_encoding.ids.begin(),
-                      final_encoding.ids.end());
-    result.type_ids.insert(result.type_ids.end(),
-                           final_encoding.type_ids.begin(),
-                           final_encoding.type_ids.end());
-    result.tokens.insert(result.tokens.end(), final_encoding.tokens.begin(),
-                         final_encoding.tokens.end());
-    result.words.insert(result.words.end(), final_encoding.words.begin(),
-                        final_encoding.words.end());
-    result.offsets.insert(result.offsets.end(), final_encoding.offsets.begin(),
-                          final_encoding.offsets.end());
-    result.special_tokens_mask.insert(
-        result.special_tokens_mask.end(),
-        final_encoding.special_tokens_mask.begin(),
-        final_encoding.special_tokens_mask.end());
-    result.attention_mask.insert(result.attention_mask.end(),
-                                 final_encoding.attention_mask.begin(),
-                                 final_encoding.attention_mask.end());
+  EncodeOptions fields = result.fields = sequences[0]->fields;
+  result.ids.resize(length);
+  if (fields & TYPE_IDS_ENCODE_OPTION) {
+    result.type_ids.resize(length);
+  }
+  if (fields & TOKENS_ENCODE_OPTION) {
+    result.tokens.resize(length);
+  }
+  if (fields & WORDS_ENCODE_OPTION) {
+    result.words.resize(length, NO_WORD);
+  }
+  if (fields & OFFSETS_ENCODE_OPTION) {
+    result.offsets.resize(length);
+  }
+  if (fields & SPECIAL_TOKENS_MASK_ENCODE_OPTION) {
+    result.special_tokens_mask.resize(length, 1);
+  }
+  if (fields & ATTENTION_MASK_ENCODE_OPTION) {
+    result.attention_mask.resize(length, 1);
+  }
+  size_t position = 0;
+  for (const TemplateInstruction& instruction : program) {
+    if (instruction.type == SEQUENCE_TEMPLATE_INSTRUCTION) {
+      Encoding& sequence = *sequences[instruction.sequence];
+      size_t size = sequence.ids.size();
+      std::copy(sequence.ids.begin(), sequence.ids.end(),
+                result.ids.begin() + position);
+      if (fields & TYPE_IDS_ENCODE_OPTION) {
+        std::fill_n(result.type_ids.begin() + position, size,
+                    instruction.type_id);
+      }
+      if (fields & TOKENS_ENCODE_OPTION) {
+        std::copy(sequence.tokens.begin(), sequence.tokens.end(),
+                  result.tokens.begin() + position);
+      }
+      if (fields & WORDS_ENCODE_OPTION) {
+        std::copy(sequence.words.begin(), sequence.words.end(),
+                  result.words.begin() + position);
+      }
+      if (fields & OFFSETS_ENCODE_OPTION) {
+        std::copy(sequence.offsets.begin(), sequence.offsets.end(),
+                  result.offsets.begin() + position);
+      }
+      if (fields & SPECIAL_TOKENS_MASK_ENCODE_OPTION) {
+        std::copy(sequence.special_tokens_mask.begin(),
+                  sequence.special_tokens_mask.end(),
+                  result.special_tokens_mask.begin() + position);
+      }
+      if (fields & ATTENTION_MASK_ENCODE_OPTION) {
+        std::copy(sequence.attention_mask.begin(),
+                  sequence.attention_mask.end(),
+                  result.attention_mask.begin() + position);
+      }
+      position += size;
+    } else if (add_special_tokens) {
+      size_t size = instruction.end - instruction.begin;
+      std::copy_n(special_ids.begin() + instruction.begin, size,
+                  result.ids.begin() + position);
+      if (fields & TYPE_IDS_ENCODE_OPTION) {
+        std::fill_n(result.type_ids.begin() + position, size,
+                    instruction.type_id);
+      }
+      if (fields & TOKENS_ENCODE_OPTION) {
+        std::copy_n(special_tokens.begin() + instruction.begin, size,
+                    result.tokens.begin() + position);
+      }
+      position += size;
+    }
   }
   return result;
 }
 
-Encoding ByteLevelProcessing::process_offsets(const Encoding& encoding,
-                                              bool add_prefix_space) const {
-  Encoding new_encoding = encoding;
-  for (int i = 0; i < encoding.ids.size(); i++) {
-    std::string token = encoding.tokens[i];
-    std::pair<int, int> offsets = encoding.offsets[i];
-    int leading_spaces = 0, trailing_spaces = 0;
-    icu::UnicodeString unicode_token = icu::UnicodeString::fromUTF8(token);
-    for (int j = 0; j < unicode_token.length(); j++) {
-      std::string token_char;
-      unicode_token.tempSubString(j, 1).toUTF8String(token_char);
-      if (BYTES_CHAR.at(static_cast<uint16_t>(' ')) == token_char) {
-        leading_spaces++;
-      } else {
-        break;
-      }
+// Moves the first size values to position and grows values to length.
+template <typename T>
+void shift_field(std::vector<T>* values, size_t position, size_t length) {
+  size_t size = values->size();
+  values->resize(length);
+  std::move_backward(values->begin(), values->begin() + size,
+                     values->begin() + position + size);
+}
+
+void TemplateProcessing::apply_in_place(Encoding* encoding,
+                                        bool add_special_tokens) const {
+  size_t size = encoding->ids.size(), length = size, position = 0;
+  int sequences = 0, type_id = 0;
+  for (const TemplateInstruction& instruction : single) {
+    if (instruction.type == SEQUENCE_TEMPLATE_INSTRUCTION) {
+      type_id = instruction.type_id;
+      sequences++;
+    } else if (add_special_tokens) {
+      length += instruction.end - instruction.begin;
+      position += sequences == 0 ? instruction.end - instruction.begin : 0;
     }
-    for (int j = unicode_token.length() - 1; j >= 0; j--) {
-      std::string token_char;
-      unicode_token.tempSubString(j, 1).toUTF8String(token_char);
-      if (BYTES_CHAR.at(static_cast<uint16_t>(' ')) == token_char) {
-        trailing_spaces++;
-      } else {
-        break;
-      }
+  }
+  if (sequences != 1) {
+    Encoding* sequences[] = {encoding, encoding};
+    Encoding result = apply(single, sequences, add_special_tokens);
+    result.overflowing = std::move(encoding->overflowing);
+    *encoding = std::move(result);
+    return;
+  }
+  EncodeOptions fields = encoding->fields;
+  shift_field(&encoding->ids, position, length);
+  if (fields & TYPE_IDS_ENCODE_OPTION) {
+    shift_field(&encoding->type_ids, position, length);
+    std::fill_n(encoding->type_ids.begin() + position, size, type_id);
+  }
+  if (fields & TOKENS_ENCODE_OPTION) {
+    shift_field(&encoding->tokens, position, length);
+  }
+  if (fields & WORDS_ENCODE_OPTION) {
+    shift_field(&encoding->words, position, length);
+  }
+  if (fields & OFFSETS_ENCODE_OPTION) {
+    shift_field(&encoding->offsets, position, length);
+  }
+  if (fields & SPECIAL_TOKENS_MASK_ENCODE_OPTION) {
+    shift_field(&encoding->special_tokens_mask, position, length);
+  }
+  if (fields & ATTENTION_MASK_ENCODE_OPTION) {
+    shift_field(&encoding->attention_mask, position, length);
+  }
+  position = 0;
+  for (const TemplateInstruction& instruction : single) {
+    if (instruction.type == SEQUENCE_TEMPLATE_INSTRUCTION) {
+      position += size;
+      continue;
     }
-    if (leading_spaces > 0 || trailing_spaces > 0) {
-      if (leading_spaces > 0) {
-        bool is_first = (i == 0 || offsets.first == 0);
-        if (is_first && add_prefix_space && leading_spaces == 1) {
-          leading_spaces = 0;
-        }
-        offsets.first =
-            std::min(offsets.first + leading_spaces, offsets.second);
-      }
-      if (trailing_spaces > 0 && offsets.second >= trailing_spaces) {
-        offsets.second =
-            std::max(offsets.second - trailing_spaces, offsets.first);
+    if (!add_special_tokens) {
+      continue;
+    }
+    size_t count = instruction.end - instruction.begin;
+    std::copy_n(special_ids.begin() + instruction.begin, count,
+                encoding->ids.begin() + position);
+    if (fields & TYPE_IDS_ENCODE_OPTION) {
+      std::fill_n(encoding->type_ids.begin() + position, count,
+                  instruction.type_id);
+    }
+    if (fields & TOKENS_ENCODE_OPTION) {
+      std::copy_n(special_tokens.begin() + instruction.begin, count,
+                  encoding->tokens.begin() + position);
+    }
+    if (fields & WORDS_ENCODE_OPTION) {
+      std::fill_n(encoding->words.begin() + position, count, NO_WORD);
+    }
+    if (fields & OFFSETS_ENCODE_OPTION) {
+      std::fill_n(encoding->offsets.begin() + position, count,
+                  std::pair<uint32_t, uint32_t>(0, 0));
+    }
+    if (fields & SPECIAL_TOKENS_MASK_ENCODE_OPTION) {
+      std::fill_n(encoding->special_tokens_mask.begin() + position, count, 1);
+    }
+    if (fields & ATTENTION_MASK_ENCODE_OPTION) {
+      std::fill_n(encoding->attention_mask.begin() + position, count, 1);
+    }
+    position += count;
+  }
+}
+
+void TemplateProcessing::process(Encoding* encoding,
+                                 bool add_special_tokens) const {
+  apply_in_place(encoding, add_special_tokens);
+  for (Encoding& overflowing : encoding->overflowing) {
+    apply_in_place(&overflowing, add_special_tokens);
+  }
+}
+
+std::vector<Encoding> TemplateProcessing::process_encodings(
+    std::vector<Encoding> encodings, bool add_special_tokens) const {
+  if (encodings.size() != 2 || pair.empty()) {
+    return PostProcessor::process_encodings(std::move(encodings),
+                                            add_special_tokens);
+  }
+  Encoding& encoding = encodings[0];
+  Encoding& pair_encoding = encodings[1];
+  std::vector<Encoding> overflowing;
+  for (Encoding& first : encoding.overflowing) {
+    Encoding* sequences[] = {&first, &pair_encoding};
+    overflowing.push_back(apply(pair, sequences, add_special_tokens));
+    for (Encoding& second : pair_encoding.overflowing) {
+      sequences[1] = &second;
+      overflowing.push_back(apply(pair, sequences, add_special_tokens));
+    }
+  }
+  for (Encoding& second : pair_encoding.overflowing) {
+    Encoding* sequences[] = {&encoding, &second};
+    overflowing.push_back(apply(pair, sequences, add_special_tokens));
+  }
+  Encoding* sequences[] = {&encoding, &pair_encoding};
+  Encoding result = apply(pair, sequences, add_special_tokens);
+  result.overflowing = std::move(overflowing);
+  return {std::move(result)};
+}
+
+int TemplateProcessing::added_tokens(bool is_pair) const {
+  int count = 0;
+  for (const TemplateInstruction& instruction : is_pair ? pair : single) {
+    count += instruction.end - instruction.begin;
+  }
+  return count;
+}
+
+std::pair<int, int> count_byte_level_spaces(std::string_view token) {
+  std::string_view space = "\u0120";
+  int leading_spaces = 0, trailing_spaces = 0;
+  while (token.substr(leading_spaces * space.length(), space.length()) ==
+         space) {
+    leading_spaces++;
+  }
+  if (leading_spaces * space.length() == token.length()) {
+    return {leading_spaces, leading_spaces};
+  }
+  while (token.length() >= (trailing_spaces + 1) * space.length() &&
+         token.substr(token.length() - (trailing_spaces + 1) * space.length(),
+                      space.length()) == space) {
+    trailing_spaces++;
+  }
+  return {leading_spaces, trailing_spaces};
+}
+
+std::vector<std::pair<uint16_t, uint16_t>> get_byte_level_spaces(
+    const std::vector<std::optional<std::string>>& tokens) {
+  std::vector<std::pair<uint16_t, uint16_t>> spaces(tokens.size(), {0, 0});
+  for (int id = 0; id < tokens.size(); id++) {
+    if (tokens[id].has_value()) {
+      std::pair<int, int> counts = count_byte_level_spaces(*tokens[id]);
+      spaces[id] = {std::min(counts.first, UINT16_MAX),
+                    std::min(counts.second, UINT16_MAX)};
+    }
+  }
+  return spaces;
+}
+
+// Moves offsets past the leading and trailing byte-level spaces of token,
+// looked up by id when the vocabulary was counted ahead of time.
+std::pair<int, int> trim_byte_level_offsets(
+    const std::vector<std::pair<uint16_t, uint16_t>>& byte_level_spaces,
+    int id, std::string_view token, std::pair<int, int> offsets,
+    bool is_first, bool add_prefix_space) {
+  std::pair<int, int> spaces =
+      id >= 0 && id < byte_level_spaces.size()
+          ? std::pair<int, int>(byte_level_spaces[id])
+          : count_byte_level_spaces(token);
+  if (spaces.first > 0) {
+    if (is_first && add_prefix_space && spaces.first == 1) {
+      spaces.first = 0;
+    }
+    offsets.first = std::min(offsets.first + spaces.first, offsets.second);
+  }
+  if (spaces.second > 0 && offsets.second >= spaces.second) {
+    offsets.second = std::max(offsets.second - spaces.second, offsets.first);
+  }
+  return offsets;
+}
+
+// Trims the offsets of encoding, leaving its overflowing parts as they are.
+void trim_sequence_offsets(
+    const std::vector<std::pair<uint16_t, uint16_t>>& byte_level_spaces,
+    Encoding* encoding, bool add_prefix_space) {
+  if (!(encoding->fields & OFFSETS_ENCODE_OPTION)) {
+    return;
+  }
+  bool has_tokens = encoding->fields & TOKENS_ENCODE_OPTION;
+  for (int i = 0; i < encoding->ids.size(); i++) {
+    encoding->offsets[i] = trim_byte_level_offsets(
+        byte_level_spaces, encoding->ids[i],
+        has_tokens ? encoding->tokens[i] : std::string_view(),
+        encoding->offsets[i], i == 0 || encoding->offsets[i].first == 0,
+        add_prefix_space);
+  }
+}
+
+void trim_byte_level_offsets(
+    const std::vector<std::pair<uint16_t, uint16_t>>& byte_level_spaces,
+    Encoding* encoding, bool add_prefix_space) {
+  trim_sequence_offsets(byte_level_spaces, encoding, add_prefix_space);
+  for (Encoding& overflowing : encoding->overflowing) {
+    trim_sequence_offsets(byte_level_spaces, &overflowing, add_prefix_space);
+  }
+}
+
+template <typename T>
+void wrap_field(std::vector<T>* values, bool has_prefix,
+                const typename std::vector<T>::value_type& prefix,
+                const typename std::vector<T>::value_type& suffix) {
+  values->reserve(values->size() + (has_prefix ? 2 : 1));
+  if (has_prefix) {
+    values->insert(values->begin(), prefix);
+  }
+  values->push_back(suffix);
+}
+
+// Adds prefix (when given) and suffix around the encoding in place. Special
+// tokens get special_type_id, as do the sequence tokens when
+// override_type_ids is set.
+void wrap_encoding(Encoding* encoding,
+                   const std::pair<std::string, int>* prefix,
+                   const std::pair<std::string, int>& suffix,
+                   int special_type_id, bool override_type_ids,
+                   const std::vector<std::pair<uint16_t, uint16_t>>*
+                       byte_level_spaces,
+                   bool add_prefix_space) {
+  if (byte_level_spaces != nullptr) {
+    trim_sequence_offsets(*byte_level_spaces, encoding, add_prefix_space);
+  }
+  EncodeOptions fields = encoding->fields;
+  bool has_prefix = prefix != nullptr;
+  wrap_field(&encoding->ids, has_prefix, has_prefix ? prefix->second : 0,
+             suffix.second);
+  if (fields & TYPE_IDS_ENCODE_OPTION) {
+    if (override_type_ids) {
+      std::fill(encoding->type_ids.begin(), encoding->type_ids.end(),
+                special_type_id);
+    }
+    wrap_field(&encoding->type_ids, has_prefix, special_type_id,
+               special_type_id);
+  }
+  if (fields & TOKENS_ENCODE_OPTION) {
+    wrap_field(&encoding->tokens, has_prefix,
+               has_prefix ? std::string_view(prefix->first) : "",
+               suffix.first);
+  }
+  if (fields & WORDS_ENCODE_OPTION) {
+    wrap_field(&encoding->words, has_prefix, NO_WORD, NO_WORD);
+  }
+  if (fields & OFFSETS_ENCODE_OPTION) {
+    wrap_field(&encoding->offsets, has_prefix, {0, 0}, {0, 0});
+  }
+  if (fields & SPECIAL_TOKENS_MASK_ENCODE_OPTION) {
+    wrap_field(&encoding->special_tokens_mask, has_prefix, 1, 1);
+  }
+  if (fields & ATTENTION_MASK_ENCODE_OPTION) {
+    wrap_field(&encoding->attention_mask, has_prefix, 1, 1);
+  }
+  for (Encoding& overflowing : encoding->overflowing) {
+    wrap_encoding(&overflowing, prefix, suffix, special_type_id,
+                  override_type_ids, byte_level_spaces, add_prefix_space);
+  }
+}
+
+BertProcessing::BertProcessing(const std::pair<std::string, int>& sep,
+                               const std::pair<std::string, int>& cls)
+    : sep(sep), cls(cls) {}
+
+void BertProcessing::process(Encoding* encoding,
+                             bool add_special_tokens) const {
+  if (add_special_tokens) {
+    wrap_encoding(encoding, &cls, sep, 0, false, nullptr, false);
+  }
+}
+
+std::vector<Encoding> BertProcessing::process_encodings(
+    std::vector<Encoding> encodings, bool add_special_tokens) const {
+  if (!add_special_tokens) {
+    return encodings;
+  }
+  for (int i = 0; i < encodings.size(); i++) {
+    wrap_encoding(&encodings[i], i == 0 ? &cls : nullptr, sep, i == 0 ? 0 : 1,
+                  false, nullptr, false);
+  }
+  return encodings;
+}
+
+int BertProcessing::added_tokens(bool is_pair) const {
+  return is_pair ? 3 : 2;
+}
+
+RobertaProcessing::RobertaProcessing(const std::pair<std::string, int>& sep,
+                                     const std::pair<std::string, int>& cls,
+                                     bool trim_offsets, bool add_prefix_space)
+    : sep(sep),
+      cls(cls),
+      trim_offsets(trim_offsets),
+      add_prefix_space(add_prefix_space) {}
+
+void RobertaProcessing::process(Encoding* encoding,
+                                bool add_special_tokens) const {
+  if (add_special_tokens) {
+    wrap_encoding(encoding, &cls, sep, 0, true,
+                  trim_offsets ? &byte_level_spaces : nullptr,
+                  add_prefix_space);
+  } else if (trim_offsets) {
+    trim_byte_level_offsets(byte_level_spaces, encoding, add_prefix_space);
+  }
+}
+
+std::vector<Encoding> RobertaProcessing::process_encodings(
+    std::vector<Encoding> encodings, bool add_special_tokens) const {
+  if (!add_special_tokens) {
+    if (trim_offsets) {
+      for (Encoding& encoding : encodings) {
+        trim_byte_level_offsets(byte_level_spaces, &encoding,
+                                add_prefix_space);
       }
     }
-    new_encoding.tokens[i] = token;
-    new_encoding.offsets[i] = offsets;
+    return encodings;
   }
-  return new_encoding;
+  for (int i = 0; i < encodings.size(); i++) {
+    wrap_encoding(&encodings[i], i == 0 ? &cls : &sep, sep, 0, true,
+                  trim_offsets ? &byte_level_spaces : nullptr,
+                  add_prefix_space);
+  }
+  return encodings;
+}
+
+int RobertaProcessing::added_tokens(bool is_pair) const {
+  return is_pair ? 4 : 2;
+}
+
+void RobertaProcessing::set_vocabulary(
+    const std::vector<std::optional<std::string>>& tokens) {
+  byte_level_spaces = get_byte_level_spaces(tokens);
 }
 
 ByteLevelProcessing::ByteLevelProcessing(bool add_prefix_space,
                                          bool trim_offsets)
-    : add_prefix_space(add_prefix_space),
-      trim_offsets(trim_offsets),
-      BYTES_CHAR(bytes_char()) {}
+    : add_prefix_space(add_prefix_space), trim_offsets(trim_offsets) {}
 
-Encoding ByteLevelProcessing::process(Encoding encoding,
-                                      bool add_special_tokens) const {
+void ByteLevelProcessing::process(Encoding* encoding,
+                                  bool add_special_tokens) const {
   if (trim_offsets) {
-    encoding = process_offsets(encoding, add_prefix_space);
-    for (Encoding& overflowing_encoding : encoding.overflowing) {
-      overflowing_encoding =
-          process_offsets(overflowing_encoding, add_prefix_space);
-    }
+    trim_byte_level_offsets(byte_level_spaces, encoding, add_prefix_space);
   }
-  return encoding;
+}
+
+void ByteLevelProcessing::set_vocabulary(
+    const std::vector<std::optional<std::string>>& tokens) {
+  byte_level_spaces = get_byte_level_spaces(tokens);
 }
 
 SequenceProcessing::SequenceProcessing(
     std::vector<std::unique_ptr<PostProcessor>> processors)
     : processors(std::move(processors)) {}
 
-Encoding SequenceProcessing::process(Encoding encoding,
-                                     bool add_special_tokens) const {
-  encoding = std::accumulate(
-      processors.begin(), processors.end(), encoding,
-      [add_special_tokens](const Encoding& acc,
-                           const std::unique_ptr<PostProcessor>& processor) {
-        return processor->process(acc, add_special_tokens);
-      });
-  return encoding;
+void SequenceProcessing::process(Encoding* encoding,
+                                 bool add_special_tokens) const {
+  for (const std::unique_ptr<PostProcessor>& processor : processors) {
+    processor->process(encoding, add_special_tokens);
+  }
+}
+
+std::vector<Encoding> SequenceProcessing::process_encodings(
+    std::vector<Encoding> encodings, bool add_special_tokens) const {
+  for (const std::unique_ptr<PostProcessor>& processor : processors) {
+    encodings =
+        processor->process_encodings(std::move(encodings), add_special_tokens);
+  }
+  return encodings;
+}
+
+int SequenceProcessing::added_tokens(bool is_pair) const {
+  int count = 0;
+  for (const std::unique_ptr<PostProcessor>& processor : processors) {
+    count += processor->added_tokens(is_pair);
+  }
+  return count;
+}
+
+void SequenceProcessing::set_vocabulary(
+    const std::vector<std::optional<std::string>>& tokens) {
+  for (std::unique_ptr<PostProcessor>& processor : processors) {
+    processor->set_vocabulary(tokens);
+  }
 }
@@ -4,14 +4,17 @@
 #include <unicode/regex.h>
 #include <unicode/uchar.h>
 #include <unicode/unistr.h>
+#include <unicode/utf16.h>
+#include <unicode/utf8.h>
 
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <memory>
-#include <numeric>
 #include <optional>
 #include <regex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -19,6 +22,7 @@
 #include "simdjson.h"
 #include "tokenizers/common.h"
 #include "tokenizers/normalizer.h"
+#include "tokenizers/regex.h"
 
 PRE_TOKENIZER get_pre_tokenizer(std::string type) {
   static const std::unordered_map<std::string, PRE_TOKENIZER> types = {
@@ -41,10 +45,10 @@ PRE_TOKENIZER get_pre_tokenizer(std::string type) {
   return UNKNOWN_PRE_TOKENIZER;
 }
 
-PreTokenizedString::PreTokenizedString(const NormalizedString& normalized)
-    : normalized(normalized),
-      splits({Split(convert_to_string(normalized.normalized),
-                    {0, normalized.normalized.length()})}) {}
+PreTokenizedString::PreTokenizedString(NormalizedString normalized)
+    : normalized(std::move(normalized)),
+      splits({Split(convert_to_string(this->normalized.normalized),
+                    {0, this->normalized.normalized.length()})}) {}
 
 std::unique_ptr<PreTokenizer> with_pre_tokenizer(
     simdjson::ondemand::object pre_tokenizer_params) {
@@ -70,10 +74,20 @@ std::unique_ptr<PreTokenizer> with_pre_tokenizer(
         SequencePreTokenizer(std::move(seq_pre_tokenizers)));
   } else if (get_pre_tokenizer(type) == SPLIT_PRE_TOKENIZER) {
     val = pre_tokenizer_params["pattern"].value();
-    std::string pattern = std::string(
-        val.type() == simdjson::ondemand::json_type::null
-            ? ""
-            : static_cast<std::string_view>(val["Regex"].value().get_string()));
+    std::string pattern;
+    PATTERN_TYPE pattern_type = REGEX_PATTERN_TYPE;
+    if (val.type() != simdjson::ondemand::json_type::null) {
+      simdjson::ondemand::object pattern_params = val.get_object();
+      auto regex_val = pattern_params["Regex"];
+      if (regex_val.error() == simdjson::SUCCESS) {
+        pattern = std::string(
+            static_cast<std::string_view>(regex_val.get_string()));
+      } else {
+        pattern = std::string(static_cast<std::string_view>(
+            pattern_params["String"].get_string()));
+        pattern_type = STRING_PATTERN_TYPE;
+      }
+    }
     val = pre_tokenizer_params["behavior"].value();
     std::string behavior =
         val.type() == simdjson::ondemand::json_type::null
@@ -84,7 +98,7 @@ std::unique_ptr<PreTokenizer> with_pre_tokenizer(
                       ? false
                       : static_cast<bool>(val.get_bool());
     return std::make_unique<SplitPreTokenizer>(
-        SplitPreTokenizer(pattern, behavior, invert));
+        SplitPreTokenizer(pattern, behavior, invert, pattern_type));
   } else if (get_pre_tokenizer(type) == BYTE_LEVEL_PRE_TOKENIZER) {
     val = pre_tokenizer_params["add_prefix_space"].value();
     bool add_prefix_space = val.type() == simdjson::ondemand::json_type::null
@@ -96,48 +110,200 @@ std::unique_ptr<PreTokenizer> with_pre_tokenizer(
                          : static_cast<bool>(val.get_bool());
     return std::make_unique<ByteLevelPreTokenizer>(
         ByteLevelPreTokenizer(add_prefix_space, use_regex));
+  } else if (get_pre_tokenizer(type) == METASPACE_PRE_TOKENIZER) {
+    val = pre_tokenizer_params["replacement"].value();
+    std::string replacement =
+        val.type() == simdjson::ondemand::json_type::null
+            ? "\u2581"
+            : std::string(static_cast<std::string_view>(val.get_string()));
+    std::string prepend_scheme = "always";
+    auto prepend_scheme_val = pre_tokenizer_params["prepend_scheme"];
+    if (prepend_scheme_val.error() == simdjson::SUCCESS) {
+      prepend_scheme = std::string(
+          static_cast<std::string_view>(prepend_scheme_val.get_string()));
+    } else {
+      auto add_prefix_space_val = pre_tokenizer_params["add_prefix_space"];
+      if (add_prefix_space_val.error() == simdjson::SUCCESS &&
+          !static_cast<bool>(add_prefix_space_val.get_bool())) {
+        prepend_scheme = "never";
+      }
+    }
+    bool split = true;
+    auto split_val = pre_tokenizer_params["split"];
+    if (split_val.error() == simdjson::SUCCESS) {
+      split = static_cast<bool>(split_val.get_bool());
+    }
+    return std::make_unique<MetaspacePreTokenizer>(
+        MetaspacePreTokenizer(replacement, prepend_scheme, split));
+  } else if (get_pre_tokenizer(type) == WHITESPACE_PRE_TOKENIZER) {
+    return std::make_unique<WhitespacePreTokenizer>(WhitespacePreTokenizer());
+  } else if (get_pre_tokenizer(type) == WHITESPACE_SPLIT_PRE_TOKENIZER) {
+    return std::make_unique<WhitespaceSplitPreTokenizer>(
+        WhitespaceSplitPreTokenizer());
+  } else if (get_pre_tokenizer(type) == PUNCTUATION_PRE_TOKENIZER) {
+    val = pre_tokenizer_params["behavior"].value();
+    std::string behavior =
+        val.type() == simdjson::ondemand::json_type::null
+            ? "Isolated"
+            : std::string(static_cast<std::string_view>(val.get_string()));
+    return std::make_unique<PunctuationPreTokenizer>(
+        PunctuationPreTokenizer(behavior));
+  } else if (get_pre_tokenizer(type) == DIGITS_PRE_TOKENIZER) {
+    val = pre_tokenizer_params["individual_digits"].value();
+    bool individual_digits = val.type() == simdjson::ondemand::json_type::null
+                                 ? false
+                                 : static_cast<bool>(val.get_bool());
+    return std::make_unique<DigitsPreTokenizer>(
+        DigitsPreTokenizer(individual_digits));
+  } else if (get_pre_tokenizer(type) == CHAR_DELIMITER_SPLIT_PRE_TOKENIZER) {
+    val = pre_tokenizer_params["delimiter"].value();
+    std::string delimiter =
+        val.type() == simdjson::ondemand::json_type::null
+            ? ""
+            : std::string(static_cast<std::string_view>(val.get_string()));
+    return std::make_unique<CharDelimiterSplitPreTokenizer>(
+        CharDelimiterSplitPreTokenizer(delimiter));
+  } else if (get_pre_tokenizer(type) == UNICODE_SCRIPTS_PRE_TOKENIZER) {
+    return std::make_unique<UnicodeScriptsPreTokenizer>(
+        UnicodeScriptsPreTokenizer());
   }
   return nullptr;
 }
 
-std::vector<std::pair<std::pair<int, int>, bool>> find_matches(
-    std::string regex, icu::UnicodeString input) {
-  std::vector<std::pair<int, int>> matches;
-  UErrorCode status = U_ZERO_ERROR;
-  icu::RegexPattern* unicode_pattern = icu::RegexPattern::compile(
-      icu::UnicodeString::fromUTF8(regex), 0, status);
-  icu::RegexMatcher* matcher = unicode_pattern->matcher(input, status);
-  while (matcher->find(status)) {
-    matches.push_back({matcher->start(status), matcher->end(status)});
+class SplitEmitter {
+ public:
+  SplitEmitter(const Split& original_split, SPLIT_DELIMITER_BEHAVIOR behavior,
+               std::vector<Split>* splits)
+      : original_split(original_split),
+        behavior(behavior),
+        splits(splits),
+        has_pending(false),
+        pending_match(false),
+        previous_match(false) {}
+
+  void push(std::pair<int, int> bytes, std::pair<int, int> chars,
+            bool is_match) {
+    if (bytes.first == bytes.second) {
+      return;
+    }
+    if (behavior == REMOVED) {
+      if (!is_match) {
+        emit(bytes, chars);
+      }
+      return;
+    }
+    if (behavior == ISOLATED) {
+      emit(bytes, chars);
+      return;
+    }
+    bool merge = false;
+    if (has_pending) {
+      if (behavior == MERGED_WITH_PREVIOUS) {
+        merge = is_match && !previous_match;
+      } else if (behavior == MERGED_WITH_NEXT) {
+        merge = pending_match && !is_match;
+      } else if (behavior == CONTIGUOUS) {
+        merge = pending_match == is_match;
+      }
+    }
+    if (merge) {
+      pending_bytes.second = bytes.second;
+      pending_chars.second = chars.second;
+      if (behavior == MERGED_WITH_NEXT) {
+        pending_match = false;
+      }
+    } else {
+      finish();
+      has_pending = true;
+      pending_match = is_match;
+      pending_bytes = bytes;
+      pending_chars = chars;
+    }
+    previous_match = is_match;
   }
-  delete matcher;
-  delete unicode_pattern;
 
-  std::vector<std::pair<std::pair<int, int>, bool>> result;
-  int cur = 0;
-  for (auto match : matches) {
-    if (cur != match.first) {
-      result.push_back({{cur, match.first}, false});
+  void finish() {
+    if (has_pending) {
+      emit(pending_bytes, pending_chars);
+      has_pending = false;
     }
-    result.push_back({match, true});
-    cur = match.second;
   }
-  if (cur < input.length()) {
-    result.push_back({{cur, input.length()}, false});
+
+ private:
+  const Split& original_split;
+  SPLIT_DELIMITER_BEHAVIOR behavior;
+  std::vector<Split>* splits;
+  bool has_pending;
+  bool pending_match;
+  bool previous_match;
+  std::pair<int, int> pending_bytes;
+  std::pair<int, int> pending_chars;
+
+  void emit(std::pair<int, int> bytes, std::pair<int, int> chars) {
+    splits->push_back(Split(
+        original_split.normalized.substr(bytes.first,
+                                         bytes.second - bytes.first),
+        {original_split.offsets.first + chars.first,
+         original_split.offsets.first + chars.second}));
+  }
+};
+
+int utf16_length(const char* data, int start, int end) {
+  int length = 0;
+  for (int i = start; i < end; i++) {
+    uint8_t b = static_cast<uint8_t>(data[i]);
+    if ((b & 0xC0) != 0x80) {
+      length += b >= 0xF0 ? 2 : 1;
+    }
   }
-  return result;
+  return length;
 }
 
-std::vector<std::pair<std::pair<int, int>, bool>> is_whitespace(
-    icu::UnicodeString input) {
-  std::string pattern = "\\s+";
-  return find_matches(pattern, input);
+void split_class_runs(const Split& original_split, uint8_t char_class,
+                      SPLIT_DELIMITER_BEHAVIOR behavior,
+                      std::vector<Split>* splits) {
+  SplitEmitter emitter(original_split, behavior, splits);
+  const uint8_t* data =
+      reinterpret_cast<const uint8_t*>(original_split.normalized.data());
+  int length = original_split.normalized.length();
+  int byte_start = 0, char_start = 0, char_idx = 0;
+  int i = 0;
+  while (i < length) {
+    int byte_idx = i;
+    UChar32 c;
+    U8_NEXT(data, i, length, c);
+    int units = c < 0 ? 1 : U16_LENGTH(c);
+    if (c >= 0 && (get_char_class(c) & char_class) != 0) {
+      emitter.push({byte_start, byte_idx}, {char_start, char_idx}, false);
+      emitter.push({byte_idx, i}, {char_idx, char_idx + units}, true);
+      byte_start = i;
+      char_start = char_idx + units;
+    }
+    char_idx += units;
+  }
+  emitter.push({byte_start, length}, {char_start, char_idx}, false);
+  emitter.finish();
 }
 
-std::vector<std::pair<std::pair<int, int>, bool>> is_bert_punc(
-    icu::UnicodeString input) {
-  std::string pattern = "\\p{P}";
-  return find_matches(pattern, input);
+void split_match_runs(const Split& original_split,
+                      const std::vector<std::pair<int, int>>& matches,
+                      SPLIT_DELIMITER_BEHAVIOR behavior, bool invert,
+                      std::vector<Split>* splits) {
+  SplitEmitter emitter(original_split, behavior, splits);
+  const char* data = original_split.normalized.data();
+  int byte_start = 0, char_start = 0;
+  for (auto match : matches) {
+    int char_idx = char_start + utf16_length(data, byte_start, match.first);
+    int char_end = char_idx + utf16_length(data, match.first, match.second);
+    emitter.push({byte_start, match.first}, {char_start, char_idx}, invert);
+    emitter.push(match, {char_idx, char_end}, !invert);
+    byte_start = match.second;
+    char_start = char_end;
+  }
+  int length = original_split.normalized.length();
+  int char_end = char_start + utf16_length(data, byte_start, length);
+  emitter.push({byte_start, length}, {char_start, char_end}, invert);
+  emitter.finish();
 }
 
 std::vector<Split> split_normalized(
@@ -151,27 +317,18 @@ std::vector<Split> split_normalized(
       icu::UnicodeString::fromUTF8(original_split.normalized);
   std::vector<std::pair<std::pair<int, int>, bool>> matches =
       split_fn(unicode_normalized);
-  switch (pattern) {
-    case REMOVED:
-      break;
-    case ISOLATED:
-      for (auto& match : matches) {
-        match.second = false;
-      }
-      break;
-  }
+  SplitEmitter emitter(original_split, pattern, &new_splits);
+  int byte_idx = 0;
   for (auto match : matches) {
-    if (!match.second) {
-      std::string split_unicode_normalized;
-      unicode_normalized
-          .tempSubStringBetween(match.first.first, match.first.second)
-          .toUTF8String(split_unicode_normalized);
-      new_splits.push_back(
-          Split(split_unicode_normalized,
-                {match.first.first + original_split.offsets.first,
-                 match.first.second + original_split.offsets.first}));
+    int byte_len = 0;
+    for (int i = match.first.first; i < match.first.second; i++) {
+      UChar c = unicode_normalized.charAt(i);
+      byte_len += c < 0x80 ? 1 : (c < 0x800 || U16_IS_SURROGATE(c) ? 2 : 3);
     }
+    emitter.push({byte_idx, byte_idx + byte_len}, match.first, match.second);
+    byte_idx += byte_len;
   }
+  emitter.finish();
   return new_splits;
 }
 
@@ -181,26 +338,90 @@ void PreTokenizedString::split(
         split_fn,
     SPLIT_DELIMITER_BEHAVIOR pattern) {
   std::vector<Split> new_splits;
-  for (auto orig_split : splits) {
+  for (Split& orig_split : splits) {
     if (orig_split.tokens.size() != 0) {
-      new_splits.push_back(orig_split);
+      new_splits.push_back(std::move(orig_split));
       continue;
     }
 
     std::vector<Split> new_normalized_splits =
         split_normalized(orig_split, split_fn, pattern);
-    new_splits.insert(new_splits.end(), new_normalized_splits.begin(),
-                      new_normalized_splits.end());
+    new_splits.insert(new_splits.end(),
+                      std::make_move_iterator(new_normalized_splits.begin()),
+                      std::make_move_iterator(new_normalized_splits.end()));
+  }
+  splits = std::move(new_splits);
+}
+
+void PreTokenizedString::split_on_class(uint8_t char_class,
+                                        SPLIT_DELIMITER_BEHAVIOR behavior) {
+  std::vector<Split> new_splits;
+  new_splits.reserve(splits.size());
+  for (Split& orig_split : splits) {
+    if (orig_split.tokens.size() != 0) {
+      new_splits.push_back(std::move(orig_split));
+      continue;
+    }
+    split_class_runs(orig_split, char_class, behavior, &new_splits);
   }
-  splits = new_splits;
+  splits = std::move(new_splits);
+}
+
+void PreTokenizedString::split_on_char(UChar32 delimiter,
+                                       SPLIT_DELIMITER_BEHAVIOR behavior) {
+  char encoded[U8_MAX_LENGTH];
+  int encoded_len = 0;
+  U8_APPEND_UNSAFE(encoded, encoded_len, delimiter);
+  split_on_string(std::string(encoded, encoded_len), behavior);
+}
+
+void PreTokenizedString::split_on_string(const std::string& literal,
+                                         SPLIT_DELIMITER_BEHAVIOR behavior,
+                                         bool invert) {
+  std::vector<Split> new_splits;
+  new_splits.reserve(splits.size());
+  for (Split& orig_split : splits) {
+    if (orig_split.tokens.size() != 0) {
+      new_splits.push_back(std::move(orig_split));
+      continue;
+    }
+    std::vector<std::pair<int, int>> matches;
+    std::string_view input = orig_split.normalized;
+    size_t found = find_literal(input, std::string_view(literal));
+    while (found != std::string_view::npos) {
+      matches.push_back({found, found + literal.length()});
+      found = find_literal(input, std::string_view(literal),
+                           found + literal.length());
+    }
+    split_match_runs(orig_split, matches, behavior, invert, &new_splits);
+  }
+  splits = std::move(new_splits);
+}
+
+void PreTokenizedString::split_on_regex(const Regex& regex,
+                                        SPLIT_DELIMITER_BEHAVIOR behavior,
+                                        bool invert) {
+  std::vector<Split> new_splits;
+  new_splits.reserve(splits.size());
+  for (Split& orig_split : splits) {
+    if (orig_split.tokens.size() != 0) {
+      new_splits.push_back(std::move(orig_split));
+      continue;
+    }
+    split_match_runs(orig_split, regex.find_matches(orig_split.normalized),
+                     behavior, invert, &new_splits);
+  }
+  splits = std::move(new_splits);
 }
 
 BertPreTokenizer::BertPreTokenizer() {}
 
 PreTokenizedString BertPreTokenizer::pre_tokenize(
     PreTokenizedString pre_tokenized) const {
-  pre_tokenized.split(is_whitespace, SPLIT_DELIMITER_BEHAVIOR::REMOVED);
-  pre_tokenized.split(is_bert_punc, SPLIT_DELIMITER_BEHAVIOR::ISOLATED);
+  pre_tokenized.split_on_class(WHITESPACE_CHAR_CLASS,
+                               SPLIT_DELIMITER_BEHAVIOR::REMOVED);
+  pre_tokenized.split_on_class(PUNCTUATION_CHAR_CLASS,
+                               SPLIT_DELIMITER_BEHAVIOR::ISOLATED);
   return pre_tokenized;
 }
 
@@ -210,29 +431,205 @@ SequencePreTokenizer::SequencePreTokenizer(
 
 PreTokenizedString SequencePreTokenizer::pre_tokenize(
     PreTokenizedString pre_tokenized) const {
-  pre_tokenized =
-      std::accumulate(pretokenizers.begin(), pretokenizers.end(), pre_tokenized,
-                      [](const PreTokenizedString& pre_tokenized,
-                         const std::unique_ptr<PreTokenizer>& pre_tokenizer) {
-                        return pre_tokenizer->pre_tokenize(pre_tokenized);
-                      });
+  for (const std::unique_ptr<PreTokenizer>& pre_tokenizer : pretokenizers) {
+    pre_tokenized = pre_tokenizer->pre_tokenize(std::move(pre_tokenized));
+  }
   return pre_tokenized;
 }
 
 SplitPreTokenizer::SplitPreTokenizer(const std::string& pattern,
-                                     const std::string& behavior, bool invert)
+                                     const std::string& behavior, bool invert,
+                                     PATTERN_TYPE pattern_type)
     : pattern(pattern),
+      pattern_type(pattern_type),
       behavior(get_split_delimiter_behavior(behavior)),
-      invert(invert) {}
+      invert(invert) {
+  if (pattern_type == REGEX_PATTERN_TYPE) {
+    regex = Regex(pattern);
+  }
+}
 
 PreTokenizedString SplitPreTokenizer::pre_tokenize(
     PreTokenizedString pre_tokenized) const {
-  auto matches_regex = [this](icu::UnicodeString input)
-      -> std::vector<std::pair<std::pair<int, int>, bool>> {
-    return find_matches(pattern, input);
-  };
+  if (pattern_type == STRING_PATTERN_TYPE) {
+    pre_tokenized.split_on_string(pattern, behavior, invert);
+  } else {
+    pre_tokenized.split_on_regex(regex, behavior, invert);
+  }
+  return pre_tokenized;
+}
+
+WhitespacePreTokenizer::WhitespacePreTokenizer() {}
+
+PreTokenizedString WhitespacePreTokenizer::pre_tokenize(
+    PreTokenizedString pre_tokenized) const {
+  pre_tokenized.split_on_class(WHITESPACE_CHAR_CLASS,
+                               SPLIT_DELIMITER_BEHAVIOR::REMOVED);
+  pre_tokenized.split_on_class(WORD_CHAR_CLASS,
+                               SPLIT_DELIMITER_BEHAVIOR::CONTIGUOUS);
+  return pre_tokenized;
+}
 
-  pre_tokenized.split(matches_regex, behavior);
+WhitespaceSplitPreTokenizer::WhitespaceSplitPreTokenizer() {}
+
+PreTokenizedString WhitespaceSplitPreTokenizer::pre_tokenize(
+    PreTokenizedString pre_tokenized) const {
+  pre_tokenized.split_on_class(WHITESPACE_CHAR_CLASS,
+                               SPLIT_DELIMITER_BEHAVIOR::REMOVED);
+  return pre_tokenized;
+}
+
+PunctuationPreTokenizer::PunctuationPreTokenizer(const std::string& behavior)
+    : behavior(get_split_delimiter_behavior(behavior)) {}
+
+PreTokenizedString PunctuationPreTokenizer::pre_tokenize(
+    PreTokenizedString pre_tokenized) const {
+  pre_tokenized.split_on_class(PUNCTUATION_CHAR_CLASS, behavior);
+  return pre_tokenized;
+}
+
+DigitsPreTokenizer::DigitsPreTokenizer(bool individual_digits)
+    : individual_digits(individual_digits) {}
+
+PreTokenizedString DigitsPreTokenizer::pre_tokenize(
+    PreTokenizedString pre_tokenized) const {
+  pre_tokenized.split_on_class(NUMERIC_CHAR_CLASS,
+                               individual_digits
+                                   ? SPLIT_DELIMITER_BEHAVIOR::ISOLATED
+                                   : SPLIT_DELIMITER_BEHAVIOR::CONTIGUOUS);
+  return pre_tokenized;
+}
+
+CharDelimiterSplitPreTokenizer::CharDelimiterSplitPreTokenizer(
+    const std::string& delimiter)
+    : delimiter(' ') {
+  if (delimiter.length() != 0) {
+    int i = 0;
+    U8_NEXT(delimiter.data(), i, static_cast<int>(delimiter.length()),
+            this->delimiter);
+  }
+}
+
+PreTokenizedString CharDelimiterSplitPreTokenizer::pre_tokenize(
+    PreTokenizedString pre_tokenized) const {
+  pre_tokenized.split_on_char(delimiter, SPLIT_DELIMITER_BEHAVIOR::REMOVED);
+  return pre_tokenized;
+}
+
+UnicodeScriptsPreTokenizer::UnicodeScriptsPreTokenizer() {}
+
+PreTokenizedString UnicodeScriptsPreTokenizer::pre_tokenize(
+    PreTokenizedString pre_tokenized) const {
+  std::vector<Split> new_splits;
+  new_splits.reserve(pre_tokenized.splits.size());
+  for (Split& orig_split : pre_tokenized.splits) {
+    if (orig_split.tokens.size() != 0) {
+      new_splits.push_back(std::move(orig_split));
+      continue;
+    }
+    SplitEmitter emitter(orig_split, SPLIT_DELIMITER_BEHAVIOR::ISOLATED,
+                         &new_splits);
+    const uint8_t* data =
+        reinterpret_cast<const uint8_t*>(orig_split.normalized.data());
+    int length = orig_split.normalized.length();
+    int last_script = -1;
+    int byte_start = -1, char_start = 0, char_idx = 0;
+    int i = 0;
+    while (i < length) {
+      int byte_idx = i;
+      UChar32 c;
+      U8_NEXT(data, i, length, c);
+      int script = get_char_script(c);
+      if (script != ANY_SCRIPT && script != last_script) {
+        if (byte_start >= 0) {
+          emitter.push({byte_start, byte_idx}, {char_start, char_idx}, false);
+        }
+        byte_start = byte_idx;
+        char_start = char_idx;
+        last_script = script;
+      }
+      char_idx += c < 0 ? 1 : U16_LENGTH(c);
+    }
+    if (byte_start >= 0) {
+      emitter.push({byte_start, length}, {char_start, char_idx}, false);
+    }
+  }
+  pre_tokenized.splits = std::move(new_splits);
+  return pre_tokenized;
+}
+
+MetaspacePreTokenizer::MetaspacePreTokenizer(const std::string& replacement,
+                                             const std::string& prepend_scheme,
+                                             bool split)
+    : replacement(replacement),
+      prepend_scheme(get_prepend_scheme(prepend_scheme)),
+      split(split) {}
+
+PreTokenizedString MetaspacePreTokenizer::pre_tokenize(
+    PreTokenizedString pre_tokenized) const {
+  if (replacement.length() == 0) {
+    return pre_tokenized;
+  }
+  int replacement_len = replacement.length();
+  int replacement_units = utf16_length(replacement.data(), 0, replacement_len);
+  std::vector<Split> new_splits;
+  new_splits.reserve(pre_tokenized.splits.size());
+  int shift = 0;
+  for (Split& orig_split : pre_tokenized.splits) {
+    orig_split.offsets.first += shift;
+    orig_split.offsets.second += shift;
+    if (orig_split.tokens.size() != 0) {
+      new_splits.push_back(std::move(orig_split));
+      continue;
+    }
+    const std::string& input = orig_split.normalized;
+    int length = input.length();
+    int char_idx = orig_split.offsets.first;
+    int piece_start = char_idx;
+    std::string piece;
+    piece.reserve(length + replacement_len);
+    bool prepend =
+        length != 0 && input[0] != ' ' &&
+        input.compare(0, replacement_len, replacement) != 0 &&
+        (prepend_scheme == ALWAYS_PREPEND_SCHEME ||
+         (prepend_scheme == FIRST_PREPEND_SCHEME && char_idx == 0)) &&
+        char_idx < (pre_tokenized.normalized.track_offsets
+                        ? pre_tokenized.normalized.offset_ranges.size()
+                        : pre_tokenized.normalized.normalized.length());
+    if (prepend) {
+      pre_tokenized.normalized.normalized.insert(
+          char_idx, convert_from_string(replacement));
+      pre_tokenized.normalized.transform(char_idx, "add", replacement_len);
+      piece.append(replacement);
+      char_idx += replacement_units;
+      shift += replacement_units;
+    }
+    int i = 0;
+    while (i < length) {
+      bool is_space = input[i] == ' ';
+      if (is_space || input.compare(i, replacement_len, replacement) == 0) {
+        if (split && piece.length() != 0) {
+          new_splits.push_back(Split(piece, {piece_start, char_idx}));
+          piece.clear();
+          piece_start = char_idx;
+        }
+        piece.append(replacement);
+        i += is_space ? 1 : replacement_len;
+        char_idx += is_space ? 1 : replacement_units;
+        continue;
+      }
+      int run_start = i;
+      do {
+        i++;
+      } while (i < length && input[i] != ' ' && input[i] != replacement[0]);
+      piece.append(input, run_start, i - run_start);
+      char_idx += utf16_length(input.data(), run_start, i);
+    }
+    if (piece.length() != 0) {
+      new_splits.push_back(Split(piece, {piece_start, char_idx}));
+    }
+  }
+  pre_tokenized.splits = std::move(new_splits);
   return pre_tokenized;
 }
 
@@ -240,34 +637,31 @@ ByteLevelPreTokenizer::ByteLevelPreTokenizer(bool add_prefix_space,
                                              bool use_regex)
     : add_prefix_space(add_prefix_space),
       use_regex(use_regex),
-      regex(
-          R"('s|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+)",
-          std::regex_constants::optimize),
-      BYTES_CHAR(bytes_char()) {}
+      BYTES_CHAR(bytes_char()) {
+  if (use_regex) {
+    regex = Regex(
+        R"('s|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+)");
+  }
+}
 
 PreTokenizedString ByteLevelPreTokenizer::pre_tokenize(
     PreTokenizedString pre_tokenized) const {
   if (add_prefix_space &&
       !std::iswspace(pre_tokenized.normalized.normalized.at(0))) {
-    pre_tokenized.normalized.normalized =
-        std::wstring(L" ") + pre_tokenized.normalized.normalized;
+    pre_tokenized.normalized.normalized.insert(0, 1, L' ');
     pre_tokenized.normalized.transform(0, "add", std::wstring(L" ").length());
-    pre_tokenized = PreTokenizedString(pre_tokenized.normalized);
+    pre_tokenized = PreTokenizedString(std::move(pre_tokenized.normalized));
+  }
+  if (use_regex) {
+    pre_tokenized.split_on_regex(regex, SPLIT_DELIMITER_BEHAVIOR::ISOLATED);
   }
-  auto matches_regex = [this](icu::UnicodeString input)
-      -> std::vector<std::pair<std::pair<int, int>, bool>> {
-    if (use_regex) {
-      return find_matches(regex, input);
-    }
-    return {{{0, input.length()}, false}};
-  };
-  pre_tokenized.split(matches_regex, SPLIT_DELIMITER_BEHAVIOR::ISOLATED);
   for (Split& split : pre_tokenized.splits) {
     std::string new_split_normalized;
+    new_split_normalized.reserve(split.normalized.length() * 2);
     for (const char c : split.normalized) {
-      new_split_normalized += BYTES_CHAR.at(static_cast<int>(c));
+      new_split_normalized += BYTES_CHAR.at(static_cast<uint8_t>(c));
     }
-    split.normalized = new_split_normalized;
+    split.normalized = std::move(new_split_normalized);
   }
   return pre_tokenized;
 }
@@ -0,0 +1,885 @@
+// Copyright 2024 Omkar Prabhu
+#include "tokenizers/regex.h"
+
+#include <unicode/regex.h>
+#include <unicode/uniset.h>
+#include <unicode/unistr.h>
+#include <unicode/utext.h>
+#include <unicode/utf8.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+const int MAX_REGEX_REPEAT = 1000;
+const int MAX_REGEX_PROGRAM = 10000;
+const int MAX_REGEX_STATES = 4096;
+
+enum REGEX_NODE {
+  SET_REGEX_NODE,
+  CONCAT_REGEX_NODE,
+  ALTERNATE_REGEX_NODE,
+  REPEAT_REGEX_NODE,
+  LOOKAHEAD_REGEX_NODE
+};
+
+class RegexNode {
+ public:
+  REGEX_NODE type;
+  int set;
+  int min;
+  int max;
+  bool greedy;
+  bool eof_ok;
+  std::vector<RegexNode> children;
+  explicit RegexNode(REGEX_NODE type)
+      : type(type), set(-1), min(0), max(0), greedy(true), eof_ok(false) {}
+};
+
+icu::UnicodeSet unicode_set(const char* pattern) {
+  UErrorCode status = U_ZERO_ERROR;
+  icu::UnicodeSet set(icu::UnicodeString::fromUTF8(pattern), status);
+  if (U_FAILURE(status)) {
+    throw std::invalid_argument(pattern);
+  }
+  return set;
+}
+
+class RegexParser {
+ public:
+  RegexParser(const std::string& pattern, std::vector<icu::UnicodeSet>* sets)
+      : sets(sets), pos(0), depth(0) {
+    int i = 0, length = pattern.length();
+    while (i < length) {
+      UChar32 c;
+      U8_NEXT(pattern.data(), i, length, c);
+      if (c < 0) {
+        unsupported();
+      }
+      chars.push_back(c);
+    }
+  }
+
+  RegexNode parse() {
+    RegexNode node = parse_alternation(false);
+    if (!at_end()) {
+      unsupported();
+    }
+    return node;
+  }
+
+ private:
+  std::vector<UChar32> chars;
+  std::vector<icu::UnicodeSet>* sets;
+  size_t pos;
+  int depth;
+
+  static void unsupported() {
+    throw std::invalid_argument("unsupported regex construct");
+  }
+
+  bool at_end() const { return pos >= chars.size(); }
+
+  UChar32 peek() const { return at_end() ? -1 : chars[pos]; }
+
+  bool consume(UChar32 c) {
+    if (peek() == c) {
+      pos++;
+      return true;
+    }
+    return false;
+  }
+
+  RegexNode set_node(icu::UnicodeSet set, bool icase) {
+    if (icase) {
+      set.closeOver(USET_CASE_INSENSITIVE);
+    }
+    sets->push_back(set);
+    RegexNode node(SET_REGEX_NODE);
+    node.set = sets->size() - 1;
+    return node;
+  }
+
+  RegexNode parse_alternation(bool icase) {
+    RegexNode node(ALTERNATE_REGEX_NODE);
+    node.children.push_back(parse_concat(icase));
+    while (consume('|')) {
+      node.children.push_back(parse_concat(icase));
+    }
+    return node.children.size() == 1 ? node.children[0] : node;
+  }
+
+  RegexNode parse_concat(bool icase) {
+    RegexNode node(CONCAT_REGEX_NODE);
+    while (!at_end() && peek() != '|' && peek() != ')') {
+      RegexNode atom = parse_atom(icase);
+      if (atom.type == LOOKAHEAD_REGEX_NODE) {
+        if (depth != 0 || (!at_end() && peek() != '|')) {
+          unsupported();
+        }
+        node.children.push_back(atom);
+      } else {
+        node.children.push_back(parse_quantifier(atom));
+      }
+    }
+    return node.children.size() == 1 ? node.children[0] : node;
+  }
+
+  int parse_number() {
+    int result = 0;
+    bool found = false;
+    while (peek() >= '0' && peek() <= '9') {
+      result = result * 10 + (chars[pos++] - '0');
+      if (result > MAX_REGEX_REPEAT) {
+        unsupported();
+      }
+      found = true;
+    }
+    if (!found) {
+      unsupported();
+    }
+    return result;
+  }
+
+  RegexNode parse_quantifier(const RegexNode& atom) {
+    RegexNode node(REPEAT_REGEX_NODE);
+    if (consume('*')) {
+      node.min = 0;
+      node.max = -1;
+    } else if (consume('+')) {
+      node.min = 1;
+      node.max = -1;
+    } else if (consume('?')) {
+      node.min = 0;
+      node.max = 1;
+    } else if (consume('{')) {
+      node.min = parse_number();
+      node.max = node.min;
+      if (consume(',')) {
+        node.max = peek() == '}' ? -1 : parse_number();
+      }
+      if (!consume('}') || (node.max != -1 && node.max < node.min)) {
+        unsupported();
+      }
+    } else {
+      return atom;
+    }
+    if (consume('?')) {
+      node.greedy = false;
+    }
+    UChar32 c = peek();
+    if (c == '*' || c == '+' || c == '?' || c == '{') {
+      unsupported();
+    }
+    node.children.push_back(atom);
+    return node;
+  }
+
+  RegexNode parse_atom(bool icase) {
+    UChar32 c = chars[pos++];
+    if (c == '(') {
+      return parse_group(icase);
+    } else if (c == '[') {
+      return set_node(parse_bracket(icase), false);
+    } else if (c == '.') {
+      return set_node(
+          unicode_set("[^\\n\\u000b\\f\\r\\u0085\\u2028\\u2029]"), icase);
+    } else if (c == '\\') {
+      UChar32 single;
+      return set_node(parse_escape(&single), icase);
+    } else if (c == '^' || c == '$' || c == '*' || c == '+' || c == '?' ||
+               c == '{' || c == ')') {
+      unsupported();
+    }
+    return set_node(icu::UnicodeSet(c, c), icase);
+  }
+
+  RegexNode parse_group(bool icase) {
+    bool lookahead = false, negated = false;
+    if (consume('?')) {
+      if (consume('=')) {
+        lookahead = true;
+      } else if (consume('!')) {
+        lookahead = negated = true;
+      } else if (consume('i')) {
+        icase = true;
+        if (!consume(':')) {
+          unsupported();
+        }
+      } else if (!consume(':')) {
+        unsupported();
+      }
+    }
+    depth++;
+    RegexNode node = parse_alternation(icase);
+    depth--;
+    if (!consume(')')) {
+      unsupported();
+    }
+    if (!lookahead) {
+      return node;
+    }
+    if (node.type != SET_REGEX_NODE) {
+      unsupported();
+    }
+    icu::UnicodeSet set = (*sets)[node.set];
+    if (negated) {
+      set.complement();
+    }
+    RegexNode result = set_node(set, false);
+    result.type = LOOKAHEAD_REGEX_NODE;
+    result.eof_ok = negated;
+    return result;
+  }
+
+  UChar32 parse_hex(int digits) {
+    UChar32 result = 0;
+    for (int i = 0; i < digits || (digits < 0 && peek() != '}'); i++) {
+      UChar32 c = peek();
+      int value = c >= '0' && c <= '9'   ? c - '0'
+                  : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                  : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                         : -1;
+      if (value < 0 || result > 0x10FFFF) {
+        unsupported();
+      }
+      result = result * 16 + value;
+      pos++;
+    }
+    if (result > 0x10FFFF) {
+      unsupported();
+    }
+    return result;
+  }
+
+  icu::UnicodeSet parse_escape(UChar32* single) {
+    if (at_end()) {
+      unsupported();
+    }
+    UChar32 c = chars[pos++];
+    *single = -1;
+    icu::UnicodeSet set;
+    switch (c) {
+      case 's':
+      case 'S':
+        set = unicode_set("[\\t\\n\\f\\r\\p{Z}]");
+        break;
+      case 'd':
+      case 'D':
+        set = unicode_set("[\\p{Nd}]");
+        break;
+      case 'w':
+      case 'W':
+        set = unicode_set(
+            "[\\p{Alphabetic}\\p{Mark}\\p{Decimal_Number}"
+            "\\p{Connector_Punctuation}\\u200c\\u200d]");
+        break;
+      case 'p':
+      case 'P': {
+        std::string name;
+        if (consume('{')) {
+          while (!at_end() && peek() != '}') {
+            name += static_cast<char>(chars[pos++]);
+          }
+          if (!consume('}')) {
+            unsupported();
+          }
+        } else if (!at_end()) {
+          name = static_cast<char>(chars[pos++]);
+        }
+        set = unicode_set(("[\\p{" + name + "}]").c_str());
+        break;
+      }
+      case 'n':
+        *single = '\n';
+        break;
+      case 'r':
+        *single = '\r';
+        break;
+      case 't':
+        *single = '\t';
+        break;
+      case 'f':
+        *single = '\f';
+        break;
+      case 'a':
+        *single = 0x07;
+        break;
+      case 'e':
+        *single = 0x1B;
+        break;
+      case 'u':
+        *single = parse_hex(4);
+        break;
+      case 'x':
+        if (consume('{')) {
+          *single = parse_hex(-1);
+          consume('}');
+        } else {
+          *single = parse_hex(2);
+        }
+        break;
+      default:
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+            (c >= 'A' && c <= 'Z')) {
+          unsupported();
+        }
+        *single = c;
+    }
+    if (*single >= 0) {
+      return icu::UnicodeSet(*single, *single);
+    }
+    if (c == 'S' || c == 'D' || c == 'W' || c == 'P') {
+      set.complement();
+    }
+    return set;
+  }
+
+  icu::UnicodeSet parse_bracket(bool icase) {
+    icu::UnicodeSet set;
+    bool negated = consume('^');
+    bool first = true;
+    while (true) {
+      if (at_end()) {
+        unsupported();
+      }
+      UChar32 c = chars[pos++];
+      if (c == ']') {
+        if (first) {
+          unsupported();
+        }
+        break;
+      }
+      first = false;
+      if (c == '[' || (c == '&' && peek() == '&') ||
+          (c == '-' && peek() == '-')) {
+        unsupported();
+      }
+      UChar32 low = c;
+      if (c == '\\') {
+        icu::UnicodeSet item = parse_escape(&low);
+        if (low < 0) {
+          set.addAll(item);
+          continue;
+        }
+      }
+      if (peek() == '-' && pos + 1 < chars.size() && chars[pos + 1] != ']') {
+        pos++;
+        UChar32 high = chars[pos++];
+        if (high == '\\') {
+          parse_escape(&high);
+        } else if (high == '[') {
+          unsupported();
+        }
+        if (high < low) {
+          unsupported();
+        }
+        set.add(low, high);
+      } else {
+        set.add(low);
+      }
+    }
+    if (icase) {
+      set.closeOver(USET_CASE_INSENSITIVE);
+    }
+    if (negated) {
+      set.complement();
+    }
+    return set;
+  }
+};
+
+enum REGEX_OP {
+  SET_REGEX_OP,
+  SPLIT_REGEX_OP,
+  LOOK_REGEX_OP,
+  MATCH_REGEX_OP,
+  MATCH_PREVIOUS_REGEX_OP
+};
+
+class RegexInstruction {
+ public:
+  REGEX_OP op;
+  int set;
+  int x;
+  int y;
+  bool eof_ok;
+};
+
+// Program of a pattern, or of the pattern read backwards when reverse. A
+// reversed program starts with the lookaheads, tested against the character
+// after the match, and keeps every thread past a match.
+class RegexProgram {
+ public:
+  std::vector<RegexInstruction> instructions;
+  int match;
+  int match_previous;
+  int start;
+
+  explicit RegexProgram(const RegexNode& root, bool reverse = false)
+      : reverse(reverse) {
+    match = emit({MATCH_REGEX_OP, -1, -1, -1, false});
+    match_previous = emit({MATCH_PREVIOUS_REGEX_OP, -1, -1, -1, false});
+    start = compile(root, match);
+  }
+
+  // Threads reachable from the seeds in priority order, dropping everything
+  // of lower priority than the first match.
+  std::vector<int> closure(const std::vector<int>& seeds) const {
+    std::vector<int> threads;
+    std::vector<bool> visited(instructions.size());
+    bool matched = false;
+    for (int pc : seeds) {
+      add_thread(pc, &visited, &threads, &matched);
+    }
+    return threads;
+  }
+
+ private:
+  bool reverse;
+
+  int emit(RegexInstruction instruction) {
+    if (instructions.size() >= MAX_REGEX_PROGRAM) {
+      throw std::invalid_argument("regex program too large");
+    }
+    instructions.push_back(instruction);
+    return instructions.size() - 1;
+  }
+
+  int compile(const RegexNode& node, int next) {
+    if (node.type == SET_REGEX_NODE) {
+      return emit({SET_REGEX_OP, node.set, next, -1, false});
+    } else if (node.type == LOOKAHEAD_REGEX_NODE) {
+      return emit({LOOK_REGEX_OP, node.set, reverse ? next : match_previous,
+                    -1, node.eof_ok});
+    } else if (node.type == CONCAT_REGEX_NODE) {
+      if (reverse) {
+        for (const RegexNode& child : node.children) {
+          next = compile(child, next);
+        }
+        return next;
+      }
+      for (auto it = node.children.rbegin(); it != node.children.rend(); ++it) {
+        next = compile(*it, next);
+      }
+      return next;
+    } else if (node.type == ALTERNATE_REGEX_NODE) {
+      std::vector<int> entries;
+      for (const RegexNode& child : node.children) {
+        entries.push_back(compile(child, next));
+      }
+      int entry = entries.back();
+      for (int i = entries.size() - 2; i >= 0; i--) {
+        entry = emit({SPLIT_REGEX_OP, -1, entries[i], entry, false});
+      }
+      return entry;
+    }
+    const RegexNode& child = node.children[0];
+    int entry = next;
+    if (node.max == -1) {
+      entry = emit({SPLIT_REGEX_OP, -1, -1, -1, false});
+      int body = compile(child, entry);
+      instructions[entry].x = node.greedy ? body : next;
+      instructions[entry].y = node.greedy ? next : body;
+    } else {
+      for (int i = node.min; i < node.max; i++) {
+        int body = compile(child, entry);
+        entry = node.greedy ? emit({SPLIT_REGEX_OP, -1, body, next, false})
+                            : emit({SPLIT_REGEX_OP, -1, next, body, false});
+      }
+    }
+    for (int i = 0; i < node.min; i++) {
+      entry = compile(child, entry);
+    }
+    return entry;
+  }
+
+  void add_thread(int pc, std::vector<bool>* visited, std::vector<int>* threads,
+                  bool* matched) const {
+    if (*matched || (*visited)[pc]) {
+      return;
+    }
+    (*visited)[pc] = true;
+    const RegexInstruction& instruction = instructions[pc];
+    if (instruction.op == SPLIT_REGEX_OP) {
+      add_thread(instruction.x, visited, threads, matched);
+      add_thread(instruction.y, visited, threads, matched);
+      return;
+    }
+    threads->push_back(pc);
+    if (!reverse && (instruction.op == MATCH_REGEX_OP ||
+                     instruction.op == MATCH_PREVIOUS_REGEX_OP)) {
+      *matched = true;
+    }
+  }
+};
+
+// Interns thread lists as DFA states, failing past MAX_REGEX_STATES.
+class RegexStates {
+ public:
+  std::vector<std::vector<int>> states;
+
+  int intern(const std::vector<int>& threads) {
+    auto it = state_ids.find(threads);
+    if (it != state_ids.end()) {
+      return it->second;
+    }
+    if (states.size() >= MAX_REGEX_STATES) {
+      throw std::invalid_argument("regex automaton too large");
+    }
+    state_ids[threads] = states.size();
+    states.push_back(threads);
+    return states.size() - 1;
+  }
+
+ private:
+  std::map<std::vector<int>, int> state_ids;
+};
+
+// Leftmost-first DFA of program, state 0 dead and state 1 the start. An
+// unanchored DFA starts the program again before every character, below the
+// threads already running, until one of them matches; its states mark a
+// found match with a trailing -1, state 1 having no threads.
+void determinize(const RegexProgram& program,
+                 const std::vector<std::vector<bool>>& set_classes,
+                 int num_classes, bool unanchored,
+                 std::vector<int>* transitions,
+                 std::vector<uint8_t>* accepts,
+                 std::vector<uint8_t>* eof_accepts) {
+  std::vector<int> start_threads = program.closure({program.start});
+  RegexStates dfa;
+  if (unanchored) {
+    dfa.intern({-1});
+    dfa.intern({});
+  } else {
+    dfa.intern({});
+    dfa.intern(start_threads);
+  }
+  for (size_t state = 0; state < dfa.states.size(); state++) {
+    std::vector<int> threads = dfa.states[state];
+    bool found = !threads.empty() && threads.back() == -1;
+    if (found) {
+      threads.pop_back();
+    }
+    uint8_t accept = NO_REGEX_ACCEPT, eof_accept = NO_REGEX_ACCEPT;
+    for (int pc : threads) {
+      const RegexInstruction& instruction = program.instructions[pc];
+      if (instruction.op == MATCH_REGEX_OP) {
+        accept = CURRENT_REGEX_ACCEPT;
+      } else if (instruction.op == MATCH_PREVIOUS_REGEX_OP) {
+        accept = PREVIOUS_REGEX_ACCEPT;
+      } else if (instruction.op == LOOK_REGEX_OP && instruction.eof_ok &&
+                 eof_accept == NO_REGEX_ACCEPT) {
+        eof_accept = CURRENT_REGEX_ACCEPT;
+      }
+    }
+    accepts->push_back(accept);
+    eof_accepts->push_back(eof_accept == NO_REGEX_ACCEPT ? accept
+                                                         : eof_accept);
+    if (unanchored && !found) {
+      threads.insert(threads.end(), start_threads.begin(),
+                     start_threads.end());
+    }
+    for (int k = 0; k < num_classes; k++) {
+      std::vector<int> seeds;
+      for (int pc : threads) {
+        const RegexInstruction& instruction = program.instructions[pc];
+        if ((instruction.op == SET_REGEX_OP ||
+             instruction.op == LOOK_REGEX_OP) &&
+            set_classes[instruction.set][k]) {
+          seeds.push_back(instruction.x);
+        }
+      }
+      std::vector<int> next = program.closure(seeds);
+      if (unanchored) {
+        bool next_found = found;
+        for (int pc : next) {
+          REGEX_OP op = program.instructions[pc].op;
+          next_found = next_found || op == MATCH_REGEX_OP ||
+                       op == MATCH_PREVIOUS_REGEX_OP;
+        }
+        if (next_found) {
+          next.push_back(-1);
+        }
+      }
+      transitions->push_back(dfa.intern(next));
+    }
+  }
+}
+
+// DFA of a reversed program, read backwards from the end of a match to find
+// every start of the pattern ending there, state 0 dead. The start state
+// depends on the class of the character after the match, num_classes
+// standing for the end of input.
+void determinize_reverse(const RegexProgram& program,
+                         const std::vector<std::vector<bool>>& set_classes,
+                         int num_classes, std::vector<int>* starts,
+                         std::vector<int>* transitions,
+                         std::vector<uint8_t>* accepts) {
+  auto closure = [&program](const std::vector<int>& seeds) {
+    std::vector<int> threads = program.closure(seeds);
+    std::sort(threads.begin(), threads.end());
+    return threads;
+  };
+  RegexStates dfa;
+  dfa.intern({});
+  std::vector<int> start_threads = program.closure({program.start});
+  for (int k = 0; k <= num_classes; k++) {
+    std::vector<int> seeds;
+    for (int pc : start_threads) {
+      const RegexInstruction& instruction = program.instructions[pc];
+      if (instruction.op != LOOK_REGEX_OP) {
+        seeds.push_back(pc);
+      } else if (k == num_classes ? instruction.eof_ok
+                                  : set_classes[instruction.set][k]) {
+        seeds.push_back(instruction.x);
+      }
+    }
+    starts->push_back(dfa.intern(closure(seeds)));
+  }
+  for (size_t state = 0; state < dfa.states.size(); state++) {
+    std::vector<int> threads = dfa.states[state];
+    uint8_t accept = NO_REGEX_ACCEPT;
+    for (int pc : threads) {
+      if (program.instructions[pc].op == MATCH_REGEX_OP) {
+        accept = CURRENT_REGEX_ACCEPT;
+      }
+    }
+    accepts->push_back(accept);
+    for (int k = 0; k < num_classes; k++) {
+      std::vector<int> seeds;
+      for (int pc : threads) {
+        const RegexInstruction& instruction = program.instructions[pc];
+        if (instruction.op == SET_REGEX_OP &&
+            set_classes[instruction.set][k]) {
+          seeds.push_back(instruction.x);
+        }
+      }
+      transitions->push_back(dfa.intern(closure(seeds)));
+    }
+  }
+}
+
+Regex::Regex() : num_classes(0) {}
+
+Regex::Regex(const std::string& pattern) : num_classes(0) {
+  try {
+    std::vector<icu::UnicodeSet> sets;
+    RegexNode root = RegexParser(pattern, &sets).parse();
+    RegexProgram program(root);
+
+    std::vector<UChar32> boundaries = {0, 0x110000};
+    for (const icu::UnicodeSet& set : sets) {
+      for (int i = 0; i < set.getRangeCount(); i++) {
+        boundaries.push_back(set.getRangeStart(i));
+        boundaries.push_back(set.getRangeEnd(i) + 1);
+      }
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()),
+                     boundaries.end());
+    std::unordered_map<std::string, uint16_t> signatures;
+    std::vector<std::vector<bool>> set_classes(sets.size());
+    std::vector<uint16_t> classes(0x110000);
+    for (size_t i = 0; i + 1 < boundaries.size(); i++) {
+      std::string signature(sets.size(), '\0');
+      for (size_t j = 0; j < sets.size(); j++) {
+        signature[j] = sets[j].contains(boundaries[i]) ? 1 : 0;
+      }
+      auto it = signatures.find(signature);
+      if (it == signatures.end()) {
+        it = signatures.insert({signature, signatures.size()}).first;
+        for (size_t j = 0; j < sets.size(); j++) {
+          set_classes[j].push_back(signature[j] != 0);
+        }
+      }
+      std::fill(classes.begin() + boundaries[i],
+                classes.begin() + boundaries[i + 1], it->second);
+    }
+    num_classes = signatures.size();
+    class_index.resize(0x110000 >> 8);
+    std::unordered_map<std::u16string, uint16_t> blocks;
+    for (UChar32 start = 0; start < 0x110000; start += 256) {
+      std::u16string block(classes.begin() + start,
+                           classes.begin() + start + 256);
+      auto it = blocks.find(block);
+      if (it == blocks.end()) {
+        it = blocks.insert({block, blocks.size()}).first;
+        class_blocks.insert(class_blocks.end(), block.begin(), block.end());
+      }
+      class_index[start >> 8] = it->second;
+    }
+
+    determinize(program, set_classes, num_classes, false, &transitions,
+                &accepts, &eof_accepts);
+    // Searching starts the program below the running threads, so its start
+    // must consume a character. Patterns that can match empty or look ahead
+    // first, or whose search automata grow too large, run the DFA from each
+    // character instead.
+    std::vector<int> start_threads = program.closure({program.start});
+    bool searchable = std::all_of(
+        start_threads.begin(), start_threads.end(), [&program](int pc) {
+          return program.instructions[pc].op == SET_REGEX_OP;
+        });
+    if (searchable) {
+      try {
+        determinize(program, set_classes, num_classes, true,
+                    &search_transitions, &search_accepts,
+                    &search_eof_accepts);
+        determinize_reverse(RegexProgram(root, true), set_classes,
+                            num_classes, &reverse_starts,
+                            &reverse_transitions, &reverse_accepts);
+      } catch (const std::invalid_argument&) {
+        search_transitions.clear();
+        search_accepts.clear();
+        search_eof_accepts.clear();
+        reverse_starts.clear();
+        reverse_transitions.clear();
+        reverse_accepts.clear();
+      }
+    }
+  } catch (const std::invalid_argument&) {
+    num_classes = 0;
+    class_index.clear();
+    class_blocks.clear();
+    transitions.clear();
+    accepts.clear();
+    eof_accepts.clear();
+    search_transitions.clear();
+    search_accepts.clear();
+    search_eof_accepts.clear();
+    reverse_starts.clear();
+    reverse_transitions.clear();
+    reverse_accepts.clear();
+    UErrorCode status = U_ZERO_ERROR;
+    fallback.reset(icu::RegexPattern::compile(
+        icu::UnicodeString::fromUTF8(pattern), 0, status));
+    if (U_FAILURE(status)) {
+      throw std::runtime_error("Invalid regex pattern: " + pattern);
+    }
+  }
+}
+
+bool Regex::is_dfa() const { return !transitions.empty(); }
+
+int Regex::class_of(UChar32 c) const {
+  if (c < 0) {
+    c = 0xFFFD;
+  }
+  return class_blocks[(class_index[c >> 8] << 8) | (c & 0xFF)];
+}
+
+std::vector<std::pair<int, int>> Regex::find_matches(
+    std::string_view input) const {
+  std::vector<std::pair<int, int>> matches;
+  int length = input.length();
+  if (fallback != nullptr) {
+    UErrorCode status = U_ZERO_ERROR;
+    UText* text = utext_openUTF8(nullptr, input.data(), length, &status);
+    std::unique_ptr<icu::RegexMatcher> matcher(fallback->matcher(status));
+    if (U_SUCCESS(status)) {
+      matcher->reset(text);
+      while (matcher->find(status)) {
+        int start = matcher->start64(status), end = matcher->end64(status);
+        if (start != end) {
+          matches.push_back({start, end});
+        }
+      }
+    }
+    utext_close(text);
+    return matches;
+  }
+  if (transitions.empty()) {
+    return matches;
+  }
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(input.data());
+  if (!search_transitions.empty()) {
+    return search_matches(data, length);
+  }
+  int pos = 0;
+  while (pos < length) {
+    int state = 1, best = -1, i = pos;
+    while (i < length) {
+      int previous = i;
+      UChar32 c;
+      U8_NEXT(data, i, length, c);
+      state = transitions[state * num_classes + class_of(c)];
+      if (state == 0) {
+        break;
+      }
+      if (accepts[state] == CURRENT_REGEX_ACCEPT) {
+        best = i;
+      } else if (accepts[state] == PREVIOUS_REGEX_ACCEPT) {
+        best = previous;
+      }
+    }
+    if (state != 0 && eof_accepts[state] == CURRENT_REGEX_ACCEPT) {
+      best = length;
+    }
+    if (best > pos) {
+      matches.push_back({pos, best});
+      pos = best;
+    } else {
+      U8_FWD_1(data, pos, length);
+    }
+  }
+  return matches;
+}
+
+std::vector<std::pair<int, int>> Regex::search_matches(const uint8_t* data,
+                                                       int length) const {
+  std::vector<std::pair<int, int>> matches;
+  int pos = 0;
+  while (pos < length) {
+    // end of the leftmost match, reading each character once
+    int state = 1, end = -1, i = pos;
+    while (i < length) {
+      int previous = i;
+      UChar32 c;
+      U8_NEXT(data, i, length, c);
+      state = search_transitions[state * num_classes + class_of(c)];
+      if (state == 0) {
+        break;
+      }
+      if (search_accepts[state] == CURRENT_REGEX_ACCEPT) {
+        end = i;
+      } else if (search_accepts[state] == PREVIOUS_REGEX_ACCEPT) {
+        end = previous;
+      }
+    }
+    if (state != 0 && search_eof_accepts[state] == CURRENT_REGEX_ACCEPT) {
+      end = length;
+    }
+    if (end < 0) {
+      break;
+    }
+    // its start is the leftmost one of a match ending there
+    int next_class = num_classes;
+    if (end < length) {
+      int j = end;
+      UChar32 c;
+      U8_NEXT(data, j, length, c);
+      next_class = class_of(c);
+    }
+    int start = end;
+    state = reverse_starts[next_class];
+    i = end;
+    while (i > pos && state != 0) {
+      UChar32 c;
+      U8_PREV(data, pos, i, c);
+      state = reverse_transitions[state * num_classes + class_of(c)];
+      if (reverse_accepts[state] == CURRENT_REGEX_ACCEPT) {
+        start = i;
+      }
+    }
+    matches.push_back({start, end});
+    pos = end;
+  }
+  return matches;
+}
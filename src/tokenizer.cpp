@@ -4,24 +4,90 @@
 #include <unicode/uchar.h>
 #include <unicode/unistr.h>
 
+#include <algorithm>
+#include <exception>
 #include <memory>
-#include <numeric>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "simdjson.h"
 #include "tokenizers/added_vocabulary.h"
+#include "tokenizers/binary.h"
 #include "tokenizers/common.h"
 #include "tokenizers/decoder.h"
 #include "tokenizers/model.h"
 #include "tokenizers/normalizer.h"
+#include "tokenizers/pipeline.h"
 #include "tokenizers/post_processor.h"
 #include "tokenizers/pre_tokenizer.h"
 #include "tokenizers/utils.h"
 
-Tokenizer::Tokenizer(const std::string& path, const std::string& config) {
+// Shortest length of both sequences for encoding a pair on two threads.
+const size_t PARALLEL_PAIR_LENGTH = 4096;
+
+// Top-level keys of a tokenizer config, each required even if null.
+const std::vector<std::string_view> TOKENIZER_KEYS = {
+    "truncation",    "padding", "added_tokens", "normalizer",
+    "pre_tokenizer", "model",   "decoder",      "post_processor"};
+
+// Clears encoding, keeping its capacity, and fills it from pre_tokenized.
+void into_encoding(const PreTokenizedString& pre_tokenized,
+                   std::optional<int> word_idx, int type_id,
+                   EncodeOptions options, const Vocab* vocab,
+                   TokenStorage* token_storage, Encoding* encoding) {
+  size_t length = 0;
+  for (const Split& split : pre_tokenized.splits) {
+    length += split.tokens.size();
+  }
+  encoding->clear();
+  encoding->fields = options;
+  encoding->reserve(length);
+  if (options & TYPE_IDS_ENCODE_OPTION) {
+    encoding->type_ids.assign(length, type_id);
+  }
+  if (options & SPECIAL_TOKENS_MASK_ENCODE_OPTION) {
+    encoding->special_tokens_mask.assign(length, 0);
+  }
+  if (options & ATTENTION_MASK_ENCODE_OPTION) {
+    encoding->attention_mask.assign(length, 1);
+  }
+  for (int idx = 0; idx < pre_tokenized.splits.size(); idx++) {
+    const Split& split = pre_tokenized.splits[idx];
+    for (const Token& token : split.tokens) {
+      encoding->ids.push_back(token.id);
+    }
+    if (options & WORDS_ENCODE_OPTION) {
+      encoding->words.insert(encoding->words.end(), split.tokens.size(),
+                            word_idx.has_value() ? word_idx.value() : idx);
+    }
+    if (options & TOKENS_ENCODE_OPTION) {
+      for (const Token& token : split.tokens) {
+        std::optional<std::string_view> value =
+            vocab != nullptr ? vocab->token(token.id) : std::nullopt;
+        encoding->tokens.push_back(value.has_value() && *value == token.value
+                                       ? *value
+                                       : token_storage->intern(token.value));
+      }
+    }
+    if (options & OFFSETS_ENCODE_OPTION) {
+      for (const Token& token : split.tokens) {
+        encoding->offsets.push_back(
+            original_offsets(pre_tokenized.normalized,
+                             split.offsets.first + token.offsets.first,
+                             split.offsets.first + token.offsets.second));
+      }
+    }
+  }
+}
+
+Tokenizer::Tokenizer(const std::string& path, const std::string& config,
+                     int num_threads)
+    : token_storage(std::make_unique<TokenStorage>()) {
   if (path.length() == 0 && config.length() == 0) {
     throw std::invalid_argument(
         "Requires path or config for initializing a tokenizer!");
@@ -40,146 +106,606 @@ Tokenizer::Tokenizer(const std::string& path, const std::string& config) {
     simdjson::ondemand::document tokenizer_json =
         parser.iterate(tokenizer_json_str);
 
-    if (!tokenizer_json["truncation"].is_null()) {
-      simdjson::ondemand::object truncation_params =
-          tokenizer_json["truncation"].get_object();
-      truncation = with_truncation(truncation_params);
-    }
-    if (!tokenizer_json["padding"].is_null()) {
-      simdjson::ondemand::object padding_params =
-          tokenizer_json["padding"].get_object();
-      padding = with_padding(padding_params);
-    }
-    if (!tokenizer_json["added_tokens"].is_null()) {
-      simdjson::ondemand::array added_tokens_params =
-          tokenizer_json["added_tokens"].get_array();
-      added_vocabulary = with_added_vocabulary(added_tokens_params);
+    // The model is built in this pass, everything but its vocab and merges
+    // being kept as the config the other components are built from.
+    this->config = "{";
+    for (auto field : tokenizer_json.get_object()) {
+      std::string_view key = field.escaped_key();
+      simdjson::ondemand::value value = field.value();
+      if (this->config.length() > 1) {
+        this->config += ",";
+      }
+      this->config += "\"" + std::string(key) + "\":";
+      if (key != "model" ||
+          value.type() != simdjson::ondemand::json_type::object) {
+        this->config += static_cast<std::string_view>(value.raw_json());
+        continue;
+      }
+      simdjson::ondemand::object model_params = value.get_object();
+      std::string model_config = "{";
+      for (auto param : model_params) {
+        std::string_view param_key = param.escaped_key();
+        if (param_key == "vocab" || param_key == "merges") {
+          continue;
+        }
+        if (model_config.length() > 1) {
+          model_config += ",";
+        }
+        model_config += "\"" + std::string(param_key) + "\":";
+        model_config +=
+            static_cast<std::string_view>(param.value().raw_json());
+      }
+      this->config += model_config + "}";
+      model_params.reset();
+      model = with_model(model_params, nullptr, nullptr, num_threads);
     }
+    this->config += "}";
+  } catch (const std::exception& e) {
+    throw std::runtime_error("Error parsing tokenizer config");
+  }
+  configure(nullptr);
+}
 
-    if (!tokenizer_json["normalizer"].is_null()) {
-      simdjson::ondemand::object normalizer_params =
-          tokenizer_json["normalizer"].value();
-      normalizer = with_normalizer(normalizer_params);
-    }
-    if (!tokenizer_json["pre_tokenizer"].is_null()) {
-      simdjson::ondemand::object pre_tokenizer_params =
-          tokenizer_json["pre_tokenizer"].value();
-      pre_tokenizer = with_pre_tokenizer(pre_tokenizer_params);
-    }
-    if (!tokenizer_json["model"].is_null()) {
-      simdjson::ondemand::object model_params = tokenizer_json["model"].value();
-      model = with_model(model_params);
+Tokenizer::Tokenizer(const BinaryReader& reader)
+    : token_storage(std::make_unique<TokenStorage>()) {
+  std::optional<std::string_view> config_section =
+      reader.section(CONFIG_BINARY_SECTION);
+  if (!config_section.has_value()) {
+    throw std::runtime_error("Missing tokenizer config");
+  }
+  config = std::string(config_section.value());
+  configure(&reader);
+}
+
+Tokenizer Tokenizer::load_binary(const std::string& path) {
+  return Tokenizer(BinaryReader(path));
+}
+
+void Tokenizer::save_binary(const std::string& path) const {
+  BinaryWriter writer;
+  writer.add_section(CONFIG_BINARY_SECTION, config);
+  if (model != nullptr) {
+    writer.add_section(VOCAB_BINARY_SECTION, model->vocab.blob());
+    const BPE* bpe = dynamic_cast<const BPE*>(model.get());
+    if (bpe != nullptr) {
+      writer.add_section(MERGES_BINARY_SECTION, bpe->merges.blob());
     }
-    if (!tokenizer_json["decoder"].is_null()) {
-      simdjson::ondemand::object decoder_params =
-          tokenizer_json["decoder"].value();
-      decoder = with_decoder(decoder_params);
+  }
+  writer.write(path);
+}
+
+// Builds the components from config in one pass, and the model too from the
+// vocab and merges sections of reader when given.
+void Tokenizer::configure(const BinaryReader* reader) {
+  simdjson::ondemand::parser parser;
+  simdjson::padded_string tokenizer_json_str(config);
+
+  try {
+    simdjson::ondemand::document tokenizer_json =
+        parser.iterate(tokenizer_json_str);
+
+    int found = 0;
+    for (auto field : tokenizer_json.get_object()) {
+      std::string_view key = field.escaped_key();
+      simdjson::ondemand::value value = field.value();
+      if (std::find(TOKENIZER_KEYS.begin(), TOKENIZER_KEYS.end(), key) !=
+          TOKENIZER_KEYS.end()) {
+        found++;
+      }
+      if (value.is_null()) {
+        continue;
+      }
+      if (key == "truncation") {
+        truncation = with_truncation(value.get_object());
+      } else if (key == "padding") {
+        padding = with_padding(value.get_object());
+      } else if (key == "added_tokens") {
+        added_vocabulary = with_added_vocabulary(value.get_array());
+      } else if (key == "normalizer") {
+        normalizer = with_normalizer(value.get_object());
+      } else if (key == "pre_tokenizer") {
+        pre_tokenizer = with_pre_tokenizer(value.get_object());
+      } else if (key == "model" && reader != nullptr) {
+        std::optional<std::string_view> vocab_section =
+            reader->section(VOCAB_BINARY_SECTION);
+        std::optional<std::string_view> merges_section =
+            reader->section(MERGES_BINARY_SECTION);
+        if (!vocab_section.has_value()) {
+          throw std::runtime_error("Missing vocabulary");
+        }
+        Vocab vocab(vocab_section->data(), vocab_section->size(),
+                    reader->file());
+        std::optional<MergeTable> merges;
+        if (merges_section.has_value()) {
+          merges = MergeTable(merges_section->data(), merges_section->size(),
+                              reader->file());
+        }
+        model = with_model(value.get_object(), &vocab,
+                           merges.has_value() ? &merges.value() : nullptr);
+      } else if (key == "decoder") {
+        decoder = with_decoder(value.get_object());
+      } else if (key == "post_processor") {
+        post_processor = with_post_processor(value.get_object());
+      }
     }
-    if (!tokenizer_json["post_processor"].is_null()) {
-      simdjson::ondemand::object post_processor_params =
-          tokenizer_json["post_processor"].value();
-      post_processor = with_post_processor(post_processor_params);
+    if (found != TOKENIZER_KEYS.size()) {
+      throw std::runtime_error("Missing tokenizer components");
     }
   } catch (const std::exception& e) {
     throw std::runtime_error("Error parsing tokenizer config");
   }
 
   if (added_vocabulary != nullptr) {
-    add_tokens(added_vocabulary->added_tokens);
+    added_vocabulary->add_tokens(added_vocabulary->added_tokens, model.get(),
+                                 normalizer.get());
   }
+  pipeline = make_pipeline(normalizer.get(), pre_tokenizer.get(), model.get(),
+                           post_processor.get());
+  refresh_vocabulary_tables();
 }
 
 Encoding Tokenizer::encode(const std::wstring& sequence,
-                           bool add_special_tokens) {
-  PreTokenizedString pre_tokenized =
-      PreTokenizedString(NormalizedString(sequence));
-  if (added_vocabulary != nullptr) {
-    pre_tokenized =
-        added_vocabulary->extract_and_normalize(normalizer.get(), sequence);
+                           bool add_special_tokens, EncodeOptions options) {
+  Encoding encoding;
+  encode_sequence(sequence, 0, options, &encoding);
+  do_post_process(&encoding, add_special_tokens);
+  return encoding;
+}
+
+void Tokenizer::encode_into(std::string_view sequence, Encoding* encoding,
+                            bool add_special_tokens,
+                            EncodeOptions options) const {
+  encode_sequence(convert_from_string(std::string(sequence)), 0, options,
+                  encoding);
+  do_post_process(encoding, add_special_tokens);
+}
+
+void Tokenizer::encode_batch_into(
+    const std::vector<std::string_view>& sequences,
+    std::vector<Encoding>* encodings, bool add_special_tokens,
+    EncodeOptions options) const {
+  encodings->resize(sequences.size());
+  int num_threads = std::min<int>(
+      std::max(1u, std::thread::hardware_concurrency()), sequences.size());
+  std::vector<std::exception_ptr> errors(num_threads);
+  auto encode_chunk = [&](int t) {
+    try {
+      for (size_t i = t; i < sequences.size(); i += num_threads) {
+        encode_into(sequences[i], &(*encodings)[i], add_special_tokens,
+                    options);
+      }
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; t++) {
+    threads.push_back(std::thread(encode_chunk, t));
   }
-  if (pre_tokenizer != nullptr) {
-    pre_tokenized = pre_tokenizer->pre_tokenize(pre_tokenized);
+  if (num_threads > 0) {
+    encode_chunk(0);
   }
-  Encoding encoding = do_tokenize(pre_tokenized, std::nullopt, 0);
-  return do_post_process(encoding, add_special_tokens);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (std::exception_ptr& error : errors) {
+    if (error != nullptr) {
+      std::rethrow_exception(error);
+    }
+  }
+  if (padding != nullptr) {
+    padding->pad_encodings(encodings);
+  }
+}
+
+void Tokenizer::encode_sequence(const std::wstring& sequence, int type_id,
+                                EncodeOptions options,
+                                Encoding* encoding) const {
+  PreTokenizedString pre_tokenized = pipeline->tokenize(
+      sequence, added_vocabulary.get(), options & OFFSETS_ENCODE_OPTION);
+  into_encoding(pre_tokenized, std::nullopt, type_id, options,
+                model != nullptr ? &model->vocab : nullptr,
+                token_storage.get(), encoding);
+}
+
+Encoding Tokenizer::encode_pair(const std::wstring& sequence,
+                                const std::wstring& pair,
+                                bool add_special_tokens,
+                                EncodeOptions options) {
+  Encoding encoding, pair_encoding;
+  if (std::min(sequence.length(), pair.length()) >= PARALLEL_PAIR_LENGTH) {
+    std::thread thread(
+        [&]() { encode_sequence(pair, 1, options, &pair_encoding); });
+    encode_sequence(sequence, 0, options, &encoding);
+    thread.join();
+  } else {
+    encode_sequence(sequence, 0, options, &encoding);
+    encode_sequence(pair, 1, options, &pair_encoding);
+  }
+  encoding = do_post_process_pair(std::move(encoding),
+                                  std::move(pair_encoding), add_special_tokens);
+  if (padding != nullptr) {
+    padding->pad_encoding(&encoding);
+  }
+  return encoding;
+}
+
+std::vector<Encoding> Tokenizer::encode_pair_batch(
+    const std::vector<std::pair<std::wstring, std::wstring>>& pairs,
+    bool add_special_tokens, EncodeOptions options) {
+  std::vector<Encoding> encodings(pairs.size());
+  int num_threads = std::min<int>(
+      std::max(1u, std::thread::hardware_concurrency()), pairs.size());
+  std::vector<std::exception_ptr> errors(num_threads);
+  auto encode_chunk = [&](int t) {
+    try {
+      for (size_t i = t; i < pairs.size(); i += num_threads) {
+        Encoding encoding, pair_encoding;
+        encode_sequence(pairs[i].first, 0, options, &encoding);
+        encode_sequence(pairs[i].second, 1, options, &pair_encoding);
+        encodings[i] = do_post_process_pair(
+            std::move(encoding), std::move(pair_encoding), add_special_tokens);
+      }
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; t++) {
+    threads.push_back(std::thread(encode_chunk, t));
+  }
+  if (num_threads > 0) {
+    encode_chunk(0);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (std::exception_ptr& error : errors) {
+    if (error != nullptr) {
+      std::rethrow_exception(error);
+    }
+  }
+  if (padding != nullptr) {
+    padding->pad_encodings(&encodings);
+  }
+  return encodings;
 }
 
 std::string Tokenizer::decode(const std::vector<int>& ids,
-                              bool skip_special_tokens) {
-  std::vector<std::string> tokens;
-  for (int id : ids) {
-    std::string token = "";
-    std::optional<std::string> av_token = added_vocabulary->id_to_token(id);
-    if (!av_token.has_value()) {
-      token = model->id_to_token(id).value();
-    } else {
-      token = av_token.value();
+                              bool skip_special_tokens) const {
+  std::string result;
+  decode_into(ids.data(), ids.size(), skip_special_tokens, &result);
+  return result;
+}
+
+void Tokenizer::decode_into(const int* ids, size_t length,
+                            bool skip_special_tokens,
+                            std::string* output) const {
+  prepare_decode_table();
+  if (decode_table.is_enabled()) {
+    decode_table.decode_into(ids, length, skip_special_tokens, output);
+    return;
+  }
+  DecodedTokens tokens;
+  tokens.ends.reserve(length);
+  for (size_t i = 0; i < length; i++) {
+    std::optional<std::string> token;
+    if (added_vocabulary != nullptr) {
+      token = added_vocabulary->id_to_token(ids[i]);
+      if (token.has_value() && skip_special_tokens &&
+          added_vocabulary->is_special_token(token.value())) {
+        continue;
+      }
+    }
+    if (!token.has_value()) {
+      token = model->id_to_token(ids[i]);
+    }
+    if (token.has_value()) {
+      tokens.push_back(token.value());
     }
-    if (!skip_special_tokens || !added_vocabulary->is_special_token(token)) {
-      tokens.push_back(token);
+  }
+  if (decoder == nullptr) {
+    for (int i = 0; i < tokens.size(); i++) {
+      if (i != 0) {
+        output->push_back(' ');
+      }
+      output->append(tokens.token(i));
+    }
+    return;
+  }
+  output->append(decoder->decode(tokens));
+}
+
+DecodedBatch Tokenizer::decode_batch(const std::vector<int>& ids,
+                                     const std::vector<size_t>& offsets,
+                                     bool skip_special_tokens,
+                                     int num_threads) const {
+  DecodedBatch batch;
+  if (offsets.size() < 2) {
+    batch.offsets.push_back(0);
+    return batch;
+  }
+  int size = offsets.size() - 1;
+  for (int i = 0; i < size; i++) {
+    if (offsets[i] > offsets[i + 1]) {
+      throw std::invalid_argument("Invalid offsets for decode batch");
     }
   }
-  tokens = decoder->decode_chain(tokens);
-  return std::accumulate(tokens.begin(), tokens.end(), std::string{});
+  if (offsets.back() > ids.size()) {
+    throw std::invalid_argument("Invalid offsets for decode batch");
+  }
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, size);
+
+  // chunks of consecutive sequences holding about the same number of ids
+  std::vector<int> chunks = {0};
+  size_t total = offsets.back() - offsets.front();
+  for (int t = 1; t < num_threads; t++) {
+    size_t target = offsets.front() + total * t / num_threads;
+    int chunk = std::lower_bound(offsets.begin() + chunks.back(),
+                                 offsets.end() - 1, target) -
+                offsets.begin();
+    if (chunk > chunks.back() && chunk < size) {
+      chunks.push_back(chunk);
+    }
+  }
+  chunks.push_back(size);
+
+  int num_chunks = chunks.size() - 1;
+  std::vector<std::string> buffers(num_chunks);
+  std::vector<std::vector<size_t>> lengths(num_chunks);
+  std::vector<std::exception_ptr> errors(num_chunks);
+  auto decode_chunk = [&](int c) {
+    try {
+      lengths[c].reserve(chunks[c + 1] - chunks[c]);
+      for (int i = chunks[c]; i < chunks[c + 1]; i++) {
+        size_t start = buffers[c].length();
+        decode_into(ids.data() + offsets[i], offsets[i + 1] - offsets[i],
+                    skip_special_tokens, &buffers[c]);
+        lengths[c].push_back(buffers[c].length() - start);
+      }
+    } catch (...) {
+      errors[c] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int c = 1; c < num_chunks; c++) {
+    threads.push_back(std::thread(decode_chunk, c));
+  }
+  decode_chunk(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (std::exception_ptr& error : errors) {
+    if (error != nullptr) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  size_t length = 0;
+  for (const std::string& buffer : buffers) {
+    length += buffer.length();
+  }
+  batch.buffer.reserve(length);
+  batch.offsets.reserve(size + 1);
+  batch.offsets.push_back(0);
+  for (int c = 0; c < num_chunks; c++) {
+    batch.buffer.append(buffers[c]);
+    for (size_t sequence_length : lengths[c]) {
+      batch.offsets.push_back(batch.offsets.back() + sequence_length);
+    }
+  }
+  return batch;
+}
+
+int DecodedBatch::size() const { return offsets.size() - 1; }
+
+std::string_view DecodedBatch::sequence(int i) const {
+  return std::string_view(buffer).substr(offsets[i],
+                                         offsets[i + 1] - offsets[i]);
+}
+
+DecodeStream Tokenizer::decode_stream(bool skip_special_tokens) const {
+  return DecodeStream(this, skip_special_tokens);
+}
+
+DecodeStream::DecodeStream(const Tokenizer* tokenizer,
+                           bool skip_special_tokens)
+    : tokenizer(tokenizer),
+      skip_special_tokens(skip_special_tokens),
+      prefix_index(0) {}
+
+std::optional<std::string> DecodeStream::step(int id) {
+  ids.push_back(id);
+  std::string text = tokenizer->decode(ids, skip_special_tokens);
+  bool incomplete = text.length() >= 3 &&
+                    text.compare(text.length() - 3, 3, "\uFFFD") == 0;
+  if (text.length() <= prefix.length() || incomplete) {
+    return std::nullopt;
+  }
+  if (text.compare(0, prefix.length(), prefix) != 0) {
+    throw std::runtime_error("Invalid prefix encountered while decoding");
+  }
+  std::string new_text = text.substr(prefix.length());
+  int new_prefix_index = ids.size() - prefix_index;
+  ids.erase(ids.begin(), ids.begin() + prefix_index);
+  prefix = tokenizer->decode(ids, skip_special_tokens);
+  prefix_index = new_prefix_index;
+  return new_text;
+}
+
+DecodeTree::DecodeTree(const Tokenizer* tokenizer, bool skip_special_tokens)
+    : root(tokenizer, skip_special_tokens) {}
+
+int DecodeTree::extend(int parent, int id) {
+  if (parent < -1 || parent >= size()) {
+    throw std::invalid_argument("Invalid parent node");
+  }
+  DecodeStream stream = parent == -1 ? root : streams[parent];
+  std::optional<std::string> text = stream.step(id);
+  parents.push_back(parent);
+  streams.push_back(std::move(stream));
+  texts.push_back(text.has_value() ? std::move(text.value()) : "");
+  return size() - 1;
+}
+
+std::vector<int> DecodeTree::extend(
+    const std::vector<std::pair<int, int>>& steps) {
+  std::vector<int> nodes;
+  nodes.reserve(steps.size());
+  for (const std::pair<int, int>& step : steps) {
+    nodes.push_back(extend(step.first, step.second));
+  }
+  return nodes;
+}
+
+int DecodeTree::size() const { return parents.size(); }
+
+const std::string& DecodeTree::new_text(int node) const {
+  return texts[node];
+}
+
+std::string DecodeTree::text(int node) const {
+  std::vector<int> path;
+  size_t length = 0;
+  for (int i = node; i != -1; i = parents[i]) {
+    path.push_back(i);
+    length += texts[i].length();
+  }
+  std::string result;
+  result.reserve(length);
+  for (auto it = path.rbegin(); it != path.rend(); it++) {
+    result.append(texts[*it]);
+  }
+  return result;
 }
 
 int Tokenizer::add_tokens(const std::vector<AddedToken>& tokens) {
-  return added_vocabulary->add_tokens(tokens, model.get(), normalizer.get());
+  int added =
+      added_vocabulary->add_tokens(tokens, model.get(), normalizer.get());
+  refresh_vocabulary_tables();
+  return added;
 }
 
 int Tokenizer::add_special_tokens(const std::vector<AddedToken>& tokens) {
-  return added_vocabulary->add_special_tokens(tokens, model.get(),
-                                              normalizer.get());
+  int added = added_vocabulary->add_special_tokens(tokens, model.get(),
+                                                   normalizer.get());
+  refresh_vocabulary_tables();
+  return added;
 }
 
-Encoding into_encoding(PreTokenizedString pre_tokenized,
-                       std::optional<int> word_idx, int type_id) {
-  Encoding encoding;
-  for (int idx = 0; idx < pre_tokenized.splits.size(); idx++) {
-    Split split = pre_tokenized.splits[idx];
-    std::pair<int, int> transformed_split_offset = {
-        pre_tokenized.normalized
-            .offsets[pre_tokenized.normalized.offset_ranges[split.offsets.first]
-                         .first]
-            .first,
-        pre_tokenized.normalized
-            .offsets[pre_tokenized.normalized.offset_ranges[split.offsets.first]
-                         .first]
-            .second};
-    for (Token token : split.tokens) {
-      encoding.ids.push_back(token.id);
-      encoding.tokens.push_back(token.value);
-      encoding.offsets.push_back(
-          {transformed_split_offset.first + token.offsets.first,
-           transformed_split_offset.first + token.offsets.second});
-      encoding.words.push_back(word_idx.has_value() ? word_idx.value() : idx);
-      encoding.type_ids.push_back(type_id);
-      encoding.special_tokens_mask.push_back(0);
-      encoding.attention_mask.push_back(1);
+void Tokenizer::collect_tokens(
+    std::vector<std::optional<std::string>>* tokens,
+    std::vector<bool>* special) const {
+  auto set_token = [&](int id, std::string_view token, bool is_special) {
+    if (id < 0) {
+      return;
+    }
+    if (id >= tokens->size()) {
+      tokens->resize(id + 1);
+      special->resize(id + 1);
+    }
+    (*tokens)[id] = std::string(token);
+    (*special)[id] = is_special;
+  };
+  tokens->reserve(model->vocab.id_count());
+  special->reserve(model->vocab.id_count());
+  for (int id = 0; id < model->vocab.id_count(); id++) {
+    std::optional<std::string_view> token = model->vocab.token(id);
+    if (token.has_value()) {
+      set_token(id, token.value(), false);
     }
   }
-  return encoding;
+  if (added_vocabulary != nullptr) {
+    for (const auto& elem : added_vocabulary->get_added_tokens_decoder()) {
+      set_token(elem.first, elem.second.content,
+                added_vocabulary->is_special_token(elem.second.content));
+    }
+  }
+}
+
+void Tokenizer::refresh_vocabulary_tables() {
+  decode_table_flag = std::make_unique<std::once_flag>();
+  post_processor_flag = std::make_unique<std::once_flag>();
 }
 
-Encoding Tokenizer::do_tokenize(PreTokenizedString pre_tokenized,
-                                std::optional<int> word_idx,
-                                int type_id) const {
+void Tokenizer::prepare_post_processor() const {
+  std::call_once(*post_processor_flag, [this]() {
+    if (model == nullptr || post_processor == nullptr) {
+      return;
+    }
+    std::vector<std::optional<std::string>> tokens;
+    std::vector<bool> special;
+    collect_tokens(&tokens, &special);
+    post_processor->set_vocabulary(tokens);
+  });
+}
+
+void Tokenizer::prepare_decode_table() const {
+  std::call_once(*decode_table_flag, [this]() {
+    decode_table = DecodeTable();
+    if (model == nullptr || decoder == nullptr) {
+      return;
+    }
+    std::vector<std::optional<std::string>> tokens;
+    std::vector<bool> special;
+    collect_tokens(&tokens, &special);
+    decode_table = DecodeTable(decoder.get(), tokens, special);
+  });
+}
+
+PIPELINE Tokenizer::get_pipeline() const { return pipeline->type(); }
+
+VocabularyIndex Tokenizer::get_vocabulary_index() const {
+  prepare_decode_table();
+  if (decode_table.is_enabled()) {
+    return VocabularyIndex(decode_table);
+  }
+  std::vector<std::optional<std::string>> tokens;
+  std::vector<bool> special;
   if (model != nullptr) {
-    pre_tokenized = model->tokenize(pre_tokenized);
+    collect_tokens(&tokens, &special);
+  }
+  for (int id = 0; id < tokens.size(); id++) {
+    if (tokens[id].has_value()) {
+      tokens[id] = decode({id}, false);
+    }
   }
-  return into_encoding(pre_tokenized, word_idx, type_id);
+  return VocabularyIndex(tokens);
 }
 
-Encoding Tokenizer::do_post_process(Encoding encoding,
-                                    bool add_special_tokens) const {
+void Tokenizer::do_post_process(Encoding* encoding,
+                                bool add_special_tokens) const {
+  prepare_post_processor();
   if (truncation != nullptr) {
-    encoding = truncation->truncate_encoding(encoding);
-  }
-  if (post_processor != nullptr) {
-    encoding = post_processor->process(encoding, add_special_tokens);
+    int added_tokens = add_special_tokens && post_processor != nullptr
+                           ? post_processor->added_tokens(false)
+                           : 0;
+    truncation->truncate_encoding(encoding, added_tokens);
   }
+  pipeline->process(encoding, add_special_tokens);
   if (padding != nullptr) {
-    encoding = padding->pad_encoding(encoding);
+    padding->pad_encoding(encoding);
   }
-  return encoding;
+}
+
+Encoding Tokenizer::do_post_process_pair(Encoding encoding, Encoding pair,
+                                         bool add_special_tokens) const {
+  prepare_post_processor();
+  if (truncation != nullptr) {
+    int added_tokens = add_special_tokens && post_processor != nullptr
+                           ? post_processor->added_tokens(true)
+                           : 0;
+    truncation->truncate_pair(&encoding, &pair, added_tokens);
+  }
+  std::vector<Encoding> encodings;
+  encodings.push_back(std::move(encoding));
+  encodings.push_back(std::move(pair));
+  if (post_processor != nullptr) {
+    encodings = post_processor->process_encodings(std::move(encodings),
+                                                  add_special_tokens);
+  }
+  return merge_encodings(std::move(encodings));
 }
@@ -2,9 +2,11 @@
 #include "tokenizers/utils.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -44,21 +46,51 @@ Truncation::Truncation(const std::string& direction,
       max_length(max_length),
       stride(stride) {}
 
-Encoding truncate(Encoding encoding, int max_length, int stride,
-                  TRUNCATION_DIRECTION direction) {
-  int encoding_length = encoding.ids.size();
+template <typename T>
+std::vector<T> slice_range(const std::vector<T>& values, int start, int stop) {
+  if (values.empty()) {
+    return {};
+  }
+  return std::vector<T>(values.begin() + start, values.begin() + stop);
+}
+
+Encoding slice_encoding(const Encoding& encoding, int start, int stop) {
+  Encoding result(slice_range(encoding.ids, start, stop),
+                  slice_range(encoding.type_ids, start, stop),
+                  slice_range(encoding.tokens, start, stop),
+                  slice_range(encoding.words, start, stop),
+                  slice_range(encoding.offsets, start, stop),
+                  slice_range(encoding.special_tokens_mask, start, stop),
+                  slice_range(encoding.attention_mask, start, stop));
+  result.fields = encoding.fields;
+  return result;
+}
+
+template <typename T>
+void keep_range(std::vector<T>* values, int start, int stop) {
+  if (values->empty()) {
+    return;
+  }
+  values->erase(values->begin() + stop, values->end());
+  values->erase(values->begin(), values->begin() + start);
+}
+
+// Keeps the first part in place and moves the rest to overflowing.
+void truncate(Encoding* encoding, int max_length, int stride,
+              TRUNCATION_DIRECTION direction) {
+  int encoding_length = encoding->ids.size();
   if (max_length >= encoding_length) {
-    return encoding;
+    return;
   }
   if (max_length == 0) {
-    encoding.overflowing = {};
-    return encoding;
+    encoding->overflowing.clear();
+    return;
   }
   int offset = max_length - stride;
   bool end = false;
   std::vector<std::pair<int, int>> parts_ranges;
   if (direction == RIGHT_TRUNCATION_DIRECTION) {
-    for (int start = 0; start < encoding.ids.size(); start += offset) {
+    for (int start = 0; start < encoding_length; start += offset) {
       if (!end) {
         int stop = std::min(start + max_length, encoding_length);
         end = stop == encoding_length;
@@ -66,8 +98,7 @@ Encoding truncate(Encoding encoding, int max_length, int stride,
       }
     }
   } else if (direction == LEFT_TRUNCATION_DIRECTION) {
-    for (int stop = encoding.ids.size() - 1; stop >= 0; stop -= offset) {
-      stop += 1;
+    for (int stop = encoding_length; stop > 0; stop -= offset) {
       int start = stop < max_length ? 0 : stop - max_length;
       if (start < stop && !end) {
         end = start == 0;
@@ -75,63 +106,78 @@ Encoding truncate(Encoding encoding, int max_length, int stride,
       }
     }
   }
-  std::pair<int, int> elem = parts_ranges[0];
-  Encoding new_encoding(
-      std::vector<int>(encoding.ids.begin() + elem.first,
-                       encoding.ids.begin() + elem.second),
-      std::vector<int>(encoding.type_ids.begin() + elem.first,
-                       encoding.type_ids.begin() + elem.second),
-      std::vector<std::string>(encoding.tokens.begin() + elem.first,
-                               encoding.tokens.begin() + elem.second),
-      std::vector<std::optional<int>>(encoding.words.begin() + elem.first,
-                                      encoding.words.begin() + elem.second),
-      std::vector<std::pair<int, int>>(encoding.offsets.begin() + elem.first,
-                                       encoding.offsets.begin() + elem.second),
-      std::vector<int>(encoding.special_tokens_mask.begin() + elem.first,
-                       encoding.special_tokens_mask.begin() + elem.second),
-      std::vector<int>(encoding.attention_mask.begin() + elem.first,
-                       encoding.attention_mask.begin() + elem.second));
-  new_encoding.overflowing = {};
+  std::vector<Encoding> overflowing;
+  overflowing.reserve(parts_ranges.size() - 1);
   for (int i = 1; i < parts_ranges.size(); i++) {
-    elem = parts_ranges[i];
-    new_encoding.overflowing.push_back(Encoding(
-        std::vector<int>(encoding.ids.begin() + elem.first,
-                         encoding.ids.begin() + elem.second),
-        std::vector<int>(encoding.type_ids.begin() + elem.first,
-                         encoding.type_ids.begin() + elem.second),
-        std::vector<std::string>(encoding.tokens.begin() + elem.first,
-                                 encoding.tokens.begin() + elem.second),
-        std::vector<std::optional<int>>(encoding.words.begin() + elem.first,
-                                        encoding.words.begin() + elem.second),
-        std::vector<std::pair<int, int>>(
-            encoding.offsets.begin() + elem.first,
-            encoding.offsets.begin() + elem.second),
-        std::vector<int>(encoding.special_tokens_mask.begin() + elem.first,
-                         encoding.special_tokens_mask.begin() + elem.second),
-        std::vector<int>(encoding.attention_mask.begin() + elem.first,
-                         encoding.attention_mask.begin() + elem.second)));
+    overflowing.push_back(slice_encoding(*encoding, parts_ranges[i].first,
+                                         parts_ranges[i].second));
   }
-  return new_encoding;
+  int start = parts_ranges[0].first, stop = parts_ranges[0].second;
+  keep_range(&encoding->ids, start, stop);
+  keep_range(&encoding->type_ids, start, stop);
+  keep_range(&encoding->tokens, start, stop);
+  keep_range(&encoding->words, start, stop);
+  keep_range(&encoding->offsets, start, stop);
+  keep_range(&encoding->special_tokens_mask, start, stop);
+  keep_range(&encoding->attention_mask, start, stop);
+  encoding->overflowing = std::move(overflowing);
 }
 
-Encoding Truncation::truncate_encoding(Encoding encoding) const {
+void Truncation::truncate_encoding(Encoding* encoding,
+                                   int added_tokens) const {
+  int length = std::max(max_length - added_tokens, 0);
   if (max_length == 0) {
-    return truncate(encoding, 0, stride, direction);
+    truncate(encoding, 0, stride, direction);
+    return;
   }
-  if (encoding.ids.size() <= max_length) {
-    return encoding;
+  if (encoding->ids.size() <= length) {
+    return;
   }
-  int to_remove = encoding.ids.size() - max_length;
+  int to_remove = encoding->ids.size() - length;
   if (strategy == LONGEST_FIRST_TRUNCATION_STRATEGY) {
-    encoding =
-        truncate(encoding, encoding.ids.size() - to_remove, stride, direction);
+    truncate(encoding, encoding->ids.size() - to_remove, stride, direction);
   } else if (strategy == ONLY_FIRST_TRUNCATION_STRATEGY) {
-    int target_len = encoding.ids.size();
+    int target_len = encoding->ids.size();
+    if (target_len > to_remove) {
+      truncate(encoding, length, stride, direction);
+    }
+  }
+}
+
+void Truncation::truncate_pair(Encoding* encoding, Encoding* pair,
+                               int added_tokens) const {
+  int length = std::max(max_length - added_tokens, 0);
+  if (max_length == 0) {
+    truncate(encoding, 0, stride, direction);
+    truncate(pair, 0, stride, direction);
+    return;
+  }
+  int first_length = encoding->ids.size(), second_length = pair->ids.size();
+  if (first_length + second_length <= length) {
+    return;
+  }
+  int to_remove = first_length + second_length - length;
+  if (strategy == LONGEST_FIRST_TRUNCATION_STRATEGY) {
+    bool swap = first_length > second_length;
+    int n1 = std::min(first_length, second_length);
+    int n2 = n1 > length ? n1 : std::max(n1, length - n1);
+    if (n1 + n2 > length) {
+      n1 = length / 2;
+      n2 = n1 + length % 2;
+    }
+    if (swap) {
+      std::swap(n1, n2);
+    }
+    truncate(encoding, n1, stride, direction);
+    truncate(pair, n2, stride, direction);
+  } else {
+    Encoding* target =
+        strategy == ONLY_SECOND_TRUNCATION_STRATEGY ? pair : encoding;
+    int target_len = target->ids.size();
     if (target_len > to_remove) {
-      encoding = truncate(encoding, max_length, stride, direction);
+      truncate(target, target_len - to_remove, stride, direction);
     }
   }
-  return encoding;
 }
 
 std::unique_ptr<Truncation> with_truncation(
@@ -193,50 +239,66 @@ Padding::Padding(const std::string& direction, const std::string& strategy,
       pad_token(pad_token),
       pad_to_multiple_of(pad_to_multiple_of) {}
 
-Encoding pad(Encoding encoding, int target_length, int pad_id, int pad_type_id,
-             std::string pad_token, PADDING_DIRECTION direction) {
-  std::transform(encoding.overflowing.begin(), encoding.overflowing.end(),
-                 encoding.overflowing.begin(),
-                 [&](const Encoding& overflow_encoding) {
-                   return pad(overflow_encoding, target_length, pad_id,
-                              pad_type_id, pad_token, direction);
-                 });
-  if (encoding.ids.size() >= target_length) {
-    return encoding;
+void pad(Encoding* encoding, int target_length, int pad_id, int pad_type_id,
+         std::string_view pad_token, PADDING_DIRECTION direction) {
+  for (Encoding& overflowing : encoding->overflowing) {
+    pad(&overflowing, target_length, pad_id, pad_type_id, pad_token,
+        direction);
+  }
+  if (encoding->ids.size() >= target_length ||
+      direction == UNKNOWN_PADDING_DIRECTION) {
+    return;
+  }
+  int pad_length = target_length - encoding->ids.size();
+  auto pad_field = [&](auto* values, auto value) {
+    values->insert(direction == LEFT_PADDING_DIRECTION ? values->begin()
+                                                       : values->end(),
+                   pad_length, value);
+  };
+  pad_field(&encoding->ids, pad_id);
+  if (encoding->fields & TYPE_IDS_ENCODE_OPTION) {
+    pad_field(&encoding->type_ids, pad_type_id);
+  }
+  if (encoding->fields & TOKENS_ENCODE_OPTION) {
+    pad_field(&encoding->tokens, pad_token);
+  }
+  if (encoding->fields & WORDS_ENCODE_OPTION) {
+    pad_field(&encoding->words, 0);
+  }
+  if (encoding->fields & ATTENTION_MASK_ENCODE_OPTION) {
+    pad_field(&encoding->attention_mask, 0);
+  }
+  if (encoding->fields & SPECIAL_TOKENS_MASK_ENCODE_OPTION) {
+    pad_field(&encoding->special_tokens_mask, 1);
   }
-  int pad_length = target_length - encoding.ids.size();
-  if (direction == LEFT_PADDING_DIRECTION) {
-    encoding.ids.insert(encoding.ids.begin(), pad_length, pad_id);
-    encoding.type_ids.insert(encoding.type_ids.begin(), pad_length,
-                             pad_type_id);
-    encoding.tokens.insert(encoding.tokens.begin(), pad_length, pad_token);
-    encoding.words.insert(encoding.words.begin(), pad_length, 0);
-    encoding.attention_mask.insert(encoding.attention_mask.begin(), pad_length,
-                                   0);
-    encoding.special_tokens_mask.insert(encoding.special_tokens_mask.begin(),
-                                        pad_length, 1);
-    encoding.offsets.insert(encoding.offsets.begin(), pad_length, {0, 0});
-  } else if (direction == RIGHT_PADDING_DIRECTION) {
-    encoding.ids.insert(encoding.ids.end(), pad_length, pad_id);
-    encoding.type_ids.insert(encoding.type_ids.end(), pad_length, pad_type_id);
-    encoding.tokens.insert(encoding.tokens.end(), pad_length, pad_token);
-    encoding.words.insert(encoding.words.end(), pad_length, 0);
-    encoding.attention_mask.insert(encoding.attention_mask.end(), pad_length,
-                                   0);
-    encoding.special_tokens_mask.insert(encoding.special_tokens_mask.end(),
-                                        pad_length, 1);
-    encoding.offsets.insert(encoding.offsets.end(), pad_length, {0, 0});
+  if (encoding->fields & OFFSETS_ENCODE_OPTION) {
+    pad_field(&encoding->offsets, std::pair<uint32_t, uint32_t>(0, 0));
   }
-  return encoding;
 }
 
-Encoding Padding::pad_encoding(const Encoding& encoding) const {
+void Padding::pad_encoding(Encoding* encoding) const {
   int pad_length =
-      strategy == FIXED_PADDING_STRATEGY ? fixed_size : encoding.ids.size();
+      strategy == FIXED_PADDING_STRATEGY ? fixed_size : encoding->ids.size();
   if (pad_to_multiple_of > 0 && pad_length % pad_to_multiple_of > 0) {
     pad_length += pad_to_multiple_of - pad_length % pad_to_multiple_of;
   }
-  return pad(encoding, pad_length, pad_id, pad_type_id, pad_token, direction);
+  pad(encoding, pad_length, pad_id, pad_type_id, pad_token, direction);
+}
+
+void Padding::pad_encodings(std::vector<Encoding>* encodings) const {
+  int pad_length = fixed_size;
+  if (strategy == BATCH_LONGEST_PADDING_STRATEGY) {
+    pad_length = 0;
+    for (const Encoding& encoding : *encodings) {
+      pad_length = std::max(pad_length, static_cast<int>(encoding.ids.size()));
+    }
+  }
+  if (pad_to_multiple_of > 0 && pad_length % pad_to_multiple_of > 0) {
+    pad_length += pad_to_multiple_of - pad_length % pad_to_multiple_of;
+  }
+  for (Encoding& encoding : *encodings) {
+    pad(&encoding, pad_length, pad_id, pad_type_id, pad_token, direction);
+  }
 }
 
 std::unique_ptr<Padding> with_padding(
@@ -287,6 +349,7 @@ std::unique_ptr<Padding> with_padding(
 std::unordered_map<std::string, int> get_map_ints_from_json(
     simdjson::ondemand::object json_object) {
   std::unordered_map<std::string, int> result;
+  result.reserve(json_object.count_fields());
   for (auto element : json_object) {
     result.insert(
         {std::string(static_cast<std::string_view>(element.escaped_key())),
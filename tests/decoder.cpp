@@ -4,6 +4,7 @@
 #include <gtest/gtest.h>
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -54,6 +55,60 @@ TEST(SequenceDecoderTest, Simple) {
   EXPECT_EQ(expected, got);
 }
 
+TEST(ReplaceDecoderTest, Simple) {
+  std::unique_ptr<Decoder> decoder = get_decoder_from_string(
+      "{\"type\":\"Replace\",\"pattern\":{\"String\":\"▁\"},\"content\":"
+      "\" \"}");
+  EXPECT_NE(decoder, nullptr);
+  std::vector<std::string> input = {"▁Hey", "▁friend", "!", "▁▁"};
+  std::vector<std::string> got = decoder->decode_chain(input);
+  std::vector<std::string> expected = {" Hey", " friend", "!", "  "};
+  EXPECT_EQ(expected, got);
+}
+
+TEST(ByteFallbackDecoderTest, Simple) {
+  std::unique_ptr<Decoder> decoder =
+      get_decoder_from_string("{\"type\":\"ByteFallback\"}");
+  EXPECT_NE(decoder, nullptr);
+  std::vector<std::string> input = {"<0xE5>", "<0x8f>", "<0xab>", "a"};
+  std::vector<std::string> expected = {"叫", "a"};
+  EXPECT_EQ(expected, decoder->decode_chain(input));
+  input = {"<0xE5>", "<0x8f>", "a", "<0x61>"};
+  expected = {"\uFFFD", "\uFFFD", "a", "a"};
+  EXPECT_EQ(expected, decoder->decode_chain(input));
+}
+
+TEST(FuseDecoderTest, Simple) {
+  std::unique_ptr<Decoder> decoder =
+      get_decoder_from_string("{\"type\":\"Fuse\"}");
+  EXPECT_NE(decoder, nullptr);
+  std::vector<std::string> input = {"Hey", " friend!"};
+  std::vector<std::string> expected = {"Hey friend!"};
+  EXPECT_EQ(expected, decoder->decode_chain(input));
+}
+
+TEST(StripDecoderTest, Simple) {
+  std::unique_ptr<Decoder> decoder = get_decoder_from_string(
+      "{\"type\":\"Strip\",\"content\":\"H\",\"start\":1,\"stop\":0}");
+  EXPECT_NE(decoder, nullptr);
+  std::vector<std::string> input = {"Hey", " friend!", "HH"};
+  std::vector<std::string> expected = {"ey", " friend!", "H"};
+  EXPECT_EQ(expected, decoder->decode_chain(input));
+}
+
+TEST(SequenceDecoderTest, Llama) {
+  std::unique_ptr<Decoder> decoder = get_decoder_from_string(
+      "{\"type\":\"Sequence\",\"decoders\":[{\"type\":\"Replace\","
+      "\"pattern\":{\"String\":\"▁\"},\"content\":\" \"},{\"type\":"
+      "\"ByteFallback\"},{\"type\":\"Fuse\"},{\"type\":\"Strip\","
+      "\"content\":\" \",\"start\":1,\"stop\":0}]}");
+  EXPECT_NE(decoder, nullptr);
+  std::vector<std::string> input = {"▁Hey", "▁friend", "<0x21>", "▁",
+                                    "<0xE5>", "<0x8F>", "<0xAB>"};
+  std::vector<std::string> expected = {"Hey friend! 叫"};
+  EXPECT_EQ(expected, decoder->decode_chain(input));
+}
+
 TEST(ByteLevelDecoderTest, Simple) {
   std::unique_ptr<Decoder> decoder =
       get_decoder_from_string("{\"type\":\"ByteLevel\"}");
@@ -62,4 +117,89 @@ TEST(ByteLevelDecoderTest, Simple) {
   std::vector<std::string> got = decoder->decode_chain(input);
   std::vector<std::string> expected = {"How are ya doing?"};
   EXPECT_EQ(expected, got);
+  input = {"ĠçŁ", "¥", "éģĵ", "ĠçŁ"};
+  expected = {" 知道 \uFFFD"};
+  EXPECT_EQ(expected, decoder->decode_chain(input));
+}
+
+TEST(MetaspaceDecoderTest, Simple) {
+  std::unique_ptr<Decoder> decoder = get_decoder_from_string(
+      "{\"type\":\"Metaspace\",\"replacement\":\"▁\",\"prepend_scheme\":"
+      "\"always\",\"split\":true}");
+  EXPECT_NE(decoder, nullptr);
+  std::vector<std::string> input = {"▁Hey", "▁friend", "!", "▁▁"};
+  std::vector<std::string> got = decoder->decode_chain(input);
+  std::vector<std::string> expected = {"Hey", " friend", "!", "  "};
+  EXPECT_EQ(expected, got);
+  decoder = get_decoder_from_string(
+      "{\"type\":\"Metaspace\",\"replacement\":\"▁\",\"prepend_scheme\":"
+      "\"never\",\"split\":true}");
+  got = decoder->decode_chain(input);
+  expected = {" Hey", " friend", "!", "  "};
+  EXPECT_EQ(expected, got);
+}
+
+TEST(DecodeTableTest, Simple) {
+  std::unique_ptr<Decoder> decoder = get_decoder_from_string(
+      "{\"type\":\"Sequence\",\"decoders\":[{\"type\":\"Replace\","
+      "\"pattern\":{\"String\":\"▁\"},\"content\":\" \"},{\"type\":"
+      "\"ByteFallback\"},{\"type\":\"Fuse\"},{\"type\":\"Strip\","
+      "\"content\":\" \",\"start\":1,\"stop\":0}]}");
+  std::vector<std::optional<std::string>> tokens = {
+      "<s>",    "▁Hey",   "▁friend", "<0x21>", "▁",
+      "<0xE5>", "<0x8F>", "<0xAB>",  std::nullopt};
+  std::vector<bool> special = {true};
+  DecodeTable table(decoder.get(), tokens, special);
+  EXPECT_TRUE(table.is_enabled());
+  EXPECT_EQ("Hey friend! 叫", table.decode({0, 1, 2, 3, 4, 5, 6, 7}));
+  EXPECT_EQ("<s> Hey", table.decode({0, 1}, false));
+  EXPECT_EQ("�� friend", table.decode({5, 6, 8, 2}));
+  decoder = get_decoder_from_string(
+      "{\"type\":\"WordPiece\",\"prefix\":\"##\",\"cleanup\":true}");
+  tokens = {"##o", "hell", "n't", "do"};
+  table = DecodeTable(decoder.get(), tokens, {});
+  EXPECT_EQ("##o hello don't", table.decode({0, 1, 0, 3, 2}));
+  decoder = get_decoder_from_string(
+      "{\"type\":\"Sequence\",\"decoders\":[{\"type\":\"ByteFallback\"},{"
+      "\"type\":\"Strip\",\"content\":\" \",\"start\":1,\"stop\":0}]}");
+  table = DecodeTable(decoder.get(), tokens, {});
+  EXPECT_FALSE(table.is_enabled());
+}
+
+TEST(StopSequenceMatcherTest, Simple) {
+  StopSequenceMatcher matcher({"</s>", "s>", "\n\nUser:", ""});
+  std::vector<std::string> texts = {"Hello", " <", "/", "s> more"};
+  std::optional<StopMatch> match;
+  for (int i = 0; i < texts.size() && !match.has_value(); i++) {
+    match = matcher.feed(texts[i], i);
+  }
+  EXPECT_TRUE(match.has_value());
+  EXPECT_EQ(0, match->stop);
+  EXPECT_EQ(3, match->token);
+  EXPECT_EQ(6, match->start);
+  EXPECT_EQ(10, match->end);
+  matcher.reset();
+  EXPECT_FALSE(matcher.feed("Sure.\n\nUse", 0).has_value());
+  match = matcher.feed("r: hi", 1);
+  EXPECT_EQ(2, match->stop);
+  EXPECT_EQ(5, match->start);
+  EXPECT_EQ(12, match->end);
+}
+
+TEST(VocabularyIndexTest, Simple) {
+  std::unique_ptr<Decoder> decoder =
+      get_decoder_from_string("{\"type\":\"ByteLevel\"}");
+  std::vector<std::optional<std::string>> tokens = {
+      "Ġ", "Ġf", "Ġfr", "Ġfriend", "fr", "ĠçŁ", std::nullopt, "Ġfo"};
+  DecodeTable table(decoder.get(), tokens, {});
+  VocabularyIndex index(table);
+  std::vector<bool> expected = {false, true, true, true,
+                                false, false, false, true};
+  EXPECT_EQ(expected, index.starting_with(" f"));
+  expected = {true, true, true, false, false, false, false, false};
+  EXPECT_EQ(expected, index.prefixes_of(" fri"));
+  expected = {true, false, false, false, false, true, false, false};
+  EXPECT_EQ(expected, index.prefixes_of(" 知"));
+  expected = std::vector<bool>(8);
+  EXPECT_EQ(expected, index.starting_with("x"));
 }
@@ -4,8 +4,11 @@
 #include <gtest/gtest.h>
 
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "simdjson.h"
@@ -27,6 +30,35 @@ void assert_tokens(std::vector<Token> expected, std::vector<Token> got) {
   }
 }
 
+TEST(VocabTest, Tables) {
+  Vocab vocab(std::vector<std::pair<std::string_view, int>>(
+      {{"a", 0}, {"bc", 2}, {"", 3}, {"a", 5}, {"neg", -1}}));
+  EXPECT_EQ(4, vocab.size());
+  EXPECT_EQ(6, vocab.id_count());
+  EXPECT_EQ(0, vocab.find("a"));
+  EXPECT_EQ(3, vocab.find(""));
+  EXPECT_EQ(-1, vocab.find("neg"));
+  EXPECT_EQ(std::nullopt, vocab.find("b"));
+  EXPECT_EQ("bc", vocab.token(2));
+  EXPECT_EQ(std::nullopt, vocab.token(1));
+  EXPECT_EQ(std::nullopt, vocab.token(5));
+  // views of the blob, as mapped from a binary file
+  std::string_view blob = vocab.blob();
+  Vocab view(blob.data(), blob.size(), nullptr);
+  EXPECT_EQ(2, view.find("bc"));
+  EXPECT_THROW(Vocab(blob.data(), blob.size() - 1, nullptr),
+               std::runtime_error);
+  MergeTable merges({{0, 2, 0, 7}, {2, 0, 1, 8}, {0, 2, 2, 9}});
+  EXPECT_EQ(2, merges.size());
+  EXPECT_EQ(7, merges.find(0, 2)->new_id);
+  EXPECT_EQ(1, merges.find(2, 0)->rank);
+  EXPECT_EQ(nullptr, merges.find(0, 0));
+  blob = merges.blob();
+  MergeTable merges_view(blob.data(), blob.size(), nullptr);
+  EXPECT_EQ(8, merges_view.find(2, 0)->new_id);
+  EXPECT_THROW(MergeTable(blob.data(), 4, nullptr), std::runtime_error);
+}
+
 TEST(WordPieceModelTest, EmptyVocab) {
   std::unique_ptr<Model> model = get_model_from_string(
       "{\"type\":\"WordPiece\",\"unk_token\":\"[UNK]\",\"continuing_subword_"
@@ -148,6 +180,29 @@ TEST(BPEModelTest, UNKTokenFused) {
   assert_tokens(expected, got.splits[0].tokens);
 }
 
+TEST(BPEModelTest, ByteFallbackOffsets) {
+  std::unique_ptr<Model> model = get_model_from_string(
+      "{\"type\":\"BPE\",\"dropout\":null,\"unk_token\":\"<unk>\","
+      "\"continuing_subword_prefix\":null,\"end_of_word_suffix\":null,\"fuse_"
+      "unk\":true,\"byte_fallback\":true,\"ignore_merges\":false,\"vocab\":{"
+      "\"<unk>\":0,\"a\":1,\"b\":2,\" \":3,\"<0xE2>\":4,\"<0x82>\":5,"
+      "\"<0xAC>\":6,\"<0xF0>\":7,\"<0x9F>\":8,\"<0x98>\":9,\"<0x80>\":10},"
+      "\"merges\":[]}");
+  EXPECT_NE(model, nullptr);
+  // bytes of a character all map to it
+  std::wstring input = L"€a \U0001F600b\u00e7\u00e7";
+  std::vector<Token> expected = {
+      Token(4, "<0xE2>", {0, 1}),  Token(5, "<0x82>", {0, 1}),
+      Token(6, "<0xAC>", {0, 1}),  Token(1, "a", {1, 2}),
+      Token(3, " ", {2, 3}),       Token(7, "<0xF0>", {3, 5}),
+      Token(8, "<0x9F>", {3, 5}),  Token(9, "<0x98>", {3, 5}),
+      Token(10, "<0x80>", {3, 5}), Token(2, "b", {5, 6}),
+      Token(0, "<unk>", {6, 8}),
+  };
+  auto got = model->tokenize(PreTokenizedString(NormalizedString(input)));
+  assert_tokens(expected, got.splits[0].tokens);
+}
+
 TEST(BPEModelTest, WithAndWithoutDropout) {
   std::unique_ptr<Model> model = get_model_from_string(
       "{\"type\":\"BPE\",\"dropout\":null,\"unk_token\":null,"
@@ -164,6 +219,17 @@ TEST(BPEModelTest, WithAndWithoutDropout) {
   };
   auto got = model->tokenize(PreTokenizedString(NormalizedString(input)));
   assert_tokens(expected, got.splits[0].tokens);
+  // word outgrowing the scratch arena, too long to be cached
+  input.clear();
+  expected.clear();
+  for (int i = 0; i < 1000; i++) {
+    input += L"unrelated";
+    expected.push_back(Token(15, "unrelated", {i * 9, i * 9 + 9}));
+  }
+  got = model->tokenize(PreTokenizedString(NormalizedString(input)));
+  assert_tokens(expected, got.splits[0].tokens);
+  got = model->tokenize(PreTokenizedString(NormalizedString(input)));
+  assert_tokens(expected, got.splits[0].tokens);
   model = get_model_from_string(
       "{\"type\":\"BPE\",\"dropout\":1.0,\"unk_token\":null,"
       "\"continuing_subword_prefix\":null,\"end_of_word_suffix\":null,\"fuse_"
@@ -182,3 +248,57 @@ TEST(BPEModelTest, WithAndWithoutDropout) {
   got = model->tokenize(PreTokenizedString(NormalizedString(input)));
   assert_tokens(expected, got.splits[0].tokens);
 }
+
+TEST(BPEModelTest, MergePairs) {
+  // merges of parts with spaces, given as pairs
+  std::unique_ptr<Model> model = get_model_from_string(
+      "{\"type\":\"BPE\",\"dropout\":null,\"unk_token\":null,"
+      "\"continuing_subword_prefix\":null,\"end_of_word_suffix\":null,\"fuse_"
+      "unk\":false,\"byte_fallback\":false,\"ignore_merges\":false,\"vocab\":{"
+      "\"a\":0,\"b\":1,\" \":2,\"a \":3,\"a b\":4,\"bb\":5},\"merges\":[[\"a\","
+      "\" \"],[\"a \",\"b\"],\"b  b\"]}");
+  EXPECT_NE(model, nullptr);
+  auto got = model->tokenize(PreTokenizedString(NormalizedString(L"a b")));
+  assert_tokens({Token(4, "a b", {0, 3})}, got.splits[0].tokens);
+  got = model->tokenize(PreTokenizedString(NormalizedString(L"bb")));
+  assert_tokens({Token(5, "bb", {0, 2})}, got.splits[0].tokens);
+}
+
+TEST(BPEModelTest, ParallelMerges) {
+  // enough merges to resolve on two threads, the first half of unknown tokens
+  // and the second building every token of up to three letters
+  std::vector<std::string> tokens;
+  for (char c = 'a'; c <= 'z'; c++) {
+    tokens.push_back(std::string(1, c));
+  }
+  std::string merges = "\"0 0\"";
+  for (int i = 1; i < 20000; i++) {
+    merges += ",\"" + std::to_string(i) + " " + std::to_string(i) + "\"";
+  }
+  for (int i = 0; tokens.size() < 26 + 26 * 26 + 26 * 26 * 26; i++) {
+    for (char c = 'a'; c <= 'z'; c++) {
+      merges += ",\"" + tokens[i] + " " + c + "\"";
+      tokens.push_back(tokens[i] + c);
+    }
+  }
+  std::string vocab;
+  for (int i = 0; i < tokens.size(); i++) {
+    vocab += (i == 0 ? "\"" : ",\"") + tokens[i] + "\":" + std::to_string(i);
+  }
+  std::string json = "{\"type\":\"BPE\",\"vocab\":{" + vocab +
+                     "},\"merges\":[" + merges + "]}";
+  std::vector<std::unique_ptr<Model>> models;
+  for (int num_threads : {1, 2}) {
+    simdjson::ondemand::parser parser;
+    simdjson::padded_string padded_json(json);
+    simdjson::ondemand::document doc = parser.iterate(padded_json);
+    models.push_back(
+        with_model(doc.get_object().value(), nullptr, nullptr, num_threads));
+  }
+  for (const std::unique_ptr<Model> &model : models) {
+    auto got = model->tokenize(PreTokenizedString(NormalizedString(L"ab")));
+    assert_tokens({Token(27, "ab", {0, 2})}, got.splits[0].tokens);
+    got = model->tokenize(PreTokenizedString(NormalizedString(L"zza")));
+    assert_tokens({Token(18252, "zza", {0, 3})}, got.splits[0].tokens);
+  }
+}
@@ -164,6 +164,19 @@ TEST(ReplaceNormalizerTest, ReplaceContent) {
   EXPECT_EQ(L"Hello▁World!", normalized.normalized);
 }
 
+TEST(ReplaceNormalizerTest, Literal) {
+  std::unique_ptr<Normalizer> normalizer = get_normalizer_from_string(
+      "{\"type\":\"Replace\",\"pattern\":{\"String\":\"..\"},"
+      "\"content\":\"▁\"}");
+  EXPECT_NE(normalizer, nullptr);
+  auto normalized = normalizer->normalize(NormalizedString(L"a..b.c"));
+  EXPECT_EQ(L"a▁b.c", normalized.normalized);
+  std::vector<std::pair<int, int>> expected = {{0, 1}, {1, 3}, {1, 3},
+                                               {1, 3}, {3, 4}, {4, 5},
+                                               {5, 6}};
+  EXPECT_EQ(expected, normalized.offsets);
+}
+
 TEST(StripNormalizerTest, Simple) {
   std::unique_ptr<Normalizer> normalizer = get_normalizer_from_string(
       "{\"type\":\"Strip\",\"strip_left\":true,\"strip_right\":true}");
@@ -0,0 +1,139 @@
+// Copyright 2024 Omkar Prabhu
+#include "tokenizers/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Tokens with their split index and offsets mapped back to the sequence.
+std::vector<std::tuple<int, std::string, std::pair<int, int>, int>>
+resolve_tokens(const PreTokenizedString &pre_tokenized) {
+  std::vector<std::tuple<int, std::string, std::pair<int, int>, int>> result;
+  for (int i = 0; i < pre_tokenized.splits.size(); i++) {
+    const Split &split = pre_tokenized.splits[i];
+    for (const Token &token : split.tokens) {
+      result.push_back(
+          {token.id, token.value,
+           original_offsets(pre_tokenized.normalized,
+                            split.offsets.first + token.offsets.first,
+                            split.offsets.first + token.offsets.second),
+           i});
+    }
+  }
+  return result;
+}
+
+void assert_pipeline_parity(const Pipeline &expected, const Pipeline &got,
+                            const std::vector<std::wstring> &inputs,
+                            const AddedVocabulary *added_vocabulary) {
+  for (const std::wstring &input : inputs) {
+    EXPECT_EQ(
+        resolve_tokens(expected.tokenize(input, added_vocabulary, true)),
+        resolve_tokens(got.tokenize(input, added_vocabulary, true)));
+    Encoding expected_encoding({1, 2}, {0, 0}, {"a", "b"}, {0, 1},
+                               {{0, 1}, {1, 3}}, {0, 0}, {1, 1});
+    Encoding got_encoding = expected_encoding;
+    expected.process(&expected_encoding, true);
+    got.process(&got_encoding, true);
+    EXPECT_EQ(expected_encoding.ids, got_encoding.ids);
+    EXPECT_EQ(expected_encoding.type_ids, got_encoding.type_ids);
+    EXPECT_EQ(expected_encoding.tokens, got_encoding.tokens);
+    EXPECT_EQ(expected_encoding.offsets, got_encoding.offsets);
+  }
+}
+
+TEST(PipelineTest, Bert) {
+  BertNormalizer normalizer;
+  BertPreTokenizer pre_tokenizer;
+  WordPiece model({{"[UNK]", 0}, {"hello", 1}, {"world", 2}, {"##s", 3},
+                   {"!", 4}, {"[CLS]", 5}, {"[SEP]", 6}});
+  BertProcessing post_processor({"[SEP]", 6}, {"[CLS]", 5});
+  AddedVocabulary added_vocabulary(
+      {AddedToken(5, "[CLS]", false, false, false, false, true)});
+  std::vector<std::wstring> inputs = {L"Hello Worlds!", L"HELLO\tworld",
+                                      L"x y", L"[CLS] hello[CLS]"};
+  DynamicPipeline dynamic(&normalizer, &pre_tokenizer, &model,
+                          &post_processor);
+  EXPECT_EQ(DYNAMIC_PIPELINE, dynamic.type());
+  StaticPipeline<BertNormalizer, BertPreTokenizer, WordPiece, BertProcessing>
+      static_pipeline(BERT_PROCESSING_PIPELINE, &normalizer, &pre_tokenizer,
+                      &model, &post_processor);
+  assert_pipeline_parity(dynamic, static_pipeline, inputs, &added_vocabulary);
+  std::unique_ptr<Pipeline> pipeline =
+      make_pipeline(&normalizer, &pre_tokenizer, &model, &post_processor);
+  EXPECT_EQ(FUSED_BERT_PIPELINE, pipeline->type());
+  assert_pipeline_parity(dynamic, *pipeline, inputs, &added_vocabulary);
+  assert_pipeline_parity(dynamic, *pipeline, inputs, nullptr);
+  // offsets of characters removed, decomposed or isolated by the normalizer
+  std::vector<std::tuple<int, std::string, std::pair<int, int>, int>>
+      expected = {{0, "[UNK]", {1, 2}, 0},
+                  {1, "hello", {2, 7}, 1},
+                  {4, "!", {7, 8}, 2}};
+  EXPECT_EQ(expected, resolve_tokens(pipeline->tokenize(
+                          L"\u0001中HÉllo!", &added_vocabulary, true)));
+  pipeline = make_pipeline(nullptr, &pre_tokenizer, &model, &post_processor);
+  EXPECT_EQ(DYNAMIC_PIPELINE, pipeline->type());
+}
+
+TEST(PipelineTest, ByteLevel) {
+  ByteLevelPreTokenizer pre_tokenizer(false, true);
+  BPE model({{"h", 0}, {"e", 1}, {"l", 2}, {"o", 3}, {"Ġ", 4}, {"he", 5},
+             {"ll", 6}, {"hell", 7}, {"hello", 8}, {"Ã", 9}, {"©", 10}},
+            {"h e", "l l", "he ll", "hell o"}, 0.0f, "", "", "", false, false,
+            false);
+  ByteLevelProcessing post_processor(false, true);
+  AddedVocabulary added_vocabulary(
+      {AddedToken(11, "<s>", false, false, false, true, true)});
+  std::vector<std::wstring> inputs = {L"hello hello", L"hell", L"héllo  é",
+                                      L"<s>hello <s>"};
+  DynamicPipeline dynamic(nullptr, &pre_tokenizer, &model, &post_processor);
+  StaticPipeline<void, ByteLevelPreTokenizer, BPE, ByteLevelProcessing>
+      static_pipeline(BYTE_LEVEL_PIPELINE, nullptr, &pre_tokenizer, &model,
+                      &post_processor);
+  assert_pipeline_parity(dynamic, static_pipeline, inputs, &added_vocabulary);
+  std::unique_ptr<Pipeline> pipeline =
+      make_pipeline(nullptr, &pre_tokenizer, &model, &post_processor);
+  EXPECT_EQ(FUSED_BYTE_LEVEL_PIPELINE, pipeline->type());
+  assert_pipeline_parity(dynamic, *pipeline, inputs, &added_vocabulary);
+  assert_pipeline_parity(dynamic, *pipeline, inputs, nullptr);
+  // regex Split ahead of a ByteLevel without its own regex
+  std::vector<std::unique_ptr<PreTokenizer>> pretokenizers;
+  pretokenizers.push_back(std::make_unique<SplitPreTokenizer>(
+      "\\p{L}+|\\s+|[^\\s\\p{L}]+", "Isolated", false));
+  pretokenizers.push_back(
+      std::make_unique<ByteLevelPreTokenizer>(false, false));
+  SequencePreTokenizer sequence_pre_tokenizer(std::move(pretokenizers));
+  DynamicPipeline sequence_dynamic(nullptr, &sequence_pre_tokenizer, &model,
+                                   &post_processor);
+  pipeline =
+      make_pipeline(nullptr, &sequence_pre_tokenizer, &model, &post_processor);
+  EXPECT_EQ(FUSED_BYTE_LEVEL_PIPELINE, pipeline->type());
+  assert_pipeline_parity(sequence_dynamic, *pipeline, inputs,
+                         &added_vocabulary);
+}
+
+TEST(PipelineTest, SentencePiece) {
+  std::vector<std::unique_ptr<Normalizer>> normalizers;
+  normalizers.push_back(std::make_unique<Prepend>("▁"));
+  normalizers.push_back(std::make_unique<Replace>(" ", "▁"));
+  SequenceNormalizer normalizer(std::move(normalizers));
+  BPE model({{"<unk>", 0}, {"▁", 1}, {"h", 2}, {"e", 3}, {"l", 4}, {"o", 5},
+             {"▁h", 6}, {"el", 7}, {"▁hel", 8}, {"<0xC3>", 9},
+             {"<0xA9>", 10}},
+            {"▁ h", "e l", "▁h el"}, 0.0f, "<unk>", "", "", true, true, false);
+  AddedVocabulary added_vocabulary(
+      {AddedToken(11, "<s>", false, false, false, false, true)});
+  std::vector<std::wstring> inputs = {L"hello", L" hello  hé", L"xx hello",
+                                      L"<s>hello<s> hel"};
+  DynamicPipeline dynamic(&normalizer, nullptr, &model, nullptr);
+  std::unique_ptr<Pipeline> pipeline =
+      make_pipeline(&normalizer, nullptr, &model, nullptr);
+  EXPECT_EQ(FUSED_SENTENCE_PIECE_PIPELINE, pipeline->type());
+  assert_pipeline_parity(dynamic, *pipeline, inputs, &added_vocabulary);
+  assert_pipeline_parity(dynamic, *pipeline, inputs, nullptr);
+}
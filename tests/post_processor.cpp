@@ -47,10 +47,20 @@ TEST(TemplateProcessingTest, AddSpecialTokens) {
                           {{0, 5}, {6, 11}}, {0, 0}, {1, 1});
   Encoding expected(
       {101, 12, 14, 102}, {0, 0, 0, 0}, {"[CLS]", "hello", "world", "[SEP]"},
-      {std::nullopt, 0, 0, std::nullopt}, {{0, 0}, {0, 5}, {6, 11}, {0, 0}},
+      {NO_WORD, 0, 0, NO_WORD}, {{0, 0}, {0, 5}, {6, 11}, {0, 0}},
       {1, 0, 0, 1}, {1, 1, 1, 1});
-  Encoding got = post_processor->process(input_encoding, true);
+  Encoding got = input_encoding;
+  post_processor->process(&got, true);
   assert_post_processor_encoding(expected, got);
+  input_encoding.overflowing = {Encoding({16}, {0}, {"!"}, {1}, {{11, 12}},
+                                         {0}, {1})};
+  got = input_encoding;
+  post_processor->process(&got, true);
+  EXPECT_EQ(1, got.overflowing.size());
+  expected = Encoding({101, 16, 102}, {0, 0, 0}, {"[CLS]", "!", "[SEP]"},
+                      {NO_WORD, 1, NO_WORD},
+                      {{0, 0}, {11, 12}, {0, 0}}, {1, 0, 1}, {1, 1, 1});
+  assert_post_processor_encoding(expected, got.overflowing[0]);
 }
 
 TEST(TemplateProcessingTest, WithoutSpecialTokens) {
@@ -71,7 +81,58 @@ TEST(TemplateProcessingTest, WithoutSpecialTokens) {
                           {{0, 5}, {6, 11}}, {0, 0}, {1, 1});
   Encoding expected({12, 14}, {0, 0}, {"hello", "world"}, {0, 0},
                     {{0, 5}, {6, 11}}, {0, 0}, {1, 1});
-  Encoding got = post_processor->process(input_encoding, false);
+  Encoding got = input_encoding;
+  post_processor->process(&got, false);
+  assert_post_processor_encoding(expected, got);
+}
+
+TEST(TemplateProcessingTest, MissingSpecialToken) {
+  EXPECT_THROW(get_post_processor_from_string(
+                   "{\"type\":\"TemplateProcessing\",\"single\":[{"
+                   "\"SpecialToken\":{\"id\":\"[CLS]\",\"type_id\":0}},{"
+                   "\"Sequence\":{\"id\":\"A\",\"type_id\":0}}],\"pair\":[{"
+                   "\"Sequence\":{\"id\":\"A\",\"type_id\":0}},{\"Sequence\":{"
+                   "\"id\":\"B\",\"type_id\":1}}],\"special_tokens\":{}}"),
+               std::invalid_argument);
+}
+
+TEST(BertProcessingTest, AddSpecialTokens) {
+  std::unique_ptr<PostProcessor> post_processor =
+      get_post_processor_from_string(
+          "{\"type\":\"BertProcessing\",\"sep\":[\"[SEP]\",102],\"cls\":[\"["
+          "CLS]\",101]}");
+  EXPECT_NE(post_processor, nullptr);
+  EXPECT_EQ(3, post_processor->added_tokens(true));
+  std::vector<Encoding> encodings = post_processor->process_encodings(
+      {Encoding({12}, {0}, {"hello"}, {0}, {{0, 5}}, {0}, {1}),
+       Encoding({14}, {1}, {"world"}, {0}, {{0, 5}}, {0}, {1})},
+      true);
+  EXPECT_EQ(2, encodings.size());
+  Encoding expected({101, 12, 102}, {0, 0, 0}, {"[CLS]", "hello", "[SEP]"},
+                    {NO_WORD, 0, NO_WORD}, {{0, 0}, {0, 5}, {0, 0}},
+                    {1, 0, 1}, {1, 1, 1});
+  assert_post_processor_encoding(expected, encodings[0]);
+  expected = Encoding({14, 102}, {1, 1}, {"world", "[SEP]"}, {0, NO_WORD},
+                      {{0, 5}, {0, 0}}, {0, 1}, {1, 1});
+  assert_post_processor_encoding(expected, encodings[1]);
+}
+
+TEST(RobertaProcessingTest, TrimOffsets) {
+  std::unique_ptr<PostProcessor> post_processor =
+      get_post_processor_from_string(
+          "{\"type\":\"RobertaProcessing\",\"sep\":[\"</s>\",2],\"cls\":[\"<s>"
+          "\",0],\"trim_offsets\":true,\"add_prefix_space\":true}");
+  EXPECT_NE(post_processor, nullptr);
+  EXPECT_EQ(4, post_processor->added_tokens(true));
+  Encoding input_encoding({12, 14}, {0, 0}, {"Ġhello", "Ġworld"}, {0, 1},
+                          {{0, 6}, {6, 12}}, {0, 0}, {1, 1});
+  Encoding expected({0, 12, 14, 2}, {0, 0, 0, 0},
+                    {"<s>", "Ġhello", "Ġworld", "</s>"},
+                    {NO_WORD, 0, 1, NO_WORD},
+                    {{0, 0}, {0, 6}, {7, 12}, {0, 0}}, {1, 0, 0, 1},
+                    {1, 1, 1, 1});
+  Encoding got = input_encoding;
+  post_processor->process(&got, true);
   assert_post_processor_encoding(expected, got);
 }
 
@@ -87,7 +148,8 @@ TEST(ByteLevelProcessingTest, AddPrefixSpace) {
   Encoding expected({0, 1, 2, 3, 4}, {},
                     {"Ġ", "ĠĠĠĠHelloĠĠ", "ĠĠHello", "HelloĠĠ", "ĠĠĠĠ"}, {},
                     {{0, 1}, {0, 11}, {11, 18}, {18, 25}, {25, 29}}, {}, {});
-  Encoding got = post_processor->process(input_encoding, false);
+  Encoding got = input_encoding;
+  post_processor->process(&got, false);
   assert_post_processor_encoding(expected, got);
 }
 
@@ -103,6 +165,12 @@ TEST(ByteLevelProcessingTest, TrimOffsets) {
   Encoding expected({0, 1, 2, 3, 4}, {},
                     {"Ġ", "ĠĠĠĠHelloĠĠ", "ĠĠHello", "HelloĠĠ", "ĠĠĠĠ"}, {},
                     {{1, 1}, {4, 9}, {13, 18}, {18, 23}, {29, 29}}, {}, {});
-  Encoding got = post_processor->process(input_encoding, false);
+  Encoding got = input_encoding;
+  post_processor->process(&got, false);
+  assert_post_processor_encoding(expected, got);
+  post_processor->set_vocabulary(
+      {"Ġ", "ĠĠĠĠHelloĠĠ", "ĠĠHello", "HelloĠĠ", "ĠĠĠĠ"});
+  got = input_encoding;
+  post_processor->process(&got, false);
   assert_post_processor_encoding(expected, got);
 }
@@ -67,6 +67,25 @@ TEST(SplitPreTokenizerTest, Simple) {
   validate_splits(expected, got.splits);
 }
 
+TEST(SplitPreTokenizerTest, String) {
+  std::unique_ptr<PreTokenizer> pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Split\",\"pattern\":{\"String\":\"▁\"},\"behavior\":"
+      "\"MergedWithNext\",\"invert\":false}");
+  EXPECT_NE(pre_tokenizer, nullptr);
+  std::vector<Split> expected = {Split("▁Hey", {0, 4}),
+                                 Split("▁friend", {4, 11}), Split("▁", {11, 12})};
+  auto got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"▁Hey▁friend▁")));
+  validate_splits(expected, got.splits);
+  pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Split\",\"pattern\":{\"String\":\".*\"},\"behavior\":"
+      "\"Removed\",\"invert\":true}");
+  expected = {Split(".*", {3, 5})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey.*you")));
+  validate_splits(expected, got.splits);
+}
+
 TEST(ByteLevelPreTokenizerTest, Simple) {
   std::unique_ptr<PreTokenizer> pre_tokenizer = get_pre_tokenizer_from_string(
       "{\"type\":\"ByteLevel\",\"add_prefix_space\":false,\"use_regex\":"
@@ -105,3 +124,171 @@ TEST(SequencePreTokenizerTest, Simple) {
       PreTokenizedString(NormalizedString(L"How are ya doing?")));
   validate_splits(expected, got.splits);
 }
+
+TEST(WhitespacePreTokenizerTest, Simple) {
+  std::unique_ptr<PreTokenizer> pre_tokenizer =
+      get_pre_tokenizer_from_string("{\"type\":\"Whitespace\"}");
+  EXPECT_NE(pre_tokenizer, nullptr);
+  std::vector<Split> expected = {
+      Split("How", {0, 3}), Split("are", {4, 7}), Split("you", {8, 11}),
+      Split("doing", {12, 17}), Split("?", {17, 18})};
+  auto got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"How are you doing?")));
+  validate_splits(expected, got.splits);
+  expected = {Split("Hey", {0, 3}), Split("man", {4, 7}),
+              Split("!?,", {7, 10}), Split("héllo", {11, 16})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey man!?,\théllo")));
+  validate_splits(expected, got.splits);
+}
+
+TEST(WhitespaceSplitPreTokenizerTest, Simple) {
+  std::unique_ptr<PreTokenizer> pre_tokenizer =
+      get_pre_tokenizer_from_string("{\"type\":\"WhitespaceSplit\"}");
+  EXPECT_NE(pre_tokenizer, nullptr);
+  std::vector<Split> expected = {Split("Hey", {0, 3}), Split("man!", {4, 8}),
+                                 Split("野口", {10, 12})};
+  auto got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey man!　 野口")));
+  validate_splits(expected, got.splits);
+}
+
+TEST(PunctuationPreTokenizerTest, Behaviors) {
+  std::unique_ptr<PreTokenizer> pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Punctuation\",\"behavior\":\"Isolated\"}");
+  EXPECT_NE(pre_tokenizer, nullptr);
+  std::vector<Split> expected = {
+      Split("Hey friend", {0, 10}), Split("!", {10, 11}),
+      Split("     How are you", {11, 27}), Split("?", {27, 28}),
+      Split("!", {28, 29}), Split("?", {29, 30})};
+  auto got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey friend!     How are you?!?")));
+  validate_splits(expected, got.splits);
+  pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Punctuation\",\"behavior\":\"MergedWithPrevious\"}");
+  expected = {Split("Hey friend!", {0, 11}),
+              Split("     How are you?", {11, 28}), Split("!", {28, 29}),
+              Split("?", {29, 30})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey friend!     How are you?!?")));
+  validate_splits(expected, got.splits);
+  pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Punctuation\",\"behavior\":\"MergedWithNext\"}");
+  expected = {Split("the", {0, 3}), Split("-final", {3, 9}),
+              Split("-", {9, 10}), Split("-countdown", {10, 20})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"the-final--countdown")));
+  validate_splits(expected, got.splits);
+  pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Punctuation\",\"behavior\":\"Contiguous\"}");
+  expected = {Split("the", {0, 3}), Split("-", {3, 4}),
+              Split("final", {4, 9}), Split("--", {9, 11}),
+              Split("countdown", {11, 20})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"the-final--countdown")));
+  validate_splits(expected, got.splits);
+  pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Punctuation\",\"behavior\":\"Removed\"}");
+  expected = {Split("the", {0, 3}), Split("final", {4, 9}),
+              Split("countdown", {11, 20})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"the-final--countdown")));
+  validate_splits(expected, got.splits);
+}
+
+TEST(DigitsPreTokenizerTest, Simple) {
+  std::unique_ptr<PreTokenizer> pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Digits\",\"individual_digits\":false}");
+  EXPECT_NE(pre_tokenizer, nullptr);
+  std::vector<Split> expected = {Split("Hey ", {0, 4}), Split("123", {4, 7}),
+                                 Split(" friend!", {7, 15})};
+  auto got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey 123 friend!")));
+  validate_splits(expected, got.splits);
+  pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Digits\",\"individual_digits\":true}");
+  expected = {Split("Hey ", {0, 4}), Split("1", {4, 5}), Split("2", {5, 6}),
+              Split("3", {6, 7}), Split(" friend!", {7, 15})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey 123 friend!")));
+  validate_splits(expected, got.splits);
+}
+
+TEST(UnicodeScriptsPreTokenizerTest, Simple) {
+  std::unique_ptr<PreTokenizer> pre_tokenizer =
+      get_pre_tokenizer_from_string("{\"type\":\"UnicodeScripts\"}");
+  EXPECT_NE(pre_tokenizer, nullptr);
+  std::vector<Split> expected = {
+      Split("Hey friend", {0, 10}), Split("!     ", {10, 16}),
+      Split("How are you", {16, 27}), Split("?!?", {27, 30})};
+  auto got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey friend!     How are you?!?")));
+  validate_splits(expected, got.splits);
+  expected = {Split("どこで生れ", {0, 5}), Split("。", {5, 6}),
+              Split("Yes", {6, 9})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"どこで生れ。Yes")));
+  validate_splits(expected, got.splits);
+  expected = {Split("ハーブ", {0, 3}), Split("Тест", {3, 7})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"ハーブТест")));
+  validate_splits(expected, got.splits);
+}
+
+TEST(CharDelimiterSplitPreTokenizerTest, Simple) {
+  std::unique_ptr<PreTokenizer> pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"CharDelimiterSplit\",\"delimiter\":\"-\"}");
+  EXPECT_NE(pre_tokenizer, nullptr);
+  std::vector<Split> expected = {Split("Hey", {0, 3}), Split("friend", {4, 10}),
+                                 Split("野口", {12, 14})};
+  auto got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey-friend--野口-")));
+  validate_splits(expected, got.splits);
+  pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"CharDelimiterSplit\",\"delimiter\":\"▁\"}");
+  expected = {Split("Hey", {0, 3}), Split("friend", {4, 10})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey▁friend")));
+  validate_splits(expected, got.splits);
+}
+
+TEST(MetaspacePreTokenizerTest, Simple) {
+  std::unique_ptr<PreTokenizer> pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Metaspace\",\"replacement\":\"▁\",\"prepend_scheme\":"
+      "\"always\",\"split\":true}");
+  EXPECT_NE(pre_tokenizer, nullptr);
+  std::vector<Split> expected = {Split("▁Hey", {0, 4}),
+                                 Split("▁friend!", {4, 12})};
+  auto got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey friend!")));
+  validate_splits(expected, got.splits);
+  EXPECT_EQ(L"▁Hey friend!", got.normalized.normalized);
+  expected = {Split("▁Hey", {0, 4}), Split("▁", {4, 5}), Split("▁", {5, 6}),
+              Split("▁friend!", {6, 14})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey   friend!")));
+  validate_splits(expected, got.splits);
+  expected = {Split("▁Hey", {0, 4}), Split("▁friend!", {4, 12})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L" Hey friend!")));
+  validate_splits(expected, got.splits);
+}
+
+TEST(MetaspacePreTokenizerTest, PrependScheme) {
+  std::unique_ptr<PreTokenizer> pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Metaspace\",\"replacement\":\"▁\",\"prepend_scheme\":"
+      "\"never\",\"split\":true}");
+  EXPECT_NE(pre_tokenizer, nullptr);
+  std::vector<Split> expected = {Split("Hey", {0, 3}),
+                                 Split("▁friend!", {3, 11})};
+  auto got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey friend!")));
+  validate_splits(expected, got.splits);
+  pre_tokenizer = get_pre_tokenizer_from_string(
+      "{\"type\":\"Metaspace\",\"replacement\":\"▁\",\"add_prefix_space\":true,"
+      "\"split\":false}");
+  expected = {Split("▁Hey▁friend!", {0, 12})};
+  got = pre_tokenizer->pre_tokenize(
+      PreTokenizedString(NormalizedString(L"Hey friend!")));
+  validate_splits(expected, got.splits);
+}
@@ -0,0 +1,63 @@
+// Copyright 2024 Omkar Prabhu
+#include "tokenizers/regex.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+TEST(RegexTest, Dfa) {
+  Regex regex(
+      "(?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\\r\\n\\p{L}\\p{N}]?\\p{L}+|\\p{N}{1,3}| "
+      "?[^\\s\\p{L}\\p{N}]+[\\r\\n]*|\\s*[\\r\\n]+|\\s+(?!\\S)|\\s+");
+  EXPECT_TRUE(regex.is_dfa());
+  std::vector<std::pair<int, int>> expected = {
+      {0, 5},   {5, 8},   {8, 14},  {14, 15}, {15, 16},
+      {16, 19}, {19, 21}, {21, 26}, {26, 27}};
+  EXPECT_EQ(expected, regex.find_matches("Hello'RE world  12345 !?\n\n "));
+  expected = {{0, 3}, {3, 15}, {15, 22}};
+  EXPECT_EQ(expected, regex.find_matches("Hé ünïcödé 日本"));
+}
+
+TEST(RegexTest, Fallback) {
+  Regex regex("(a)\\1|\\bb");
+  EXPECT_FALSE(regex.is_dfa());
+  std::vector<std::pair<int, int>> expected = {{0, 2}, {3, 4}};
+  EXPECT_EQ(expected, regex.find_matches("aa b ab"));
+}
+
+TEST(RegexTest, Search) {
+  // a prefix failing at every position is read once
+  Regex regex("a+b");
+  EXPECT_TRUE(regex.is_dfa());
+  std::string input(200000, 'a');
+  EXPECT_TRUE(regex.find_matches(input).empty());
+  std::vector<std::pair<int, int>> expected = {{0, 200001}};
+  EXPECT_EQ(expected, regex.find_matches(input + "b"));
+  // same matches as ICU, reached through a never matching fallback branch
+  std::vector<std::string> patterns = {
+      "'s|'t|'re|'ve|'m|'ll|'d| ?\\p{L}+| ?\\p{N}+| ?[^\\s\\p{L}\\p{N}]+|"
+      "\\s+(?!\\S)|\\s+",
+      "(?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\\r\\n\\p{L}\\p{N}]?\\p{L}+|\\p{N}{1,3}| "
+      "?[^\\s\\p{L}\\p{N}]+[\\r\\n]*|\\s*[\\r\\n]+|\\s+(?!\\S)|\\s+",
+      "ab|abc", "a+?b", "a{2,3}?", "x?|yzx", "a|ab*c", "[ab]*c", "a*"};
+  std::string alphabet[] = {"a", "b", "c", "x", "y", "z", " ", "\n", "1", "'",
+                            "é"};
+  uint32_t seed = 1;
+  for (const std::string &pattern : patterns) {
+    Regex dfa(pattern);
+    Regex fallback("(?:" + pattern + ")|\\b(?!x)x");
+    EXPECT_TRUE(dfa.is_dfa());
+    EXPECT_FALSE(fallback.is_dfa());
+    for (int i = 0; i < 200; i++) {
+      input.clear();
+      for (int j = 0; j < i % 40; j++) {
+        seed = seed * 1103515245 + 12345;
+        input += alphabet[(seed >> 16) % 11];
+      }
+      EXPECT_EQ(fallback.find_matches(input), dfa.find_matches(input))
+          << pattern << " on " << input;
+    }
+  }
+}
@@ -3,8 +3,12 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdio>
+#include <fstream>
 #include <memory>
+#include <string>
 #include <typeinfo>
+#include <vector>
 
 void assert_tokenizer_encoding(Encoding expected, Encoding got) {
   EXPECT_EQ(expected.ids, got.ids);
@@ -32,6 +36,7 @@ TEST(TokenizerTest, Success) {
   Encoding expected = Encoding({}, {}, {}, {}, {}, {}, {});
   Encoding got = tokenizer.encode(L"Hello World!", true);
   assert_tokenizer_encoding(expected, got);
+  EXPECT_EQ(DYNAMIC_PIPELINE, tokenizer.get_pipeline());
   // valid components
   tokenizer = Tokenizer(
       "",
@@ -63,11 +68,25 @@ TEST(TokenizerTest, Success) {
       "\",\"max_input_chars_per_word\":100,\"vocab\":{\"[PAD]\":0}}}");
   expected = Encoding({101, 0, 0, 0, 102}, {0, 0, 0, 0, 0},
                       {"[CLS]", "[UNK]", "[UNK]", "[UNK]", "[SEP]"},
-                      {std::nullopt, 0, 1, 2, std::nullopt},
+                      {NO_WORD, 0, 1, 2, NO_WORD},
                       {{0, 0}, {0, 5}, {6, 11}, {11, 12}, {0, 0}},
                       {1, 0, 0, 0, 1}, {1, 1, 1, 1, 1});
   got = tokenizer.encode(L"Hello World!", true);
   assert_tokenizer_encoding(expected, got);
+  EXPECT_EQ(FUSED_BERT_PIPELINE, tokenizer.get_pipeline());
+  // reused encoding
+  const int32_t* ids = got.ids.data();
+  tokenizer.encode_into("Hello World!", &got);
+  assert_tokenizer_encoding(expected, got);
+  EXPECT_EQ(ids, got.ids.data());
+  tokenizer.encode_into("Hello", &got);
+  EXPECT_EQ(std::vector<int32_t>({101, 0, 102}), got.ids);
+  EXPECT_EQ(ids, got.ids.data());
+  std::vector<Encoding> batch(1, got);
+  tokenizer.encode_batch_into({"Hello World!", "Hello"}, &batch);
+  EXPECT_EQ(2, batch.size());
+  assert_tokenizer_encoding(expected, batch[0]);
+  EXPECT_EQ(std::vector<int32_t>({101, 0, 102}), batch[1].ids);
 }
 
 TEST(TokenizerTest, Error) {
@@ -79,4 +98,234 @@ TEST(TokenizerTest, Error) {
       std::runtime_error);
   // invalid json config string
   EXPECT_THROW({ auto tokenizer = Tokenizer("", "{}"); }, std::runtime_error);
+  // invalid binary file
+  EXPECT_THROW(
+      { auto tokenizer = Tokenizer::load_binary("invalid-file-path"); },
+      std::runtime_error);
+  std::string path = testing::TempDir() + "invalid.bin";
+  std::ofstream(path) << "{\"truncation\":null}";
+  EXPECT_THROW(
+      { auto tokenizer = Tokenizer::load_binary(path); }, std::runtime_error);
+  std::remove(path.c_str());
+}
+
+TEST(TokenizerTest, Metaspace) {
+  auto tokenizer = Tokenizer(
+      "",
+      "{\"truncation\":null,\"padding\":null,\"added_tokens\":[],"
+      "\"normalizer\":null,\"pre_tokenizer\":{\"type\":\"Metaspace\","
+      "\"replacement\":\"▁\",\"prepend_scheme\":\"always\",\"split\":true},"
+      "\"model\":{\"type\":\"BPE\",\"dropout\":null,\"unk_token\":null,"
+      "\"continuing_subword_prefix\":null,\"end_of_word_suffix\":null,"
+      "\"fuse_unk\":false,\"byte_fallback\":false,\"ignore_merges\":false,"
+      "\"vocab\":{\"▁\":0,\"H\":1,\"e\":2,\"y\":3,\"▁H\":4,\"▁He\":5,"
+      "\"▁Hey\":6,\"f\":7,\"r\":8,\"i\":9,\"n\":10,\"d\":11},\"merges\":[\"▁ "
+      "H\",\"▁H e\",\"▁He y\"]},\"post_processor\":null,\"decoder\":{"
+      "\"type\":\"Metaspace\",\"replacement\":\"▁\",\"prepend_scheme\":"
+      "\"always\",\"split\":true}}");
+  Encoding expected = Encoding(
+      {6, 0, 7, 8, 9, 2, 11}, {0, 0, 0, 0, 0, 0, 0},
+      {"▁Hey", "▁", "f", "r", "i", "e", "d"}, {0, 1, 1, 1, 1, 1, 1},
+      {{0, 3}, {3, 4}, {4, 5}, {5, 6}, {6, 7}, {7, 8}, {8, 9}},
+      {0, 0, 0, 0, 0, 0, 0}, {1, 1, 1, 1, 1, 1, 1});
+  Encoding got = tokenizer.encode(L"Hey fried", true);
+  assert_tokenizer_encoding(expected, got);
+  EXPECT_EQ("Hey fried", tokenizer.decode(got.ids));
+  // tokens are views into the same interned vocabulary
+  EXPECT_EQ(got.tokens[0].data(),
+            tokenizer.encode(L"Hey", true).tokens[0].data());
+  DecodedBatch batch = tokenizer.decode_batch(
+      {6, 0, 7, 6, 11, 2, 6, 8, 9}, {0, 3, 3, 6, 9}, true, 3);
+  EXPECT_EQ(4, batch.size());
+  EXPECT_EQ("Hey f", batch.sequence(0));
+  EXPECT_EQ("", batch.sequence(1));
+  EXPECT_EQ("Heyde", batch.sequence(2));
+  batch = tokenizer.decode_batch({6, 0, 7, 8, 9, 2, 11, 6, 11, 2, 6, 8, 9},
+                                 {0, 7, 10, 13});
+  EXPECT_EQ("Hey friedHeydeHeyri", batch.buffer);
+  std::vector<size_t> offsets = {0, 9, 14, 19};
+  EXPECT_EQ(offsets, batch.offsets);
+  EXPECT_THROW(tokenizer.decode_batch({6, 0, 7, 8, 9, 2}, {0, 5, 2, 6}),
+               std::invalid_argument);
+  EXPECT_THROW(tokenizer.decode_batch({6, 0, 7}, {0, 4}),
+               std::invalid_argument);
+}
+
+TEST(TokenizerTest, DecodeStream) {
+  auto tokenizer = Tokenizer(
+      "",
+      "{\"truncation\":null,\"padding\":null,\"added_tokens\":[{\"id\":0,"
+      "\"content\":\"<s>\",\"single_word\":false,\"lstrip\":false,"
+      "\"rstrip\":false,\"normalized\":false,\"special\":true}],"
+      "\"normalizer\":null,\"pre_tokenizer\":null,\"model\":{\"type\":"
+      "\"BPE\",\"dropout\":null,\"unk_token\":null,"
+      "\"continuing_subword_prefix\":null,\"end_of_word_suffix\":null,"
+      "\"fuse_unk\":false,\"byte_fallback\":true,\"ignore_merges\":false,"
+      "\"vocab\":{\"<s>\":0,\"▁Hey\":1,\"▁friend\":2,\"<0x21>\":3,\"▁\":4,"
+      "\"<0xE5>\":5,\"<0x8F>\":6,\"<0xAB>\":7},\"merges\":[]},"
+      "\"post_processor\":null,\"decoder\":{\"type\":\"Sequence\","
+      "\"decoders\":[{\"type\":\"Replace\",\"pattern\":{\"String\":\"▁\"},"
+      "\"content\":\" \"},{\"type\":\"ByteFallback\"},{\"type\":\"Fuse\"},"
+      "{\"type\":\"Strip\",\"content\":\" \",\"start\":1,\"stop\":0}]}}");
+  std::vector<int> ids = {0, 1, 2, 3, 4, 5, 6, 7};
+  DecodeStream stream = tokenizer.decode_stream();
+  std::vector<std::optional<std::string>> expected = {
+      std::nullopt, "Hey",        " friend",    "!",
+      " ",          std::nullopt, std::nullopt, "叫"};
+  for (int i = 0; i < ids.size(); i++) {
+    EXPECT_EQ(expected[i], stream.step(ids[i]));
+  }
+  EXPECT_EQ("Hey friend! 叫", tokenizer.decode(ids));
+  DecodeTree tree(&tokenizer);
+  std::vector<int> nodes = tree.extend({{-1, 1}, {0, 2}, {0, 4}});
+  nodes = tree.extend({{nodes[1], 3}, {nodes[2], 5}, {nodes[2], 1}});
+  nodes = tree.extend({{nodes[1], 6}, {nodes[1], 7}});
+  EXPECT_EQ(" Hey", tree.new_text(5));
+  EXPECT_EQ("", tree.new_text(nodes[0]));
+  EXPECT_EQ("Hey friend!", tree.text(3));
+  EXPECT_EQ("Hey  Hey", tree.text(5));
+  EXPECT_EQ("Hey ", tree.text(nodes[1]));
+  EXPECT_EQ("叫", tree.new_text(tree.extend(nodes[0], 7)));
+  EXPECT_THROW(tree.extend(9, 1), std::invalid_argument);
+}
+
+TEST(TokenizerTest, DecodeStreamLong) {
+  // streamed steps of a long generation join into its whole decode
+  std::vector<std::string> configs = {
+      "{\"truncation\":null,\"padding\":null,\"added_tokens\":[],"
+      "\"normalizer\":null,\"pre_tokenizer\":null,\"model\":{\"type\":"
+      "\"WordPiece\",\"unk_token\":\"[UNK]\",\"continuing_subword_"
+      "prefix\":\"##\",\"max_input_chars_per_word\":100,\"vocab\":{"
+      "\"[UNK]\":0,\"a\":1,\"b\":2,\"##c\":3,\"d\":4,\"##b\":5,"
+      "\"ef\":6}},\"post_processor\":null,\"decoder\":{\"type\":"
+      "\"WordPiece\",\"prefix\":\"##\",\"cleanup\":true}}",
+      "{\"truncation\":null,\"padding\":null,\"added_tokens\":[],"
+      "\"normalizer\":null,\"pre_tokenizer\":null,\"model\":{\"type\":"
+      "\"BPE\",\"dropout\":null,\"unk_token\":null,"
+      "\"continuing_subword_prefix\":null,\"end_of_word_suffix\":null,"
+      "\"fuse_unk\":false,\"byte_fallback\":false,\"ignore_merges\":"
+      "false,\"vocab\":{\"▁\":0,\"H\":1,\"e\":2,\"y\":3,\"▁H\":4,"
+      "\"▁He\":5,\"▁Hey\":6},\"merges\":[]},\"post_processor\":null,"
+      "\"decoder\":{\"type\":\"Metaspace\",\"replacement\":\"▁\","
+      "\"prepend_scheme\":\"always\",\"split\":true}}"};
+  for (const std::string &config : configs) {
+    Tokenizer tokenizer("", config);
+    std::vector<int> ids;
+    for (int i = 0; i < 40; i++) {
+      ids.push_back((i * 5 + i / 3) % 7);
+    }
+    DecodeStream stream = tokenizer.decode_stream();
+    std::string text;
+    for (int id : ids) {
+      text += stream.step(id).value_or("");
+    }
+    EXPECT_EQ(tokenizer.decode(ids), text);
+  }
+}
+
+TEST(TokenizerTest, EncodePair) {
+  auto tokenizer = Tokenizer(
+      "",
+      "{\"truncation\":{\"direction\":\"Right\",\"max_length\":6,\"strategy\":"
+      "\"LongestFirst\",\"stride\":0},\"padding\":null,\"added_tokens\":[{"
+      "\"id\":1,\"content\":\"[CLS]\",\"single_word\":false,\"lstrip\":false,"
+      "\"rstrip\":false,\"normalized\":false,\"special\":true},{\"id\":2,"
+      "\"content\":\"[SEP]\",\"single_word\":false,\"lstrip\":false,"
+      "\"rstrip\":false,\"normalized\":false,\"special\":true}],"
+      "\"normalizer\":null,\"pre_tokenizer\":{\"type\":\"Whitespace\"},"
+      "\"post_processor\":{\"type\":\"TemplateProcessing\",\"single\":[{"
+      "\"SpecialToken\":{\"id\":\"[CLS]\",\"type_id\":0}},{\"Sequence\":{"
+      "\"id\":\"A\",\"type_id\":0}},{\"SpecialToken\":{\"id\":\"[SEP]\","
+      "\"type_id\":0}}],\"pair\":[{\"SpecialToken\":{\"id\":\"[CLS]\","
+      "\"type_id\":0}},{\"Sequence\":{\"id\":\"A\",\"type_id\":0}},{"
+      "\"SpecialToken\":{\"id\":\"[SEP]\",\"type_id\":0}},{\"Sequence\":{"
+      "\"id\":\"B\",\"type_id\":1}},{\"SpecialToken\":{\"id\":\"[SEP]\","
+      "\"type_id\":1}}],\"special_tokens\":{\"[CLS]\":{\"id\":\"[CLS]\","
+      "\"ids\":[1],\"tokens\":[\"[CLS]\"]},\"[SEP]\":{\"id\":\"[SEP]\","
+      "\"ids\":[2],\"tokens\":[\"[SEP]\"]}}},\"decoder\":null,\"model\":{"
+      "\"type\":\"WordPiece\",\"unk_token\":\"[UNK]\","
+      "\"continuing_subword_prefix\":\"##\",\"max_input_chars_per_word\":100,"
+      "\"vocab\":{\"[UNK]\":0,\"[CLS]\":1,\"[SEP]\":2,\"hello\":3,\"world\":4,"
+      "\"how\":5,\"are\":6,\"you\":7}}}");
+  Encoding expected({1, 3, 2, 5, 6, 2}, {0, 0, 0, 1, 1, 1},
+                    {"[CLS]", "hello", "[SEP]", "how", "are", "[SEP]"},
+                    {NO_WORD, 0, NO_WORD, 0, 1, NO_WORD},
+                    {{0, 0}, {0, 5}, {0, 0}, {0, 3}, {4, 7}, {0, 0}},
+                    {1, 0, 1, 0, 0, 1}, {1, 1, 1, 1, 1, 1});
+  expected.overflowing = {
+      Encoding({1, 4, 2, 5, 6, 2}, {0, 0, 0, 1, 1, 1},
+               {"[CLS]", "world", "[SEP]", "how", "are", "[SEP]"},
+               {NO_WORD, 1, NO_WORD, 0, 1, NO_WORD},
+               {{0, 0}, {6, 11}, {0, 0}, {0, 3}, {4, 7}, {0, 0}},
+               {1, 0, 1, 0, 0, 1}, {1, 1, 1, 1, 1, 1}),
+      Encoding({1, 4, 2, 7, 2}, {0, 0, 0, 1, 1},
+               {"[CLS]", "world", "[SEP]", "you", "[SEP]"},
+               {NO_WORD, 1, NO_WORD, 2, NO_WORD},
+               {{0, 0}, {6, 11}, {0, 0}, {8, 11}, {0, 0}}, {1, 0, 1, 0, 1},
+               {1, 1, 1, 1, 1}),
+      Encoding({1, 3, 2, 7, 2}, {0, 0, 0, 1, 1},
+               {"[CLS]", "hello", "[SEP]", "you", "[SEP]"},
+               {NO_WORD, 0, NO_WORD, 2, NO_WORD},
+               {{0, 0}, {0, 5}, {0, 0}, {8, 11}, {0, 0}}, {1, 0, 1, 0, 1},
+               {1, 1, 1, 1, 1})};
+  Encoding got = tokenizer.encode_pair(L"hello world", L"how are you");
+  assert_tokenizer_encoding(expected, got);
+  std::vector<Encoding> batch = tokenizer.encode_pair_batch(
+      {{L"hello world", L"how are you"}, {L"hello", L"you"}});
+  EXPECT_EQ(2, batch.size());
+  assert_tokenizer_encoding(expected, batch[0]);
+  EXPECT_EQ(std::vector<int>({1, 3, 2, 7, 2}), batch[1].ids);
+  got = tokenizer.encode_pair(L"hello world", L"how are you", true,
+                              ATTENTION_MASK_ENCODE_OPTION);
+  EXPECT_EQ(expected.ids, got.ids);
+  EXPECT_EQ(expected.attention_mask, got.attention_mask);
+  EXPECT_TRUE(got.tokens.empty());
+  EXPECT_TRUE(got.offsets.empty());
+  EXPECT_EQ(expected.overflowing[1].ids, got.overflowing[1].ids);
+}
+
+TEST(TokenizerTest, Binary) {
+  std::vector<std::string> configs = {
+      "{\"truncation\":null,\"padding\":null,\"added_tokens\":[{\"id\":12,"
+      "\"content\":\"<s>\",\"single_word\":false,\"lstrip\":false,"
+      "\"rstrip\":false,\"normalized\":false,\"special\":true}],"
+      "\"normalizer\":null,\"pre_tokenizer\":{\"type\":\"Metaspace\","
+      "\"replacement\":\"▁\",\"prepend_scheme\":\"always\",\"split\":true},"
+      "\"model\":{\"type\":\"BPE\",\"dropout\":null,\"unk_token\":null,"
+      "\"continuing_subword_prefix\":null,\"end_of_word_suffix\":null,"
+      "\"fuse_unk\":false,\"byte_fallback\":false,\"ignore_merges\":false,"
+      "\"vocab\":{\"▁\":0,\"H\":1,\"e\":2,\"y\":3,\"▁H\":4,\"▁He\":5,"
+      "\"▁Hey\":6,\"f\":7,\"r\":8,\"i\":9,\"n\":10,\"d\":11},\"merges\":[\"▁ "
+      "H\",\"▁H e\",\"▁He y\"]},\"post_processor\":null,\"decoder\":{"
+      "\"type\":\"Metaspace\",\"replacement\":\"▁\",\"prepend_scheme\":"
+      "\"always\",\"split\":true}}",
+      "{\"truncation\":null,\"padding\":null,\"added_tokens\":[],"
+      "\"normalizer\":{\"type\":\"BertNormalizer\",\"clean_text\":true,"
+      "\"handle_chinese_chars\":true,\"strip_accents\":null,\"lowercase\":"
+      "true},\"pre_tokenizer\":{\"type\":\"BertPreTokenizer\"},\"model\":{"
+      "\"type\":\"WordPiece\",\"unk_token\":\"[UNK]\","
+      "\"continuing_subword_prefix\":\"##\",\"max_input_chars_per_word\":100,"
+      "\"vocab\":{\"[UNK]\":0,\"hey\":1,\"fri\":2,\"##ed\":3}},"
+      "\"post_processor\":null,\"decoder\":{\"type\":\"WordPiece\","
+      "\"prefix\":\"##\",\"cleanup\":true}}"};
+  std::string path = testing::TempDir() + "tokenizer.bin";
+  std::string copy_path = testing::TempDir() + "tokenizer_copy.bin";
+  std::vector<std::wstring> inputs = {L"Hey fried", L"<s>Hey xyz <s>"};
+  for (const std::string &config : configs) {
+    auto tokenizer = Tokenizer("", config);
+    tokenizer.save_binary(path);
+    auto loaded = Tokenizer::load_binary(path);
+    EXPECT_EQ(tokenizer.get_pipeline(), loaded.get_pipeline());
+    // saved again from the mapped tables
+    loaded.save_binary(copy_path);
+    auto copy = Tokenizer::load_binary(copy_path);
+    for (const std::wstring &input : inputs) {
+      Encoding expected = tokenizer.encode(input, true);
+      assert_tokenizer_encoding(expected, loaded.encode(input, true));
+      assert_tokenizer_encoding(expected, copy.encode(input, true));
+      EXPECT_EQ(tokenizer.decode(expected.ids), loaded.decode(expected.ids));
+    }
+  }
+  std::remove(path.c_str());
+  std::remove(copy_path.c_str());
 }
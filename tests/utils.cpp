@@ -50,7 +50,8 @@ TEST(TruncationTest, LongestFirst) {
   Encoding expected({12}, {0}, {"hello"}, {0}, {{0, 5}}, {0}, {1});
   expected.overflowing = {
       Encoding({14}, {0}, {"world"}, {0}, {{6, 11}}, {0}, {1})};
-  Encoding got = truncation->truncate_encoding(input_encoding);
+  Encoding got = input_encoding;
+  truncation->truncate_encoding(&got);
   assert_utils_encoding(expected, got);
 }
 
@@ -64,7 +65,8 @@ TEST(TruncationTest, OnlyFirst) {
   Encoding expected({12}, {0}, {"hello"}, {0}, {{0, 5}}, {0}, {1});
   expected.overflowing = {
       Encoding({14}, {0}, {"world"}, {0}, {{6, 11}}, {0}, {1})};
-  Encoding got = truncation->truncate_encoding(input_encoding);
+  Encoding got = input_encoding;
+  truncation->truncate_encoding(&got);
   assert_utils_encoding(expected, got);
 }
 
@@ -82,7 +84,8 @@ TEST(PaddingTest, BatchLongest) {
                     {0, 0, 0, 0, 0, 0},
                     {{0, 5}, {6, 11}, {12, 16}, {17, 27}, {0, 0}, {0, 0}},
                     {0, 0, 0, 0, 1, 1}, {1, 1, 1, 1, 0, 0});
-  Encoding got = padding->pad_encoding(input_encoding);
+  Encoding got = input_encoding;
+  padding->pad_encoding(&got);
   assert_utils_encoding(expected, got);
 }
 
@@ -95,6 +98,31 @@ TEST(PaddingTest, Fixed) {
                           {{0, 5}, {6, 11}}, {0, 0}, {1, 1});
   Encoding expected({12, 14, 1}, {0, 0, 1}, {"hello", "world", "[PAD]"},
                     {0, 0, 0}, {{0, 5}, {6, 11}, {0, 0}}, {0, 0, 1}, {1, 1, 0});
-  Encoding got = padding->pad_encoding(input_encoding);
+  Encoding got = input_encoding;
+  padding->pad_encoding(&got);
   assert_utils_encoding(expected, got);
 }
+
+TEST(TruncationTest, Pair) {
+  std::unique_ptr<Truncation> truncation = get_truncation_from_string(
+      "{\"strategy\":\"LongestFirst\",\"direction\":\"Right\",\"max_length\":"
+      "5,\"stride\":0}");
+  Encoding encoding({12, 14}, {0, 0}, {"hello", "world"}, {0, 1},
+                    {{0, 5}, {6, 11}}, {0, 0}, {1, 1});
+  Encoding pair({15, 16, 17}, {1, 1, 1}, {"how", "are", "you"}, {0, 1, 2},
+                {{0, 3}, {4, 7}, {8, 11}}, {0, 0, 0}, {1, 1, 1});
+  Encoding first = encoding, second = pair;
+  truncation->truncate_pair(&first, &second, 2);
+  EXPECT_EQ(std::vector<int>({12}), first.ids);
+  EXPECT_EQ(std::vector<int>({15, 16}), second.ids);
+  EXPECT_EQ(1, first.overflowing.size());
+  EXPECT_EQ(1, second.overflowing.size());
+  truncation = get_truncation_from_string(
+      "{\"strategy\":\"OnlySecond\",\"direction\":\"Left\",\"max_length\":"
+      "4,\"stride\":0}");
+  first = encoding, second = pair;
+  truncation->truncate_pair(&first, &second);
+  EXPECT_EQ(std::vector<int>({12, 14}), first.ids);
+  EXPECT_EQ(std::vector<int>({16, 17}), second.ids);
+  EXPECT_EQ(std::vector<int>({15}), second.overflowing[0].ids);
+}